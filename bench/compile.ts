@@ -0,0 +1,102 @@
+import path from "path";
+import { performance } from "perf_hooks";
+
+/**
+ * Measure the compile latency of the languages with a compile server (see src/compileServer.ts), by compiling
+ * different trivial programs of each language one by one, with and without the compile server.
+ *
+ * Usage: yarn bench:compile --config <judge config.yaml> [--compilations 20] [--languages kotlin]
+ *
+ * The first compilation of each mode is not counted, since it starts the compile server.
+ */
+
+interface CompileBenchLanguage {
+  compileAndRunOptions: unknown;
+  // A different code for each compilation, not to be cached
+  getCode: (index: number) => string;
+}
+
+const LANGUAGES: Record<string, CompileBenchLanguage> = {
+  kotlin: {
+    compileAndRunOptions: { version: "1.5", platform: "jvm" },
+    getCode: index => `fun main() {\n    println(readLine()!!.split(" ").sumOf { it.toInt() } + ${index})\n}`
+  }
+};
+
+function parseArguments(argv: string[]) {
+  const options: Record<string, string> = {};
+  for (let i = 0; i < argv.length; i++) {
+    if (argv[i].startsWith("--")) options[argv[i].slice(2)] = argv[++i];
+  }
+  return options;
+}
+
+async function main() {
+  const options = parseArguments(process.argv.slice(2));
+  if (!options.config) {
+    console.error("Usage: yarn bench:compile --config <judge config.yaml> [--compilations 20] [--languages kotlin]");
+    process.exit(1);
+  }
+
+  // The config is loaded on importing the judge's modules
+  process.env.LYRIO_JUDGE_CONFIG_FILE = path.resolve(options.config);
+  const { updateServerSideConfig } = await import("@/config");
+  const { compile, CompileResultSuccess } = await import("@/compile");
+  const { setCompileServerLanguages } = await import("@/compileServer");
+  const { summarize } = await import("./stats");
+
+  updateServerSideConfig({
+    limit: { compilerMessage: 50000, outputSize: 104857600, dataDisplay: 128, stderrDisplay: 5120 }
+  });
+
+  const compilations = Number(options.compilations) || 20;
+  const languages = (options.languages || Object.keys(LANGUAGES).join(",")).split(",");
+
+  console.log(
+    `${"Language".padEnd(10)}${"Mode".padEnd(12)}${"Latency p50 (ms)".padStart(18)}` +
+      `${"Latency mean (ms)".padStart(19)}${"Latency max (ms)".padStart(18)}`
+  );
+  for (const language of languages) {
+    const benchLanguage = LANGUAGES[language];
+    if (!benchLanguage) throw new Error(`No compile benchmark for language ${language}`);
+
+    const medians: Record<string, number> = {};
+    for (const mode of ["sandbox", "server"]) {
+      setCompileServerLanguages(mode === "server" ? [language] : []);
+
+      const latencies: number[] = [];
+      for (let i = 0; i <= compilations; i++) {
+        const startTime = performance.now();
+        const compileResult = await compile({
+          language,
+          code: `${benchLanguage.getCode(i)}\n// ${mode} ${process.pid}\n`,
+          compileAndRunOptions: benchLanguage.compileAndRunOptions
+        });
+        const latency = performance.now() - startTime;
+
+        if (!compileResult.success) {
+          throw new Error(`Failed to compile the ${language} program: ${JSON.stringify(compileResult.message)}`);
+        }
+        if (compileResult instanceof CompileResultSuccess) await compileResult.dereference();
+        if (i > 0) latencies.push(latency);
+      }
+
+      const latency = summarize(latencies);
+      medians[mode] = latency.p50;
+      console.log(
+        `${language.padEnd(10)}${mode.padEnd(12)}${latency.p50.toFixed(0).padStart(18)}` +
+          `${latency.mean.toFixed(0).padStart(19)}${latency.max.toFixed(0).padStart(18)}`
+      );
+    }
+
+    const reduction = 1 - medians.server / medians.sandbox;
+    console.log(`${language.padEnd(10)}${"reduction".padEnd(12)}${`${(reduction * 100).toFixed(1)}%`.padStart(18)}`);
+  }
+
+  process.exit(0);
+}
+
+main().catch(e => {
+  console.error(e);
+  process.exit(1);
+});
@@ -0,0 +1,78 @@
+import http from "http";
+import { AddressInfo } from "net";
+import { EventEmitter } from "events";
+
+/**
+ * A stand-in of a remote compile store with `type: http` (see src/remoteCompileStore.ts), which serves `GET` and
+ * accepts `PUT` of the files under its URL like nginx with `dav_methods PUT`, keeping them in memory.
+ *
+ * Events:
+ * * fetched(filename, found)
+ * * uploaded(filename, bytes)
+ */
+export class StandInCompileStore extends EventEmitter {
+  private httpServer: http.Server;
+
+  readonly files: Map<string, Buffer> = new Map();
+
+  url: string;
+
+  /**
+   * Flip a byte of a stored file, as if it's corrupted in the store.
+   */
+  corrupt(filename: string) {
+    const content = this.files.get(filename);
+    if (!content) throw new Error(`No such file in the stand-in compile store: ${filename}`);
+
+    const corrupted = Buffer.from(content);
+    corrupted[corrupted.length >> 1] ^= 0xff;
+    this.files.set(filename, corrupted);
+  }
+
+  async start() {
+    this.httpServer = http.createServer((request, response) => this.serve(request, response));
+    await new Promise<void>(resolve => this.httpServer.listen(0, "127.0.0.1", resolve));
+    this.url = `http://127.0.0.1:${(this.httpServer.address() as AddressInfo).port}/store`;
+    return this.url;
+  }
+
+  async stop() {
+    await new Promise(resolve => this.httpServer.close(resolve));
+  }
+
+  private serve(request: http.IncomingMessage, response: http.ServerResponse) {
+    const filename = /^\/store\/([^/?]+)$/.exec(request.url)?.[1];
+    if (!filename) {
+      response.writeHead(400).end(`Bad path: ${request.url}`);
+      return;
+    }
+
+    if (request.method === "GET") {
+      const content = this.files.get(filename);
+      this.emit("fetched", filename, !!content);
+      if (!content) {
+        response.writeHead(404).end(`No such file: ${filename}`);
+        return;
+      }
+
+      response.writeHead(200, { "Content-Type": "application/octet-stream", "Content-Length": content.length });
+      response.end(content);
+    } else if (request.method === "PUT") {
+      const chunks: Buffer[] = [];
+      request.on("data", (chunk: Buffer) => chunks.push(chunk));
+      request.on("end", () => {
+        const content = Buffer.concat(chunks);
+        if (request.headers["content-length"] && Number(request.headers["content-length"]) !== content.length) {
+          response.writeHead(400).end("Incomplete body");
+          return;
+        }
+
+        // Replaced only after the whole body is received, so a partial file is never served
+        const existed = this.files.has(filename);
+        this.files.set(filename, content);
+        response.writeHead(existed ? 204 : 201).end();
+        this.emit("uploaded", filename, content.length);
+      });
+    } else response.writeHead(405, { Allow: "GET, PUT" }).end();
+  }
+}
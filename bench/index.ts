@@ -0,0 +1,326 @@
+import fs from "fs";
+import os from "os";
+import path from "path";
+import child_process from "child_process";
+
+import yaml from "js-yaml";
+
+import { StandInServer } from "./server";
+import { loadScenario, ScenarioGenerator, BenchTask } from "./scenario";
+import { summarize, readCpuTimes, getCpuBusyRatios, formatDistribution } from "./stats";
+import { readTraceSpans, TraceSpan } from "./trace";
+
+/**
+ * Replay a scenario of submissions to a judge client through a local stand-in server, and report the throughput,
+ * the latency of each phase of the submissions and the CPU utilization of each core.
+ *
+ * Usage: yarn bench <scenario.yaml> --config <judge config.yaml> [--output report.json] [--judge-log judge.log]
+ *                   [--trace directory] [--progress-protocol full|delta] [--no-spawn]
+ *
+ * With --no-spawn the judge client is not started, the server URL and key to configure are printed instead.
+ *
+ * --progress-protocol overrides `progressProtocol` of the judge config, compare the bytes received from the judge
+ * to see the effect of the delta progress protocol.
+ *
+ * With --trace every task is traced by the judge (see src/tracing.ts) to the directory, which adds the phases
+ * measured inside the judge:
+ * * check:        the total time of running checkers of a task
+ * * sandboxStart: the time to start a sandbox, of each sandbox
+ *
+ * The phases are measured on the server side from the protocol, so progress-based ones are only accurate to
+ * the judge's progress debouncing (100ms):
+ * * queue:    released (with "rate") -> sent to the judge
+ * * download: sent -> the last testdata / submission file of the task is served (0 if all cached)
+ * * compile:  "Compiling" progress -> "Running" progress (missing if the compile result is cached)
+ * * run:      "Running" progress -> "Finished" progress, running and checking all testcases
+ * * report:   the wall time of the task not spent in the judge's handler (delivering the task and the progress)
+ */
+
+const KEY = "bench";
+
+// The performance.now() timestamps of the phases of a task
+interface TaskRecord {
+  benchTask: BenchTask;
+  releasedAt: number;
+  sentAt?: number;
+  downloadEndAt?: number;
+  downloadBytes: number;
+  progressAt: Record<string, number>;
+  finalProgress?: { status?: string; totalOccupiedTime?: number; testcaseResult?: Record<string, unknown> };
+  ackedAt?: number;
+  traceSpans?: TraceSpan[];
+}
+
+function parseArguments(argv: string[]) {
+  const options: Record<string, string | boolean> = {};
+  const positional: string[] = [];
+  for (let i = 0; i < argv.length; i++) {
+    if (argv[i] === "--no-spawn") options.noSpawn = true;
+    else if (argv[i].startsWith("--")) options[argv[i].slice(2)] = argv[++i];
+    else positional.push(argv[i]);
+  }
+  return { scenarioFile: positional[0], options };
+}
+
+function writeJudgeConfig(
+  baseConfigFile: string,
+  serverUrl: string,
+  traceDirectory: string,
+  progressProtocol: string
+) {
+  const config = yaml.load(fs.readFileSync(baseConfigFile, "utf-8")) as Record<string, unknown>;
+  config.serverUrl = serverUrl;
+  config.key = KEY;
+  config.downloadEndpointOverride = null;
+  if (traceDirectory) config.tracing = { directory: path.resolve(traceDirectory), sampleRate: 1 };
+  if (progressProtocol) config.progressProtocol = progressProtocol;
+
+  const configFile = path.join(os.tmpdir(), `lyrio-judge-bench-${process.pid}.yaml`);
+  fs.writeFileSync(configFile, yaml.dump(config));
+  return configFile;
+}
+
+function spawnJudge(configFile: string, logFile: string) {
+  const log = fs.openSync(logFile, "w");
+  const judge = child_process.spawn(
+    process.execPath,
+    ["-r", "@swc-node/register", "-r", "tsconfig-paths/register", "src/index"],
+    {
+      cwd: path.resolve(__dirname, ".."),
+      env: { ...process.env, LYRIO_JUDGE_CONFIG_FILE: configFile },
+      stdio: ["ignore", log, log]
+    }
+  );
+  fs.closeSync(log);
+  return judge;
+}
+
+function getReport(records: TaskRecord[], elapsed: number, cpuBusyRatios: Record<string, number>) {
+  const phase = (getValue: (record: TaskRecord) => number) =>
+    summarize(records.map(getValue).filter(value => value != null && Number.isFinite(value)));
+  const between = (record: TaskRecord, from: string, to: string) =>
+    record.progressAt[from] != null && record.progressAt[to] != null
+      ? record.progressAt[to] - record.progressAt[from]
+      : null;
+
+  const statuses: Record<string, number> = {};
+  const submissions: Record<string, number> = {};
+  let testcases = 0;
+  for (const record of records) {
+    const status = record.finalProgress?.status || "Unknown";
+    statuses[status] = (statuses[status] || 0) + 1;
+    submissions[record.benchTask.name] = (submissions[record.benchTask.name] || 0) + 1;
+    testcases += Object.keys(record.finalProgress?.testcaseResult || {}).length;
+  }
+
+  return {
+    submissions: records.length,
+    elapsed,
+    throughput: (records.length / elapsed) * 1000,
+    testcaseThroughput: (testcases / elapsed) * 1000,
+    mix: submissions,
+    statuses,
+    downloadBytes: records.reduce((sum, record) => sum + record.downloadBytes, 0),
+    phases: {
+      queue: phase(record => record.sentAt - record.releasedAt),
+      download: phase(record => (record.downloadEndAt ? Math.max(0, record.downloadEndAt - record.sentAt) : 0)),
+      compile: phase(record => between(record, "Compiling", "Running")),
+      run: phase(record => between(record, "Running", "Finished")),
+      report: phase(record =>
+        record.finalProgress?.totalOccupiedTime != null
+          ? Math.max(0, record.progressAt.Finished - record.sentAt - record.finalProgress.totalOccupiedTime)
+          : null
+      ),
+      total: phase(record => Math.max(record.progressAt.Finished, record.ackedAt) - record.releasedAt),
+      check: phase(record =>
+        record.traceSpans
+          ?.filter(span => span.category === "checker")
+          .reduce((sum, span) => sum + span.duration, 0)
+      ),
+      sandboxStart: summarize(
+        records.flatMap(record =>
+          (record.traceSpans || []).filter(span => span.name === "startSandbox").map(span => span.duration)
+        )
+      )
+    },
+    cpuBusyRatios
+  };
+}
+
+function printReport(report: ReturnType<typeof getReport>, receivedBytes: number) {
+  console.log(`Submissions: ${report.submissions} in ${(report.elapsed / 1000).toFixed(2)}s`);
+  console.log(
+    `Throughput:  ${report.throughput.toFixed(2)} submissions/s, ${report.testcaseThroughput.toFixed(2)} testcases/s`
+  );
+  console.log(
+    `Statuses:    ${Object.entries(report.statuses)
+      .map(([status, count]) => `${status} ${count}`)
+      .join(", ")}`
+  );
+  console.log(`Downloaded:  ${(report.downloadBytes / 1024).toFixed(1)} KiB`);
+  console.log(`Received:    ${(receivedBytes / 1024).toFixed(1)} KiB from the judge`);
+  console.log();
+  const columns = ["count", "mean", "min", "p50", "p90", "p99", "max"];
+  console.log(`${"Phase (ms)".padEnd(10)}${columns.map(column => column.padStart(9)).join("")}`);
+  for (const [name, distribution] of Object.entries(report.phases)) console.log(formatDistribution(name, distribution));
+  console.log();
+  console.log(
+    `CPU busy:    ${Object.entries(report.cpuBusyRatios)
+      .map(([cpu, ratio]) => `cpu${cpu} ${(ratio * 100).toFixed(1)}%`)
+      .join(", ")}`
+  );
+}
+
+async function main() {
+  const { scenarioFile, options } = parseArguments(process.argv.slice(2));
+  if (!scenarioFile || (!options.config && !options.noSpawn)) {
+    console.error("Usage: yarn bench <scenario.yaml> --config <judge config.yaml> [--output report.json]");
+    console.error("                  [--judge-log judge.log] [--no-spawn]");
+    process.exit(1);
+  }
+
+  const scenario = loadScenario(scenarioFile);
+  const server = new StandInServer(KEY, {
+    limit: {
+      compilerMessage: 50000,
+      outputSize: 104857600,
+      dataDisplay: 128,
+      dataDisplayForSubmitAnswer: 128,
+      stderrDisplay: 5120,
+      ...scenario.serverSideConfig?.limit
+    }
+  });
+  const serverUrl = await server.start();
+
+  const generator = new ScenarioGenerator(
+    scenario,
+    path.dirname(path.resolve(scenarioFile)),
+    (content, id) => server.addFile(content, id),
+    id => server.getFileUrl(id)
+  );
+  const warmup = scenario.warmup || 0;
+
+  let judge: child_process.ChildProcess;
+  if (options.noSpawn) {
+    console.log(`Waiting for a judge client with serverUrl: ${serverUrl}/ and key: ${KEY}`);
+  } else {
+    const logFile = (options["judge-log"] as string) || path.join(os.tmpdir(), `lyrio-judge-bench-${process.pid}.log`);
+    const configFile = writeJudgeConfig(
+      options.config as string,
+      serverUrl,
+      options.trace as string,
+      options["progress-protocol"] as string
+    );
+    judge = spawnJudge(configFile, logFile);
+    console.log(`Started judge client, logging to ${logFile}`);
+    judge.on("exit", code => {
+      console.error(`The judge client exited unexpectedly with code ${code}, see its log`);
+      process.exit(1);
+    });
+  }
+
+  const records: Map<string, TaskRecord> = new Map();
+  // The tasks waiting for each file UUID to be downloaded
+  const fileWaiters: Map<string, TaskRecord[]> = new Map();
+  const releasedTasks: TaskRecord[] = [];
+  const waitingConsumers: ((record: TaskRecord) => void)[] = [];
+  let finishedCount = 0;
+  let measureStart: { time: number; cpuTimes: ReturnType<typeof readCpuTimes> };
+
+  const release = () => {
+    const benchTask = generator.next();
+    if (!benchTask) return false;
+    const record: TaskRecord = { benchTask, releasedAt: performance.now(), downloadBytes: 0, progressAt: {} };
+    records.set(benchTask.task.taskId, record);
+    if (waitingConsumers.length) waitingConsumers.shift()(record);
+    else releasedTasks.push(record);
+    return true;
+  };
+
+  const onFinished = async () => {
+    const end = performance.now();
+    const cpuBusyRatios = getCpuBusyRatios(measureStart.cpuTimes, readCpuTimes());
+    const measured = [...records.values()].filter(record => record.benchTask.index >= warmup);
+    if (options.trace) {
+      // The traces are written asynchronously after the tasks finished
+      await new Promise(resolve => setTimeout(resolve, 500));
+      for (const record of measured)
+        record.traceSpans = readTraceSpans(options.trace as string, record.benchTask.task.taskId);
+    }
+    const report = getReport(measured, end - measureStart.time, cpuBusyRatios);
+
+    printReport(report, server.receivedBytes);
+    if (options.output) {
+      fs.writeFileSync(options.output as string, JSON.stringify({ scenario: scenarioFile, ...report }, null, 2));
+    }
+
+    if (judge) {
+      judge.removeAllListeners("exit");
+      judge.kill();
+    }
+    await server.stop();
+    process.exit(0);
+  };
+
+  const checkFinished = (record: TaskRecord) => {
+    if (record.ackedAt == null || record.progressAt.Finished == null) return;
+    if (++finishedCount === generator.total) onFinished();
+  };
+
+  server.on("ready", () => {
+    console.log(`Judge client ready, replaying ${warmup} + ${scenario.submissions} submissions`);
+    if (scenario.rate) {
+      const timer = setInterval(() => release() || clearInterval(timer), 1000 / scenario.rate);
+    }
+  });
+
+  server.on("consumeTask", (threadId: number, sendTask: (task: unknown, onAck: () => void) => void) => {
+    const send = (record: TaskRecord) => {
+      record.sentAt = performance.now();
+      if (record.benchTask.index === warmup) measureStart = { time: record.sentAt, cpuTimes: readCpuTimes() };
+      for (const id of record.benchTask.fileUuids) {
+        if (!fileWaiters.has(id)) fileWaiters.set(id, []);
+        fileWaiters.get(id).push(record);
+      }
+
+      sendTask(record.benchTask.task, () => {
+        record.ackedAt = performance.now();
+        checkFinished(record);
+      });
+    };
+
+    if (!scenario.rate && releasedTasks.length === 0) release();
+    if (releasedTasks.length) send(releasedTasks.shift());
+    else waitingConsumers.push(send);
+  });
+
+  server.on("fileServed", (id: string, bytes: number, startTime: number, endTime: number) => {
+    for (const record of fileWaiters.get(id) || []) {
+      record.downloadEndAt = Math.max(record.downloadEndAt || 0, endTime);
+      record.downloadBytes += bytes;
+    }
+    fileWaiters.delete(id);
+  });
+
+  server.on("progress", (taskId: string, progress: TaskRecord["finalProgress"] & { progressType: string }) => {
+    const record = records.get(taskId);
+    if (!record) return;
+    if (progress.progressType && record.progressAt[progress.progressType] == null)
+      record.progressAt[progress.progressType] = performance.now();
+
+    if (progress.progressType === "Finished") {
+      record.finalProgress = progress;
+      checkFinished(record);
+    }
+  });
+
+  server.on("disconnect", () => {
+    console.error("The judge client disconnected");
+    process.exit(1);
+  });
+}
+
+main().catch(e => {
+  console.error(e);
+  process.exit(1);
+});
@@ -0,0 +1,157 @@
+import path from "path";
+import { performance } from "perf_hooks";
+
+import { StandInCompileStore } from "./compileStoreServer";
+
+/**
+ * Exercise the HTTP backend of the remote compile store (see src/remoteCompileStore.ts) against a local stand-in of
+ * the store, and measure its latency. Each compilation is of a different trivial checker-like program, shared
+ * remotely, so it's uploaded in the background after compiling. Then it's fetched back and compared with the local
+ * result. At last, a missing result and a corrupted archive must be fetched as not found.
+ *
+ * Usage: yarn bench:remote-compile-store --config <judge config.yaml> [--compilations 10] [--languages cpp]
+ *
+ * The `remoteCompileStore` of the config is replaced by the stand-in.
+ */
+
+interface RemoteCompileStoreBenchLanguage {
+  compileAndRunOptions: unknown;
+  // A different code for each compilation, not to be cached
+  getCode: (index: number) => string;
+}
+
+const LANGUAGES: Record<string, RemoteCompileStoreBenchLanguage> = {
+  cpp: {
+    compileAndRunOptions: { compiler: "g++", std: "c++17", O: "2", m: "64" },
+    getCode: index => `#include <cstdio>\n\nint main() {\n    std::printf("%d\\n", ${index});\n}\n`
+  }
+};
+
+function parseArguments(argv: string[]) {
+  const options: Record<string, string> = {};
+  for (let i = 0; i < argv.length; i++) {
+    if (argv[i].startsWith("--")) options[argv[i].slice(2)] = argv[++i];
+  }
+  return options;
+}
+
+async function main() {
+  const options = parseArguments(process.argv.slice(2));
+  if (!options.config) {
+    console.error(
+      "Usage: yarn bench:remote-compile-store --config <judge config.yaml> [--compilations 10] [--languages cpp]"
+    );
+    process.exit(1);
+  }
+
+  const store = new StandInCompileStore();
+  await store.start();
+
+  // The config is loaded on importing the judge's modules, and the store's backend is created on importing the
+  // remote compile store (by the compiler)
+  process.env.LYRIO_JUDGE_CONFIG_FILE = path.resolve(options.config);
+  const { default: config, updateServerSideConfig } = await import("@/config");
+  config.remoteCompileStore = { type: "http", url: store.url, prefix: `bench-${process.pid}-` };
+
+  const { compile, CompileResultSuccess } = await import("@/compile");
+  const { fetchRemoteCompileResult } = await import("@/remoteCompileStore");
+  const { runTaskQueued } = await import("@/taskQueue");
+  const { summarize } = await import("./stats");
+
+  updateServerSideConfig({
+    limit: { compilerMessage: 50000, outputSize: 104857600, dataDisplay: 128, stderrDisplay: 5120 }
+  });
+
+  const waitForUpload = () =>
+    new Promise<void>(resolve => {
+      const onUploaded = (filename: string) => {
+        // The digest is uploaded after the archive
+        if (!filename.endsWith(".sha256")) return;
+        store.off("uploaded", onUploaded);
+        resolve();
+      };
+      store.on("uploaded", onUploaded);
+    });
+
+  const fetch = (compileTaskHash: string) =>
+    runTaskQueued(async taskWorkingDirectory => {
+      const result = await fetchRemoteCompileResult(compileTaskHash, taskWorkingDirectory);
+      return result && { ...result, binaryDirectory: null };
+    });
+
+  const compilations = Number(options.compilations) || 10;
+  const languages = (options.languages || Object.keys(LANGUAGES).join(",")).split(",");
+
+  console.log(
+    `${"Language".padEnd(10)}${"Phase".padEnd(12)}${"Latency p50 (ms)".padStart(18)}` +
+      `${"Latency mean (ms)".padStart(19)}${"Latency max (ms)".padStart(18)}`
+  );
+  let lastCompileTaskHash: string = null;
+  for (const language of languages) {
+    const benchLanguage = LANGUAGES[language];
+    if (!benchLanguage) throw new Error(`No remote compile store benchmark for language ${language}`);
+
+    const latencies: Record<string, number[]> = { compile: [], upload: [], fetch: [] };
+    for (let i = 0; i < compilations; i++) {
+      const uploaded = waitForUpload();
+      const startTime = performance.now();
+      const compileResult = await compile({
+        language,
+        code: `${benchLanguage.getCode(i)}// ${process.pid}\n`,
+        compileAndRunOptions: benchLanguage.compileAndRunOptions,
+        shareRemotely: true
+      });
+      const compiledTime = performance.now();
+      if (!(compileResult instanceof CompileResultSuccess)) {
+        throw new Error(`Failed to compile the ${language} program: ${JSON.stringify(compileResult.message)}`);
+      }
+
+      await uploaded;
+      const uploadedTime = performance.now();
+
+      const fetched = await fetch(compileResult.compileTaskHash);
+      const fetchedTime = performance.now();
+      if (!fetched) throw new Error(`Couldn't fetch the uploaded compile result of the ${language} program`);
+      if (fetched.binaryDirectorySize !== compileResult.binaryDirectorySize)
+        throw new Error(
+          `The fetched compile result of the ${language} program differs: ${fetched.binaryDirectorySize} bytes, ` +
+            `${compileResult.binaryDirectorySize} bytes compiled`
+        );
+
+      lastCompileTaskHash = compileResult.compileTaskHash;
+      await compileResult.dereference();
+
+      latencies.compile.push(compiledTime - startTime);
+      latencies.upload.push(uploadedTime - compiledTime);
+      latencies.fetch.push(fetchedTime - uploadedTime);
+    }
+
+    for (const [phase, phaseLatencies] of Object.entries(latencies)) {
+      const latency = summarize(phaseLatencies);
+      console.log(
+        `${language.padEnd(10)}${phase.padEnd(12)}${latency.p50.toFixed(0).padStart(18)}` +
+          `${latency.mean.toFixed(0).padStart(19)}${latency.max.toFixed(0).padStart(18)}`
+      );
+    }
+  }
+
+  if (await fetch("0".repeat(32))) throw new Error("Fetched a compile result never uploaded");
+  console.log("A missing compile result is not found");
+
+  if (lastCompileTaskHash) {
+    const archive = [...store.files.keys()].find(
+      filename => filename.includes(lastCompileTaskHash) && filename.endsWith(".tar.gz")
+    );
+    store.corrupt(archive);
+    if (await fetch(lastCompileTaskHash)) throw new Error("Fetched a corrupted compile result");
+    console.log("A corrupted compile result is rejected");
+  }
+
+  await store.stop();
+  process.exit(0);
+}
+
+main().catch(e => {
+  console.error(e);
+  process.exit(1);
+});
@@ -0,0 +1,186 @@
+import fs from "fs";
+import path from "path";
+import yaml from "js-yaml";
+import { v4 as uuid } from "uuid";
+
+import { createZip } from "./zip";
+
+/**
+ * A file's content in the scenario: inline text, a path relative to the scenario file, or a text repeated for
+ * many times (to make large testdata without storing it).
+ */
+export type FileSource = string | { path: string } | { repeat: string; times: number };
+
+export interface ScenarioSubmission {
+  name: string;
+  // The relative frequency of this submission in the mix, 1 by default
+  weight?: number;
+  problemType: "Traditional" | "Interaction" | "SubmitAnswer";
+  judgeInfo: unknown;
+  samples?: { inputData: string; outputData: string }[];
+  testData: Record<string, FileSource>;
+  // Every "{{id}}" in string values is replaced with the submission's index, to make each one compile again
+  submissionContent?: unknown;
+  // For SubmitAnswer, zipped as the submission file
+  answerFiles?: Record<string, FileSource>;
+}
+
+export interface Scenario {
+  // The number of submissions measured
+  submissions: number;
+  // The number of submissions replayed before measuring, to fill the judge's caches
+  warmup?: number;
+  // Release submissions at this rate (per second) instead of handing out the next one on every consumeTask
+  rate?: number;
+  // Give each submission new testdata UUIDs so its downloads are measured too, instead of hitting the data store
+  uniqueTestData?: boolean;
+  serverSideConfig?: {
+    limit?: Record<string, number>;
+  };
+  mix: ScenarioSubmission[];
+}
+
+export interface BenchTask {
+  index: number;
+  name: string;
+  task: {
+    taskId: string;
+    type: "Submission";
+    priority: number;
+    extraInfo: {
+      problemType: string;
+      judgeInfo: unknown;
+      samples?: unknown;
+      testData: Record<string, string>;
+      submissionContent: unknown;
+      file?: { uuid: string; url: string };
+    };
+  };
+  // The UUIDs of the files the judge may download for this task
+  fileUuids: string[];
+}
+
+function readFileSource(source: FileSource, baseDirectory: string): Buffer {
+  if (typeof source === "string") return Buffer.from(source);
+  if ("path" in source) return fs.readFileSync(path.resolve(baseDirectory, source.path));
+  return Buffer.from(source.repeat.repeat(source.times));
+}
+
+function replaceId(value: unknown, id: number): unknown {
+  if (value == null) return value;
+  return JSON.parse(JSON.stringify(value).split("{{id}}").join(String(id)));
+}
+
+export class ScenarioGenerator {
+  private readonly testData: Map<ScenarioSubmission, Record<string, Buffer>> = new Map();
+
+  private readonly answerFiles: Map<ScenarioSubmission, Buffer> = new Map();
+
+  // For smooth weighted round-robin, which makes the mix deterministic and evenly interleaved
+  private readonly currentWeights: number[];
+
+  private nextIndex = 0;
+
+  constructor(
+    readonly scenario: Scenario,
+    baseDirectory: string,
+    // Register a file to be served and return its UUID
+    private readonly addFile: (content: Buffer, id?: string) => string,
+    private readonly getFileUrl: (id: string) => string
+  ) {
+    for (const submission of scenario.mix) {
+      this.testData.set(
+        submission,
+        Object.fromEntries(
+          Object.entries(submission.testData || {}).map(([filename, source]) => [
+            filename,
+            readFileSource(source, baseDirectory)
+          ])
+        )
+      );
+
+      if (submission.problemType === "SubmitAnswer") {
+        this.answerFiles.set(
+          submission,
+          createZip(
+            Object.entries(submission.answerFiles || {}).map(([filename, source]) => ({
+              filename,
+              content: readFileSource(source, baseDirectory)
+            }))
+          )
+        );
+      }
+    }
+
+    this.currentWeights = scenario.mix.map(() => 0);
+  }
+
+  get total() {
+    return (this.scenario.warmup || 0) + this.scenario.submissions;
+  }
+
+  private pickSubmission() {
+    const weights = this.scenario.mix.map(submission => submission.weight ?? 1);
+    const totalWeight = weights.reduce((a, b) => a + b, 0);
+    let best = 0;
+    for (let i = 0; i < weights.length; i++) {
+      this.currentWeights[i] += weights[i];
+      if (this.currentWeights[i] > this.currentWeights[best]) best = i;
+    }
+    this.currentWeights[best] -= totalWeight;
+    return this.scenario.mix[best];
+  }
+
+  // Files are registered once per scenario submission, or per task with uniqueTestData
+  private readonly sharedTestDataUuids: Map<ScenarioSubmission, Record<string, string>> = new Map();
+
+  next(): BenchTask {
+    if (this.nextIndex >= this.total) return null;
+    const index = this.nextIndex++;
+    const submission = this.pickSubmission();
+
+    let testData = this.sharedTestDataUuids.get(submission);
+    if (!testData || this.scenario.uniqueTestData) {
+      testData = Object.fromEntries(
+        Object.entries(this.testData.get(submission)).map(([filename, content]) => [filename, this.addFile(content)])
+      );
+      if (!this.scenario.uniqueTestData) this.sharedTestDataUuids.set(submission, testData);
+    }
+    const fileUuids = Object.values(testData);
+
+    let file: { uuid: string; url: string };
+    if (this.answerFiles.has(submission)) {
+      // The judge names the downloaded file with its UUID, so it must be unique for each submission
+      const fileUuid = this.addFile(this.answerFiles.get(submission), uuid());
+      file = { uuid: fileUuid, url: this.getFileUrl(fileUuid) };
+      fileUuids.push(fileUuid);
+    }
+
+    return {
+      index,
+      name: submission.name,
+      task: {
+        taskId: uuid(),
+        type: "Submission",
+        priority: 0,
+        extraInfo: {
+          problemType: submission.problemType,
+          judgeInfo: submission.judgeInfo,
+          samples: submission.samples,
+          testData,
+          submissionContent: replaceId(submission.submissionContent || {}, index),
+          file
+        }
+      },
+      fileUuids
+    };
+  }
+}
+
+export function loadScenario(filePath: string) {
+  const scenario = yaml.load(fs.readFileSync(filePath, "utf-8")) as Scenario;
+  if (!scenario || !Array.isArray(scenario.mix) || scenario.mix.length === 0)
+    throw new Error(`Scenario ${filePath} has no submissions in "mix"`);
+  if (!(scenario.submissions > 0)) throw new Error(`Scenario ${filePath} has no positive "submissions"`);
+  return scenario;
+}
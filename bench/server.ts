@@ -0,0 +1,189 @@
+import http from "http";
+import { AddressInfo } from "net";
+import { EventEmitter } from "events";
+
+import { Server, Socket } from "socket.io";
+import SocketIOParser from "socket.io-msgpack-parser";
+import { v4 as uuid } from "uuid";
+
+/**
+ * A stand-in of the Lyrio server's judge side: the "/judge" socket.io namespace the judge client connects to,
+ * and an HTTP endpoint serving the files it requests, both on the same local port.
+ *
+ * Events:
+ * * ready(systemInfo): the judge client is authorized and has sent its system info
+ * * consumeTask(threadId, sendTask): a judge thread wants a task, call sendTask(task, onAck) when there's one
+ * * progress(taskId, progress): the whole progress, also for the delta progress protocol after applying a delta
+ * * timingStatus(status)
+ * * fileServed(id, bytes, startTime, endTime): times are from performance.now()
+ * * disconnect()
+ */
+interface ProgressDelta {
+  testcaseResult?: Record<string, unknown>;
+  samples?: Record<string, unknown>;
+  subtasks?: Record<string, { score?: number; testcases?: Record<string, unknown> }>;
+}
+
+interface Progress {
+  testcaseResult?: Record<string, unknown>;
+  samples?: unknown[];
+  subtasks?: { score: number; testcases: unknown[] }[];
+}
+
+// See src/task/submission/progress.ts
+function applyProgressDelta(progress: Progress, delta: ProgressDelta) {
+  const { testcaseResult, samples, subtasks, ...fields } = delta;
+  Object.assign(progress, fields);
+  if (testcaseResult) Object.assign(progress.testcaseResult, testcaseResult);
+  for (const [sampleId, reference] of Object.entries(samples || {})) progress.samples[sampleId] = reference;
+  for (const [subtaskIndex, { score, testcases }] of Object.entries(subtasks || {})) {
+    const subtask = progress.subtasks[subtaskIndex];
+    if (score !== undefined) subtask.score = score;
+    for (const [testcaseIndex, reference] of Object.entries(testcases || {}))
+      subtask.testcases[testcaseIndex] = reference;
+  }
+}
+
+export class StandInServer extends EventEmitter {
+  private readonly files: Map<string, Buffer> = new Map();
+
+  // taskId -> the progress and its version of the delta progress protocol
+  private readonly progresses: Map<string, { version: number; progress: Progress }> = new Map();
+
+  private httpServer: http.Server;
+
+  private io: Server;
+
+  private socket: Socket;
+
+  // The bytes of the packets received from the judge client
+  receivedBytes = 0;
+
+  constructor(private readonly key: string, private readonly serverSideConfig: unknown) {
+    super();
+  }
+
+  url: string;
+
+  addFile(content: Buffer, id = uuid()) {
+    this.files.set(id, content);
+    return id;
+  }
+
+  getFileUrl(id: string) {
+    return `${this.url}/files/${id}`;
+  }
+
+  /**
+   * Request a snapshot of a task's progress with the delta progress protocol, as if the progress is lost.
+   */
+  requestProgressSnapshot(taskId: string) {
+    this.progresses.delete(taskId);
+    this.socket?.emit("requestProgressSnapshot", taskId);
+  }
+
+  async start() {
+    this.httpServer = http.createServer((request, response) => this.serveFile(request, response));
+    this.io = new Server(this.httpServer, {
+      path: "/api/socket",
+      transports: ["websocket"],
+      maxHttpBufferSize: 1e9,
+      parser: SocketIOParser
+    });
+    this.io.of("/judge").on("connection", socket => this.onConnection(socket));
+
+    await new Promise<void>(resolve => this.httpServer.listen(0, "127.0.0.1", resolve));
+    this.url = `http://127.0.0.1:${(this.httpServer.address() as AddressInfo).port}`;
+    return this.url;
+  }
+
+  async stop() {
+    this.io.close();
+    await new Promise(resolve => this.httpServer.close(resolve));
+  }
+
+  private serveFile(request: http.IncomingMessage, response: http.ServerResponse) {
+    const startTime = performance.now();
+    const id = /^\/files\/([^/?]+)/.exec(request.url)?.[1];
+    const content = id && this.files.get(id);
+    if (!content) {
+      response.writeHead(404).end(`No such file: ${request.url}`);
+      return;
+    }
+
+    response.writeHead(200, {
+      "Content-Type": "application/octet-stream",
+      "Content-Length": content.length
+    });
+    response.end(content, () => this.emit("fileServed", id, content.length, startTime, performance.now()));
+  }
+
+  private onConnection(socket: Socket) {
+    if (socket.handshake.query.key !== this.key || this.socket) {
+      socket.emit("authenticationFailed");
+      socket.disconnect(true);
+      return;
+    }
+
+    this.socket = socket;
+    socket.conn.on("packet", (packet: { data?: string | Buffer }) => {
+      if (packet.data) this.receivedBytes += packet.data.length;
+    });
+
+    socket.once("systemInfo", systemInfo => this.emit("ready", systemInfo));
+    socket.on("timingStatus", status => this.emit("timingStatus", status));
+
+    socket.on("consumeTask", (threadId: number) => {
+      this.emit("consumeTask", threadId, (task: unknown, onAck: () => void) =>
+        socket.emit("task", threadId, task, onAck)
+      );
+    });
+
+    socket.on("progress", ({ taskMeta, progress }: { taskMeta: { taskId: string }; progress: unknown }) => {
+      this.progresses.delete(taskMeta.taskId);
+      this.emit("progress", taskMeta.taskId, progress);
+    });
+
+    socket.on(
+      "progressDelta",
+      (
+        message: {
+          taskMeta: { taskId: string };
+          version: number;
+          baseVersion?: number;
+          snapshot?: Progress;
+          delta?: ProgressDelta;
+        },
+        callback: (response: { version?: number; resync?: boolean }) => void
+      ) => {
+        const { taskId } = message.taskMeta;
+        let state = this.progresses.get(taskId);
+        if (message.snapshot) {
+          state = { version: message.version, progress: message.snapshot };
+          this.progresses.set(taskId, state);
+        } else if (!state || state.version < message.baseVersion) {
+          callback({ resync: true });
+          return;
+        } else if (message.version > state.version) {
+          // The changes are absolute values, so they could be applied on a newer version than their base
+          applyProgressDelta(state.progress, message.delta);
+          state.version = message.version;
+        }
+
+        callback({ version: state.version });
+        this.emit("progress", taskId, state.progress);
+      }
+    );
+
+    socket.on("requestFiles", (ids: string[], callback: (urls: string[]) => void) =>
+      callback(ids.map(id => this.getFileUrl(id)))
+    );
+
+    socket.on("disconnect", () => {
+      this.socket = null;
+      this.emit("disconnect");
+    });
+
+    socket.emit("ready", "bench", this.serverSideConfig);
+  }
+}
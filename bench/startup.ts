@@ -0,0 +1,193 @@
+import fs from "fs";
+import path from "path";
+
+// Only the types, the modules are imported after setting the config file
+import type { CompileResultSuccess } from "@/compile";
+
+/**
+ * Measure the startup time of the languages with a startup optimization (e.g. the class data sharing archive of the
+ * JVM, or the AOT image of mono), by running a trivial program of each language in the sandbox with and without it.
+ *
+ * Usage: yarn bench:startup --config <judge config.yaml> [--runs 20] [--languages java,kotlin,csharp,fsharp]
+ *
+ * The time and memory are measured by the sandbox like a testcase, which is what's charged to the contestant. The
+ * program is compiled in each mode (as a different code, not to share the compile cache), since some optimizations
+ * are done on compiling.
+ */
+
+interface StartupBenchLanguage {
+  compileAndRunOptions: unknown;
+  code: string;
+  // Import the language's optimization switch lazily
+  setOptimized: () => Promise<(enabled: boolean) => void>;
+}
+
+const INPUT = "1 2\n";
+
+const LANGUAGES: Record<string, StartupBenchLanguage> = {
+  java: {
+    compileAndRunOptions: {},
+    code: [
+      "import java.util.Scanner;",
+      "",
+      "public class Main {",
+      "    public static void main(String[] args) {",
+      "        Scanner scanner = new Scanner(System.in);",
+      "        System.out.println(scanner.nextInt() + scanner.nextInt());",
+      "    }",
+      "}"
+    ].join("\n"),
+    setOptimized: async () => (await import("@/languages/jvm")).setClassDataSharingEnabled
+  },
+  kotlin: {
+    compileAndRunOptions: { version: "1.5", platform: "jvm" },
+    code: 'fun main() {\n    println(readLine()!!.split(" ").sumOf { it.toInt() })\n}',
+    setOptimized: async () => (await import("@/languages/jvm")).setClassDataSharingEnabled
+  },
+  csharp: {
+    compileAndRunOptions: { version: "9" },
+    code: [
+      "using System;",
+      "",
+      "public class Program {",
+      "    public static void Main() {",
+      "        var numbers = Console.ReadLine().Split(' ');",
+      "        Console.WriteLine(int.Parse(numbers[0]) + int.Parse(numbers[1]));",
+      "    }",
+      "}"
+    ].join("\n"),
+    setOptimized: async () => (await import("@/languages/mono")).setAotEnabled
+  },
+  fsharp: {
+    compileAndRunOptions: {},
+    code: 'stdin.ReadLine().Split(\' \') |> Array.sumBy int |> printfn "%d"',
+    setOptimized: async () => (await import("@/languages/mono")).setAotEnabled
+  }
+};
+
+function parseArguments(argv: string[]) {
+  const options: Record<string, string> = {};
+  for (let i = 0; i < argv.length; i++) {
+    if (argv[i].startsWith("--")) options[argv[i].slice(2)] = argv[++i];
+  }
+  return options;
+}
+
+async function main() {
+  const options = parseArguments(process.argv.slice(2));
+  if (!options.config) {
+    console.error("Usage: yarn bench:startup --config <judge config.yaml> [--runs 20] [--languages java,kotlin,...]");
+    process.exit(1);
+  }
+
+  // The config is loaded on importing the judge's modules
+  process.env.LYRIO_JUDGE_CONFIG_FILE = path.resolve(options.config);
+  const { updateServerSideConfig } = await import("@/config");
+  const { compile } = await import("@/compile");
+  const { runTaskQueued } = await import("@/taskQueue");
+  const { runSandbox, CpuAffinityStrategy, SANDBOX_INSIDE_PATH_BINARY, SANDBOX_INSIDE_PATH_WORKING } = await import(
+    "@/sandbox"
+  );
+  const { safelyJoinPath } = await import("@/utils");
+  const { default: getLanguage } = await import("@/languages");
+  const { summarize } = await import("./stats");
+
+  updateServerSideConfig({
+    limit: { compilerMessage: 50000, outputSize: 104857600, dataDisplay: 128, stderrDisplay: 5120 }
+  });
+
+  const runs = Number(options.runs) || 20;
+  const languages = (options.languages || Object.keys(LANGUAGES).join(",")).split(",");
+
+  console.log(
+    `${"Language".padEnd(10)}${"Mode".padEnd(12)}${"Time p50 (ms)".padStart(15)}${"Time mean (ms)".padStart(16)}` +
+      `${"Memory p50 (KiB)".padStart(18)}`
+  );
+  for (const language of languages) {
+    const benchLanguage = LANGUAGES[language];
+    if (!benchLanguage) throw new Error(`No startup benchmark for language ${language}`);
+
+    const setOptimized = await benchLanguage.setOptimized();
+    const medians: Record<string, number> = {};
+    for (const optimized of [false, true]) {
+      setOptimized(optimized);
+      const mode = optimized ? "optimized" : "baseline";
+
+      const compileResult = await compile({
+        language,
+        code: `${benchLanguage.code}\n// ${mode}\n`,
+        compileAndRunOptions: benchLanguage.compileAndRunOptions
+      });
+      if (!compileResult.success) {
+        console.error(`Failed to compile the ${language} program: ${JSON.stringify(compileResult.message)}`);
+        break;
+      }
+      const binary = compileResult as CompileResultSuccess;
+
+      const times: number[] = [];
+      const memories: number[] = [];
+      for (let i = 0; i < runs; i++) {
+        await runTaskQueued(async taskWorkingDirectory => {
+          const workingDirectory = {
+            outside: safelyJoinPath(taskWorkingDirectory, "working"),
+            inside: SANDBOX_INSIDE_PATH_WORKING
+          };
+          const tempDirectoryOutside = safelyJoinPath(taskWorkingDirectory, "temp");
+          await fs.promises.mkdir(workingDirectory.outside);
+          await fs.promises.mkdir(tempDirectoryOutside);
+          await fs.promises.writeFile(safelyJoinPath(workingDirectory.outside, "input"), INPUT);
+
+          const sandboxResult = await runSandbox(null, {
+            ...getLanguage(language).run({
+              binaryDirectoryInside: SANDBOX_INSIDE_PATH_BINARY,
+              workingDirectoryInside: workingDirectory.inside,
+              compileAndRunOptions: benchLanguage.compileAndRunOptions,
+              time: 10000,
+              memory: 1024,
+              stdinFile: `${workingDirectory.inside}/input`,
+              stdoutFile: `${workingDirectory.inside}/output`,
+              stderrFile: `${workingDirectory.inside}/error`,
+              parameters: [],
+              compileResultExtraInfo: binary.extraInfo
+            }),
+            time: 10000,
+            memory: 1024 * 1024 * 1024,
+            workingDirectory: workingDirectory.inside,
+            tempDirectoryOutside,
+            extraMounts: [
+              { mappedPath: { outside: binary.binaryDirectory, inside: SANDBOX_INSIDE_PATH_BINARY }, readOnly: true },
+              { mappedPath: workingDirectory, readOnly: false }
+            ],
+            cpuAffinity: CpuAffinityStrategy.UserProgram
+          });
+
+          const output = await fs.promises.readFile(safelyJoinPath(workingDirectory.outside, "output"), "utf-8");
+          if (output.trim() !== "3") throw new Error(`Wrong output of the ${language} program: ${output}`);
+          times.push(sandboxResult.time / 1e6);
+          memories.push(sandboxResult.memory / 1024);
+        });
+      }
+
+      await binary.dereference();
+
+      const time = summarize(times);
+      const memory = summarize(memories);
+      medians[mode] = time.p50;
+      console.log(
+        `${language.padEnd(10)}${mode.padEnd(12)}${time.p50.toFixed(1).padStart(15)}` +
+          `${time.mean.toFixed(1).padStart(16)}${memory.p50.toFixed(0).padStart(18)}`
+      );
+    }
+
+    if (medians.optimized == null) continue;
+    const reduction = 1 - medians.optimized / medians.baseline;
+    console.log(`${language.padEnd(10)}${"reduction".padEnd(12)}${`${(reduction * 100).toFixed(1)}%`.padStart(15)}`);
+  }
+
+  process.exit(0);
+}
+
+main().catch(e => {
+  console.error(e);
+  process.exit(1);
+});
@@ -0,0 +1,66 @@
+import fs from "fs";
+
+export interface Distribution {
+  count: number;
+  mean: number;
+  min: number;
+  p50: number;
+  p90: number;
+  p99: number;
+  max: number;
+}
+
+export function summarize(values: number[]): Distribution {
+  if (values.length === 0) return null;
+  const sorted = [...values].sort((a, b) => a - b);
+  const quantile = (q: number) => sorted[Math.min(sorted.length - 1, Math.floor(q * sorted.length))];
+  return {
+    count: sorted.length,
+    mean: sorted.reduce((a, b) => a + b, 0) / sorted.length,
+    min: sorted[0],
+    p50: quantile(0.5),
+    p90: quantile(0.9),
+    p99: quantile(0.99),
+    max: sorted[sorted.length - 1]
+  };
+}
+
+// The busy and idle jiffies of each core in /proc/stat
+type CpuTimes = Record<string, { busy: number; total: number }>;
+
+export function readCpuTimes(): CpuTimes {
+  const result: CpuTimes = {};
+  for (const line of fs.readFileSync("/proc/stat", "utf-8").split("\n")) {
+    const match = /^cpu(\d+)\s+(.*)$/.exec(line);
+    if (!match) continue;
+
+    // user nice system idle iowait irq softirq steal
+    const fields = match[2].split(/\s+/).slice(0, 8).map(Number);
+    const total = fields.reduce((a, b) => a + b, 0);
+    result[match[1]] = { busy: total - fields[3] - fields[4], total };
+  }
+  return result;
+}
+
+// The busy ratio of each core between two readings
+export function getCpuBusyRatios(start: CpuTimes, end: CpuTimes) {
+  return Object.fromEntries(
+    Object.keys(end)
+      .filter(cpu => start[cpu])
+      .map(cpu => {
+        const total = end[cpu].total - start[cpu].total;
+        return [cpu, total > 0 ? (end[cpu].busy - start[cpu].busy) / total : 0];
+      })
+  );
+}
+
+export function formatDistribution(name: string, distribution: Distribution) {
+  const format = (value: number) => value.toFixed(1).padStart(9);
+  if (!distribution) return `${name.padEnd(10)}        -`;
+  return (
+    `${name.padEnd(10)}${String(distribution.count).padStart(9)}` +
+    [distribution.mean, distribution.min, distribution.p50, distribution.p90, distribution.p99, distribution.max]
+      .map(format)
+      .join("")
+  );
+}
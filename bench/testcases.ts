@@ -0,0 +1,154 @@
+import path from "path";
+import { performance } from "perf_hooks";
+
+// Only the types, the modules are imported after setting the config file
+import type { SubmissionTask, SubmissionHandler } from "@/task/submission";
+import type { VersionedProgress } from "@/task/progress";
+
+/**
+ * Measure the judge's own overhead of each testcase of a submission, by running `runCommonTask()` with a testcase
+ * handler which does nothing, on problems of growing numbers of testcases. The time and the heap per testcase
+ * should stay flat as the number of testcases grows.
+ *
+ * Usage: yarn bench:testcases --config <judge config.yaml> [--counts 1000,10000,100000] [--subtasks 10]
+ *
+ * Each testcase still goes through the task queue (which empties a working directory), the batched hashing (of
+ * the testdata filenames instead of the files), the progress tracking and the progress reporting (as the delta
+ * progress protocol, each 100ms), only running and checking it is skipped.
+ */
+
+const REPORT_INTERVAL = 100;
+
+function parseArguments(argv: string[]) {
+  const options: Record<string, string> = {};
+  for (let i = 0; i < argv.length; i++) {
+    if (argv[i].startsWith("--")) options[argv[i].slice(2)] = argv[++i];
+  }
+  return options;
+}
+
+function collectGarbage() {
+  if (global.gc) global.gc();
+}
+
+async function main() {
+  const options = parseArguments(process.argv.slice(2));
+  if (!options.config) {
+    console.error("Usage: yarn bench:testcases --config <judge config.yaml> [--counts 1000,10000,100000]");
+    console.error("                            [--subtasks 10]");
+    process.exit(1);
+  }
+  if (!global.gc) console.warn("Run with --expose-gc for accurate heap usage");
+
+  // The config is loaded on importing the judge's modules
+  process.env.LYRIO_JUDGE_CONFIG_FILE = path.resolve(options.config);
+  const { runCommonTask, createTestcaseHasher } = await import("@/task/submission/common");
+  const { createSubmissionEvents } = await import("@/task/submission");
+  const { SubmissionProgressTracker } = await import("@/task/submission/progress");
+
+  interface TestcaseConfig {
+    inputFile: string;
+    outputFile: string;
+  }
+  interface JudgeInfo {
+    timeLimit: number;
+    memoryLimit: number;
+    subtasks: { scoringType: "Sum"; testcases: TestcaseConfig[] }[];
+  }
+  interface TestcaseResult {
+    status: string;
+    score: number;
+    time: number;
+  }
+  type BenchTask = SubmissionTask<JudgeInfo, unknown, TestcaseResult, null>;
+
+  const handler: SubmissionHandler<JudgeInfo, unknown, TestcaseResult, null> = {
+    validateJudgeInfo: async () => {},
+    hashSampleTestcase: async () => "",
+    hashTestcases: (judgeInfo, subtaskIndex) =>
+      createTestcaseHasher({ timeLimit: judgeInfo.timeLimit }, judgeInfo.subtasks[subtaskIndex].testcases, async t => [
+        t.inputFile,
+        t.outputFile
+      ]),
+    runTask: async () => {}
+  };
+
+  const counts = (options.counts || "1000,10000,100000").split(",").map(Number);
+  const subtasksCount = Number(options.subtasks) || 10;
+
+  console.log(
+    `${"Testcases".padStart(10)}${"Time (s)".padStart(10)}${"us/case".padStart(10)}` +
+      `${"Heap (MiB)".padStart(12)}${"B/case".padStart(10)}${"Reported (KiB)".padStart(16)}`
+  );
+  for (const count of counts) {
+    const judgeInfo: JudgeInfo = {
+      timeLimit: 1000,
+      memoryLimit: 256,
+      subtasks: [...new Array(subtasksCount).keys()].map(subtaskIndex => ({
+        scoringType: "Sum",
+        testcases: [...new Array(Math.ceil(count / subtasksCount)).keys()].map(i => ({
+          inputFile: `${subtaskIndex}-${i}.in`,
+          outputFile: `${subtaskIndex}-${i}.out`
+        }))
+      }))
+    };
+
+    // Report the progress like the delta progress protocol, acknowledged immediately
+    let reportedProgress: VersionedProgress = null;
+    let reportedBytes = 0;
+    let acknowledgedVersion = 0;
+    const report = () => {
+      if (!reportedProgress || reportedProgress.version === acknowledgedVersion) return;
+      const delta = reportedProgress.getDelta(acknowledgedVersion);
+      reportedBytes += JSON.stringify(delta || reportedProgress.getSnapshot()).length;
+      acknowledgedVersion = reportedProgress.version;
+      reportedProgress.acknowledge(acknowledgedVersion);
+    };
+    const reportInterval = setInterval(report, REPORT_INTERVAL);
+
+    const task = {
+      taskId: `bench-${count}`,
+      priority: 0,
+      extraInfo: { judgeInfo, testData: {}, submissionContent: {} },
+      reportProgressRaw: progress => {
+        reportedProgress = progress as VersionedProgress;
+      }
+    } as BenchTask;
+    const progress = new SubmissionProgressTracker<TestcaseResult>();
+    task.events = createSubmissionEvents(task, handler, progress, new Date());
+
+    collectGarbage();
+    const heapBefore = process.memoryUsage().heapUsed;
+    let heapPeak = heapBefore;
+    const heapInterval = setInterval(() => {
+      heapPeak = Math.max(heapPeak, process.memoryUsage().heapUsed);
+    }, 10);
+
+    const startTime = performance.now();
+    await runCommonTask({
+      task,
+      extraParameters: null,
+      onTestcase: async () => ({ status: "Accepted", score: 100, time: 1 })
+    });
+    const elapsed = (performance.now() - startTime) / 1000;
+
+    clearInterval(heapInterval);
+    clearInterval(reportInterval);
+    report();
+
+    const heap = Math.max(heapPeak, process.memoryUsage().heapUsed) - heapBefore;
+    const testcases = judgeInfo.subtasks.length * judgeInfo.subtasks[0].testcases.length;
+    console.log(
+      `${String(testcases).padStart(10)}${elapsed.toFixed(2).padStart(10)}` +
+        `${((elapsed * 1e6) / testcases).toFixed(1).padStart(10)}${(heap / 1024 / 1024).toFixed(1).padStart(12)}` +
+        `${(heap / testcases).toFixed(0).padStart(10)}${(reportedBytes / 1024).toFixed(1).padStart(16)}`
+    );
+  }
+
+  process.exit(0);
+}
+
+main().catch(e => {
+  console.error(e);
+  process.exit(1);
+});
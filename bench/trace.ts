@@ -0,0 +1,38 @@
+import fs from "fs";
+import path from "path";
+
+export interface TraceSpan {
+  name: string;
+  category: string;
+  duration: number; // In milliseconds
+}
+
+interface TraceEvent {
+  name: string;
+  cat: string;
+  ph: string;
+  ts: number;
+  dur?: number;
+  id?: number;
+}
+
+/**
+ * Read the spans of a task from the judge's trace file (see src/tracing.ts), or null if it's not written.
+ */
+export function readTraceSpans(directory: string, taskId: string): TraceSpan[] {
+  const filePath = path.join(directory, `${taskId}.json`);
+  if (!fs.existsSync(filePath)) return null;
+
+  const { traceEvents } = JSON.parse(fs.readFileSync(filePath, "utf-8")) as { traceEvents: TraceEvent[] };
+  const spans: TraceSpan[] = [];
+  const asyncBegins: Map<number, TraceEvent> = new Map();
+  for (const event of traceEvents) {
+    if (event.ph === "X") spans.push({ name: event.name, category: event.cat, duration: event.dur / 1000 });
+    else if (event.ph === "b") asyncBegins.set(event.id, event);
+    else if (event.ph === "e" && asyncBegins.has(event.id)) {
+      const begin = asyncBegins.get(event.id);
+      spans.push({ name: begin.name, category: begin.cat, duration: (event.ts - begin.ts) / 1000 });
+    }
+  }
+  return spans;
+}
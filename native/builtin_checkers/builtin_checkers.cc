@@ -7,7 +7,9 @@
 #include "integers.h"
 #include "floats.h"
 #include "lines.h"
+#include "tokens.h"
 #include "binary.h"
+#include "trace.h"
 
 // Node.js does some clean-ups with atexit(), we need to register another atexit() handler
 // in the child process to be called before Node.js's handler to exit immediately.
@@ -20,6 +22,7 @@ class BuiltinCheckerWorker : public Napi::AsyncWorker {
 private:
     std::string outputFile, answerFile;
     std::function<void ()> checkerFunction;
+    NativeTiming timing;
 
     std::string message;
 
@@ -28,10 +31,16 @@ public:
         Napi::Function &&callback,
         std::string &&outputFile,
         std::string &&answerFile,
-        std::function<void ()> checkerFunction
-    ) : Napi::AsyncWorker(callback), outputFile(outputFile), answerFile(answerFile), checkerFunction(checkerFunction) {}
+        std::function<void ()> checkerFunction,
+        const Napi::Value &timing
+    ) : Napi::AsyncWorker(callback),
+        outputFile(outputFile),
+        answerFile(answerFile),
+        checkerFunction(checkerFunction),
+        timing(timing, EventRing::BuiltinChecker) {}
 
     void Execute() {
+        timing.start();
         pid_t pid = 0;
         try {
             int pipeFd[2];
@@ -87,9 +96,11 @@ public:
 
         kill(pid, SIGKILL);
         waitpid(pid, NULL, 0);
+        timing.end();
     }
 
     void OnOK() {
+        timing.write();
         auto env = Env();
         Callback().Call({env.Undefined(), Napi::String::New(env, message)});
     }
@@ -100,12 +111,16 @@ void runBuiltinChecker(const Napi::CallbackInfo &info, std::function<void ()> ch
         info[3].As<Napi::Function>(),
         info[0].As<Napi::String>().Utf8Value(),
         info[1].As<Napi::String>().Utf8Value(),
-        checkerFunction
+        checkerFunction,
+        info[4]
     );
     worker->Queue();
 }
 
 Napi::Object Init(Napi::Env env, Napi::Object exports) {
+    EventRing::defineExports(env, exports);
+
+    // runBuiltinChecker(outputFile, answerFile, checker, callback, timing?), see trace.h for the timing
     exports.Set("runBuiltinChecker", Napi::Function::New(env, [] (const Napi::CallbackInfo &info) {
         const auto config = info[2].As<Napi::Object>();
         auto type = config.Get("type").As<Napi::String>().Utf8Value();
@@ -117,6 +132,11 @@ Napi::Object Init(Napi::Env env, Napi::Object exports) {
         } else if (type == "lines") {
             const bool caseSensitive = config.Get("caseSensitive").As<Napi::Boolean>().Value();
             runBuiltinChecker(info, std::bind(builtinCheckerLines, caseSensitive));
+        } else if (type == "tokens") {
+            // Case-sensitive unless specified
+            const auto caseSensitiveValue = config.Get("caseSensitive");
+            const bool caseSensitive = !caseSensitiveValue.IsBoolean() || caseSensitiveValue.As<Napi::Boolean>().Value();
+            runBuiltinChecker(info, std::bind(builtinCheckerTokens, caseSensitive));
         } else
             runBuiltinChecker(info, builtinCheckerBinary);
     }));
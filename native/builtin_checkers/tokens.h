@@ -0,0 +1,35 @@
+#include <testlib.h>
+
+// The same as testlib's wcmp, maybe case-insensitive
+void builtinCheckerTokens(bool caseSensitive) {
+    int n = 0;
+    std::string j, p;
+
+    while (!ans.seekEof() && !ouf.seekEof()) {
+        n++;
+
+        j = ans.readWord();
+        p = ouf.readWord();
+
+        bool equal;
+        if (caseSensitive)
+            equal = j == p;
+        else
+            equal = lowerCase(j) == lowerCase(p);
+
+        if (!equal)
+            quitf(_wa, "%d%s words differ - expected: '%s', found: '%s'", n, englishEnding(n).c_str(), compress(j).c_str(), compress(p).c_str());
+    }
+
+    if (ans.seekEof() && ouf.seekEof()) {
+        if (n == 1)
+            quitf(_ok, "\"%s\"", compress(j).c_str());
+        else
+            quitf(_ok, "%d tokens", n);
+    }
+
+    if (ans.seekEof())
+        quitf(_wa, "Participant output contains extra tokens");
+    else
+        quitf(_wa, "Unexpected EOF in the participants output");
+}
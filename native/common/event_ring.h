@@ -0,0 +1,212 @@
+#pragma once
+
+#include <napi.h>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include <algorithm>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+// Always-on instrumentation of hot paths (src/eventRing.ts). The JavaScript side allocates an ArrayBuffer and
+// attaches it to each addon with `attachEventRing()`. It holds a ring of fixed-size binary events for each
+// thread writing events, so recording one is a few stores with no locks, formatting or allocation. Ring 0 is
+// written by JavaScript on the main thread, the others are claimed by the native threads on their first event.
+//
+// Each ring has a single producer and is drained (with `drainEventRing()` of any addon, on the main thread)
+// by a single consumer. The producer never waits: it overwrites the oldest events if the ring is full, and the
+// consumer drops the events which could be overwritten while copying them (like a seqlock), counting them as
+// lost.
+//
+// The layout is shared with src/eventRing.ts, keep them in sync.
+
+namespace EventRing {
+
+// The events written by the native addons, the ones from 100 are written by JavaScript
+enum EventId : uint32_t {
+    // args: [duration (us), operation (string)]
+    FsOperation = 1,
+    // args: [duration (us), checker type (string)]
+    BuiltinChecker = 2
+};
+
+struct Event {
+    // Microseconds of CLOCK_MONOTONIC, see trace.h
+    double time;
+    uint32_t id;
+    // The task number of src/eventRing.ts, 0 if not in a task
+    uint32_t task;
+    int32_t args[4];
+};
+static_assert(sizeof(Event) == 32, "Event must be 32 bytes");
+
+struct Header {
+    uint32_t ringCount;
+    // A power of 2
+    uint32_t ringCapacity;
+    // The next ring to be claimed by a native thread
+    uint32_t nextRing;
+    uint32_t reserved[13];
+};
+static_assert(sizeof(Header) == 64, "Header must be 64 bytes");
+
+struct RingHeader {
+    // Written by the producer only, counting the events (wrapping around 2^32). `writing` is increased before
+    // writing an event and `written` after it.
+    uint32_t writing, written;
+    // Written by the consumer only, the events drained
+    uint32_t drained;
+    // The thread ID of the producer
+    uint32_t thread;
+    uint32_t reserved[12];
+};
+static_assert(sizeof(RingHeader) == 64, "RingHeader must be 64 bytes");
+
+inline size_t bufferSize(uint32_t ringCount, uint32_t ringCapacity) {
+    return sizeof(Header) + (size_t)ringCount * (sizeof(RingHeader) + (size_t)ringCapacity * sizeof(Event));
+}
+
+// Each addon has its own copy of these, and of the rings claimed by its threads
+inline Header *attachedHeader = nullptr;
+inline thread_local RingHeader *threadRing = nullptr;
+inline thread_local bool threadRingUnavailable = false;
+
+inline RingHeader *getRing(Header *header, uint32_t index) {
+    size_t ringSize = sizeof(RingHeader) + (size_t)header->ringCapacity * sizeof(Event);
+    return (RingHeader *)((char *)(header + 1) + index * ringSize);
+}
+
+inline Event *getEvents(RingHeader *ring) {
+    return (Event *)(ring + 1);
+}
+
+// On any thread
+inline void record(
+    uint32_t id,
+    uint32_t task,
+    double time,
+    int32_t arg0 = 0,
+    int32_t arg1 = 0,
+    int32_t arg2 = 0,
+    int32_t arg3 = 0
+) {
+    Header *currentHeader = __atomic_load_n(&attachedHeader, __ATOMIC_ACQUIRE);
+    if (!currentHeader || threadRingUnavailable) return;
+
+    if (!threadRing) {
+        uint32_t index = __atomic_fetch_add(&currentHeader->nextRing, 1, __ATOMIC_RELAXED);
+        if (index >= currentHeader->ringCount) {
+            // Out of rings, drop the events of this thread
+            threadRingUnavailable = true;
+            return;
+        }
+
+        threadRing = getRing(currentHeader, index);
+        __atomic_store_n(&threadRing->thread, (uint32_t)syscall(SYS_gettid), __ATOMIC_RELAXED);
+    }
+
+    uint32_t position = threadRing->written;
+    __atomic_store_n(&threadRing->writing, position + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    Event &event = getEvents(threadRing)[position & (currentHeader->ringCapacity - 1)];
+    event.time = time;
+    event.id = id;
+    event.task = task;
+    event.args[0] = arg0;
+    event.args[1] = arg1;
+    event.args[2] = arg2;
+    event.args[3] = arg3;
+
+    __atomic_store_n(&threadRing->written, position + 1, __ATOMIC_RELEASE);
+}
+
+// attachEventRing(buffer): the header must be initialized by the caller
+inline Napi::Value attach(const Napi::CallbackInfo &info) {
+    auto buffer = info[0].As<Napi::ArrayBuffer>();
+    auto newHeader = (Header *)buffer.Data();
+    if (buffer.ByteLength() < sizeof(Header)) {
+        Napi::Error::New(info.Env(), "Invalid event ring buffer").ThrowAsJavaScriptException();
+        return info.Env().Undefined();
+    }
+
+    uint32_t capacity = newHeader->ringCapacity;
+    if (
+        capacity == 0 ||
+        (capacity & (capacity - 1)) != 0 ||
+        buffer.ByteLength() < bufferSize(newHeader->ringCount, capacity)
+    ) {
+        Napi::Error::New(info.Env(), "Invalid event ring buffer").ThrowAsJavaScriptException();
+        return info.Env().Undefined();
+    }
+    if (attachedHeader) {
+        Napi::Error::New(info.Env(), "Event ring already attached").ThrowAsJavaScriptException();
+        return info.Env().Undefined();
+    }
+
+    // Keep the buffer alive since the worker threads write to it at any time
+    new Napi::Reference<Napi::ArrayBuffer>(Napi::Persistent(buffer));
+    __atomic_store_n(&attachedHeader, newHeader, __ATOMIC_RELEASE);
+    return info.Env().Undefined();
+}
+
+// drainEventRing(): { events: ArrayBuffer, counts: number[], threads: number[], lost: number }
+// The events are ordered by ring, `counts[i]` of them are from ring `i` written by thread `threads[i]`.
+inline Napi::Value drain(const Napi::CallbackInfo &info) {
+    auto env = info.Env();
+    Header *header = attachedHeader;
+    if (!header) {
+        Napi::Error::New(env, "Event ring not attached").ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
+
+    uint32_t capacity = header->ringCapacity;
+    uint32_t ringCount = std::min(__atomic_load_n(&header->nextRing, __ATOMIC_RELAXED), header->ringCount);
+
+    std::vector<Event> events;
+    auto counts = Napi::Array::New(env, ringCount), threads = Napi::Array::New(env, ringCount);
+    double lost = 0;
+    for (uint32_t i = 0; i < ringCount; i++) {
+        RingHeader *ring = getRing(header, i);
+        uint32_t end = __atomic_load_n(&ring->written, __ATOMIC_ACQUIRE);
+        uint32_t start = ring->drained;
+        if (end - start > capacity) {
+            lost += end - start - capacity;
+            start = end - capacity;
+        }
+
+        size_t offset = events.size();
+        for (uint32_t position = start; position != end; position++)
+            events.push_back(getEvents(ring)[position & (capacity - 1)]);
+
+        // The events before `writing - capacity` could be overwritten while copying
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        uint32_t writing = __atomic_load_n(&ring->writing, __ATOMIC_RELAXED);
+        if (writing - start > capacity) {
+            uint32_t overwritten = std::min(writing - start - capacity, end - start);
+            events.erase(events.begin() + offset, events.begin() + offset + overwritten);
+            lost += overwritten;
+        }
+
+        ring->drained = end;
+        counts.Set(i, Napi::Number::New(env, events.size() - offset));
+        threads.Set(i, Napi::Number::New(env, __atomic_load_n(&ring->thread, __ATOMIC_RELAXED)));
+    }
+
+    auto buffer = Napi::ArrayBuffer::New(env, events.size() * sizeof(Event));
+    if (!events.empty()) memcpy(buffer.Data(), events.data(), events.size() * sizeof(Event));
+
+    auto result = Napi::Object::New(env);
+    result.Set("events", buffer);
+    result.Set("counts", counts);
+    result.Set("threads", threads);
+    result.Set("lost", Napi::Number::New(env, lost));
+    return result;
+}
+
+inline void defineExports(Napi::Env env, Napi::Object exports) {
+    exports.Set("attachEventRing", Napi::Function::New(env, attach));
+    exports.Set("drainEventRing", Napi::Function::New(env, drain));
+}
+
+}
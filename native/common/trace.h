@@ -0,0 +1,59 @@
+#pragma once
+
+#include <napi.h>
+#include <ctime>
+
+#include "event_ring.h"
+
+// The time an operation runs on a worker thread, for the per-task tracing (src/tracing.ts) and metrics. The
+// JavaScript side passes a Float64Array(4), which gets the start and end time of the operation in microseconds
+// of CLOCK_MONOTONIC, the clock of process.hrtime(). Its last two elements are the task number and the
+// operation (string) of the event recorded to the event ring (see event_ring.h) after the operation.
+
+inline double traceNow() {
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+class NativeTiming {
+    Napi::Reference<Napi::Float64Array> array;
+    bool enabled = false;
+    double startTime = 0, endTime = 0;
+    uint32_t eventId, eventTask = 0;
+    int32_t eventOperation = 0;
+
+public:
+    // Any value other than a Float64Array disables the timing
+    NativeTiming(const Napi::Value &value, EventRing::EventId eventId) : eventId(eventId) {
+        if (!value.IsTypedArray() || value.As<Napi::TypedArray>().TypedArrayType() != napi_float64_array) return;
+        auto typedArray = value.As<Napi::Float64Array>();
+        if (typedArray.ElementLength() < 2) return;
+
+        array = Napi::Persistent(typedArray);
+        enabled = true;
+        if (typedArray.ElementLength() >= 4) {
+            eventTask = (uint32_t)typedArray[2];
+            eventOperation = (int32_t)typedArray[3];
+        }
+    }
+
+    // On the worker thread
+    void start() {
+        if (enabled) startTime = traceNow();
+    }
+
+    void end() {
+        if (!enabled) return;
+        endTime = traceNow();
+        EventRing::record(eventId, eventTask, startTime, (int32_t)(endTime - startTime), eventOperation);
+    }
+
+    // On the main thread, after the operation
+    void write() {
+        if (!enabled) return;
+        auto typedArray = array.Value();
+        typedArray[0] = startTime;
+        typedArray[1] = endTime;
+    }
+};
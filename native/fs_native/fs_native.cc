@@ -6,6 +6,8 @@
 #include <unistd.h>
 #include <filesystem>
 
+#include "trace.h"
+
 using ReturnValueMaker = std::function<Napi::Value (Napi::Env env)>;
 using OperationExecuter = std::function<ReturnValueMaker ()>;
 using OperationHandler = std::function<OperationExecuter (const Napi::CallbackInfo &info)>;
@@ -15,26 +17,35 @@ private:
     OperationExecuter operationExecuter;
     ReturnValueMaker returnValueMaker;
     Napi::Promise::Deferred deferred;
+    NativeTiming timing;
 
 public:
     AsyncFileSystemOperationWorker(
         Napi::Env env,
-        OperationExecuter operationExecuter
-    ) : Napi::AsyncWorker(env), operationExecuter(operationExecuter), deferred(Napi::Promise::Deferred::New(env)) {}
+        OperationExecuter operationExecuter,
+        const Napi::Value &timing
+    ) : Napi::AsyncWorker(env),
+        operationExecuter(operationExecuter),
+        deferred(Napi::Promise::Deferred::New(env)),
+        timing(timing, EventRing::FsOperation) {}
 
     Napi::Promise getPromise() const {
         return deferred.Promise();
     }
 
     void Execute() {
+        timing.start();
         try {
             returnValueMaker = operationExecuter();
         } catch (std::exception &ex) {
             SetError(ex.what());
         }
+        timing.end();
     }
 
     void OnOK() {
+        timing.write();
+
         Napi::Value returnValue;
         try {
             returnValue = returnValueMaker(Env());
@@ -48,6 +59,7 @@ public:
     }
 
     void OnError(const Napi::Error &error) {
+        timing.write();
         deferred.Reject(error.Value());
     }
 };
@@ -60,8 +72,10 @@ void traverse(const std::string &path, std::function<void (const std::string &)>
 };
 
 auto Init(Napi::Env env, Napi::Object exports) {
+    EventRing::defineExports(env, exports);
+
     auto defineOperation = [&] (const std::string &name, OperationHandler handler) {
-        // Async version
+        // Async version, with an optional Float64Array as the last argument for the timing (see trace.h)
         exports.Set(name, Napi::Function::New(env, [=] (const Napi::CallbackInfo &info) -> Napi::Value {
             OperationExecuter executer;
             try {
@@ -71,7 +85,8 @@ auto Init(Napi::Env env, Napi::Object exports) {
                 return info.Env().Undefined();
             }
 
-            auto worker = new AsyncFileSystemOperationWorker(info.Env(), executer);
+            auto timing = info.Length() > 0 ? info[info.Length() - 1] : info.Env().Undefined();
+            auto worker = new AsyncFileSystemOperationWorker(info.Env(), executer, timing);
             worker->Queue();
 
             return worker->getPromise();
@@ -0,0 +1,188 @@
+#pragma once
+
+#include <ctime>
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <thread>
+
+#include "proc.h"
+
+// Sample the cgroup v2 accounting files of a sandbox. The sandbox's cgroup is removed when it exits, so the
+// files are sampled periodically and the last successful sample is kept, which makes the values accurate to
+// the sampling interval. Cgroup v1 is not supported, the sampler reports nothing there.
+
+// Return the cgroup v2 directory of the process, or an empty string if it's in the same cgroup as us (then the
+// values would be ours) or the system is not on the unified hierarchy
+inline std::string getCgroupV2Directory(pid_t pid) {
+    static const bool unified = access("/sys/fs/cgroup/cgroup.controllers", F_OK) == 0;
+    if (!unified) return "";
+
+    auto getPath = [] (const std::string &file) {
+        std::string content;
+        if (!readFile(file, content)) return std::string();
+
+        std::istringstream stream(content);
+        std::string line;
+        while (std::getline(stream, line))
+            if (line.compare(0, 3, "0::") == 0) return line.substr(3);
+        return std::string();
+    };
+
+    auto path = getPath("/proc/" + std::to_string(pid) + "/cgroup");
+    if (path.empty() || path == getPath("/proc/self/cgroup")) return "";
+    return "/sys/fs/cgroup" + path;
+}
+
+// Parse "key value" lines (cpu.stat, memory.stat)
+inline bool readFlatKeyed(const std::string &file, std::map<std::string, uint64_t> &result) {
+    std::string content;
+    if (!readFile(file, content)) return false;
+
+    std::istringstream stream(content);
+    std::string key;
+    uint64_t value;
+    while (stream >> key >> value) result[key] = value;
+    return true;
+}
+
+// Parse "<device> key=value ..." lines (io.stat), summing all devices
+inline bool readNestedKeyedSum(const std::string &file, std::map<std::string, uint64_t> &result) {
+    std::string content;
+    if (!readFile(file, content)) return false;
+
+    for (auto &item : splitWhitespace(content)) {
+        auto equal = item.find('=');
+        if (equal == std::string::npos) continue;
+        result[item.substr(0, equal)] += std::strtoull(item.c_str() + equal + 1, nullptr, 10);
+    }
+    return true;
+}
+
+// Parse the "total" stall time (in microseconds) of the "some" and "full" lines of a PSI file
+inline bool readPressure(const std::string &file, uint64_t &some, uint64_t &full) {
+    std::string content;
+    if (!readFile(file, content)) return false;
+
+    std::istringstream stream(content);
+    std::string line;
+    while (std::getline(stream, line)) {
+        auto total = line.find("total=");
+        if (total == std::string::npos) continue;
+        uint64_t value = std::strtoull(line.c_str() + total + 6, nullptr, 10);
+        if (line.compare(0, 4, "some") == 0) some = value;
+        else if (line.compare(0, 4, "full") == 0) full = value;
+    }
+    return true;
+}
+
+struct CgroupStats {
+    bool valid = false;
+
+    // cpu.stat, in microseconds
+    uint64_t cpuUsage = 0, cpuUser = 0, cpuSystem = 0, cpuThrottled = 0;
+
+    // memory.stat and memory.peak (or the maximum memory.current sampled), in bytes
+    uint64_t memoryPeak = 0, majorFaults = 0, minorFaults = 0;
+
+    // io.stat
+    uint64_t ioReadBytes = 0, ioWriteBytes = 0, ioReadOperations = 0, ioWriteOperations = 0;
+
+    // *.pressure, stall time in microseconds
+    uint64_t cpuPressureSome = 0, cpuPressureFull = 0;
+    uint64_t memoryPressureSome = 0, memoryPressureFull = 0;
+    uint64_t ioPressureSome = 0, ioPressureFull = 0;
+};
+
+inline bool readCgroupStats(const std::string &directory, CgroupStats &stats) {
+    std::map<std::string, uint64_t> cpu, memory, io;
+    if (!readFlatKeyed(directory + "/cpu.stat", cpu) || !readFlatKeyed(directory + "/memory.stat", memory))
+        return false;
+
+    stats.cpuUsage = cpu["usage_usec"];
+    stats.cpuUser = cpu["user_usec"];
+    stats.cpuSystem = cpu["system_usec"];
+    stats.cpuThrottled = cpu["throttled_usec"];
+
+    stats.majorFaults = memory["pgmajfault"];
+    stats.minorFaults = memory["pgfault"] - std::min(memory["pgfault"], memory["pgmajfault"]);
+
+    std::string peak;
+    if (readFile(directory + "/memory.peak", peak) || readFile(directory + "/memory.current", peak))
+        stats.memoryPeak = std::max<uint64_t>(stats.memoryPeak, std::strtoull(peak.c_str(), nullptr, 10));
+
+    // The io controller may not be enabled for the cgroup
+    if (readNestedKeyedSum(directory + "/io.stat", io)) {
+        stats.ioReadBytes = io["rbytes"];
+        stats.ioWriteBytes = io["wbytes"];
+        stats.ioReadOperations = io["rios"];
+        stats.ioWriteOperations = io["wios"];
+    }
+
+    // PSI may be disabled in the kernel
+    readPressure(directory + "/cpu.pressure", stats.cpuPressureSome, stats.cpuPressureFull);
+    readPressure(directory + "/memory.pressure", stats.memoryPressureSome, stats.memoryPressureFull);
+    readPressure(directory + "/io.pressure", stats.ioPressureSome, stats.ioPressureFull);
+
+    stats.valid = true;
+    return true;
+}
+
+class CgroupSampler {
+    pid_t pid;
+    uint64_t interval; // In milliseconds
+
+    std::thread thread;
+    std::mutex mutex;
+    std::condition_variable stopCondition;
+    bool stopping = false, stopped = false;
+
+    std::string directory;
+
+    void sample() {
+        // The process may not be moved into its cgroup yet right after starting
+        if (directory.empty()) directory = getCgroupV2Directory(pid);
+        if (directory.empty()) return;
+
+        CgroupStats current = stats;
+        if (readCgroupStats(directory, current)) stats = current;
+    }
+
+    void run() {
+        auto interval = std::chrono::milliseconds(this->interval);
+        std::unique_lock<std::mutex> lock(mutex);
+        do {
+            lock.unlock();
+            sample();
+            lock.lock();
+        } while (!stopCondition.wait_for(lock, interval, [this] { return stopping; }));
+    }
+
+public:
+    // Only read after stop()
+    CgroupStats stats;
+
+    CgroupSampler(pid_t pid, uint64_t interval) : pid(pid), interval(interval) {
+        thread = std::thread([this] () { run(); });
+    }
+
+    ~CgroupSampler() {
+        stop();
+    }
+
+    // Take a last sample (if the cgroup still exists) and stop
+    void stop() {
+        if (stopped) return;
+        stopped = true;
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        stopCondition.notify_one();
+        thread.join();
+        sample();
+    }
+};
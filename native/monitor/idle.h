@@ -0,0 +1,116 @@
+#pragma once
+
+#include <ctime>
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+#include "proc.h"
+
+// Watch one or more process trees and report when they stop making progress: no thread is scheduled for a
+// whole window while all threads are sleeping. With `requirePipeRead`, every tree must also have a thread
+// blocked reading a pipe (e.g. the interactor and the user program waiting for each other).
+
+struct IdleWatchOptions {
+    uint64_t window; // In milliseconds
+    uint64_t interval; // In milliseconds
+    bool requirePipeRead;
+};
+
+class IdleWatch {
+    // (tid, runCount, cpuTime) of all threads, any change means progress
+    using Signature = std::vector<std::tuple<pid_t, uint64_t, uint64_t>>;
+
+    std::vector<pid_t> pids;
+    IdleWatchOptions options;
+    std::function<void ()> onIdle;
+
+    std::thread thread;
+    std::mutex mutex;
+    std::condition_variable stopCondition;
+    bool stopping = false, stopped = false;
+
+    static uint64_t now() {
+        timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return ts.tv_sec * 1000ull + ts.tv_nsec / 1000000;
+    }
+
+    // Return if the trees look idle in this sample, and fill the signature
+    bool sample(Signature &signature) {
+        signature.clear();
+
+        bool anyThread = false;
+        for (pid_t root : pids) {
+            bool pipeRead = false;
+            for (pid_t pid : getProcessTree(root))
+                for (pid_t tid : listThreads(pid)) {
+                    ThreadState state;
+                    if (!readThreadState(pid, tid, options.requirePipeRead, state)) continue;
+
+                    // Running, or in uninterruptible sleep (usually I/O) is not idle
+                    if (state.state != 'S') return false;
+
+                    anyThread = true;
+                    pipeRead = pipeRead || state.pipeRead;
+                    signature.emplace_back(tid, state.runCount, state.cpuTime);
+                }
+
+            if (options.requirePipeRead && !pipeRead) return false;
+        }
+
+        std::sort(signature.begin(), signature.end());
+        return anyThread;
+    }
+
+    void run() {
+        Signature lastSignature, signature;
+        uint64_t idleSince = 0;
+
+        auto interval = std::chrono::milliseconds(options.interval);
+        std::unique_lock<std::mutex> lock(mutex);
+        while (!stopCondition.wait_for(lock, interval, [this] { return stopping; })) {
+            lock.unlock();
+
+            uint64_t currentTime = now();
+            if (!sample(signature))
+                idleSince = 0;
+            else if (idleSince == 0 || signature != lastSignature) {
+                idleSince = currentTime;
+                std::swap(lastSignature, signature);
+            } else if (currentTime - idleSince >= options.window) {
+                onIdle();
+                return;
+            }
+
+            lock.lock();
+        }
+    }
+
+public:
+    IdleWatch(std::vector<pid_t> &&pids, IdleWatchOptions options, std::function<void ()> &&onIdle)
+        : pids(std::move(pids)), options(options), onIdle(std::move(onIdle)) {
+        thread = std::thread([this] () { run(); });
+    }
+
+    ~IdleWatch() {
+        stop();
+    }
+
+    void stop() {
+        if (stopped) return;
+        stopped = true;
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        stopCondition.notify_one();
+        thread.join();
+    }
+};
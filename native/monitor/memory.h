@@ -0,0 +1,159 @@
+#pragma once
+
+#include <ctime>
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "proc.h"
+#include "cgroup.h"
+
+// Record the memory usage of a sandbox over time, with the cgroup's memory.current if available, otherwise the
+// total RSS of the process tree.
+//
+// The buffer holds at most 2 * points samples. When it's full, adjacent samples are merged (keeping the larger
+// one) and the interval is doubled, so the samples always cover the whole run evenly. The interval is also
+// doubled when the CPU time spent sampling exceeds the given fraction of the elapsed time.
+
+struct MemoryTimelineOptions {
+    size_t points;
+    uint64_t minInterval; // In microseconds
+    uint64_t maxInterval; // In microseconds
+    double maxOverhead; // The maximum ratio of the sampling CPU time to the elapsed time
+};
+
+struct MemoryTimelinePoint {
+    uint64_t time; // In microseconds since the sampler started
+    uint64_t memory; // In bytes
+};
+
+class MemoryTimelineSampler {
+    pid_t pid;
+    MemoryTimelineOptions options;
+
+    std::thread thread;
+    std::mutex mutex;
+    std::condition_variable stopCondition;
+    bool stopping = false, stopped = false;
+
+    std::string cgroupDirectory;
+    bool cgroupResolved = false;
+    // While the cgroup is unresolved (e.g. on cgroup v1, or before the process is moved), resolving it is retried
+    // after a number of samples doubled on each failure, since it reads two /proc files
+    uint32_t cgroupRetrySamples = 0, cgroupRetryBackoff = 1;
+    static constexpr uint32_t MAX_CGROUP_RETRY_BACKOFF = 64;
+
+    static uint64_t getTime(clockid_t clock) {
+        timespec ts;
+        clock_gettime(clock, &ts);
+        return ts.tv_sec * 1000000ull + ts.tv_nsec / 1000;
+    }
+
+    bool readMemory(uint64_t &memory) {
+        // Resolve the cgroup once the process has been moved into it
+        if (!cgroupResolved && cgroupRetrySamples > 0)
+            cgroupRetrySamples--;
+        else if (!cgroupResolved) {
+            cgroupDirectory = getCgroupV2Directory(pid);
+            cgroupResolved = !cgroupDirectory.empty();
+            if (!cgroupResolved) {
+                cgroupRetrySamples = cgroupRetryBackoff;
+                cgroupRetryBackoff = std::min(cgroupRetryBackoff * 2, MAX_CGROUP_RETRY_BACKOFF);
+            }
+        }
+
+        std::string content;
+        if (!cgroupDirectory.empty() && readFile(cgroupDirectory + "/memory.current", content)) {
+            memory = std::strtoull(content.c_str(), nullptr, 10);
+            return true;
+        }
+
+        static const long pageSize = sysconf(_SC_PAGESIZE);
+        auto pids = getProcessTree(pid);
+        if (pids.empty()) return false;
+
+        memory = 0;
+        for (pid_t current : pids) {
+            if (!readFile("/proc/" + std::to_string(current) + "/statm", content)) continue;
+            auto fields = splitWhitespace(content);
+            if (fields.size() >= 2) memory += std::strtoull(fields[1].c_str(), nullptr, 10) * pageSize;
+        }
+        return true;
+    }
+
+    static void halve(std::vector<MemoryTimelinePoint> &points) {
+        size_t count = 0;
+        for (size_t i = 0; i < points.size(); i += 2) {
+            if (i + 1 < points.size() && points[i + 1].memory > points[i].memory)
+                points[count++] = points[i + 1];
+            else
+                points[count++] = points[i];
+        }
+        points.resize(count);
+    }
+
+    void run() {
+        uint64_t startTime = getTime(CLOCK_MONOTONIC);
+        uint64_t interval = options.minInterval;
+
+        std::unique_lock<std::mutex> lock(mutex);
+        do {
+            lock.unlock();
+
+            uint64_t sampleStartCpuTime = getTime(CLOCK_THREAD_CPUTIME_ID);
+            uint64_t memory;
+            if (readMemory(memory)) {
+                timeline.push_back({ getTime(CLOCK_MONOTONIC) - startTime, memory });
+                samples++;
+            }
+
+            if (timeline.size() >= options.points * 2) {
+                halve(timeline);
+                interval = std::min(interval * 2, options.maxInterval);
+            }
+            samplingTime += getTime(CLOCK_THREAD_CPUTIME_ID) - sampleStartCpuTime;
+
+            uint64_t elapsed = getTime(CLOCK_MONOTONIC) - startTime;
+            if (samplingTime > elapsed * options.maxOverhead)
+                interval = std::min(interval * 2, options.maxInterval);
+
+            lock.lock();
+        } while (!stopCondition.wait_for(lock, std::chrono::microseconds(interval), [this] { return stopping; }));
+
+        finalInterval = interval;
+    }
+
+public:
+    // Only read after stop()
+    std::vector<MemoryTimelinePoint> timeline;
+    uint64_t samples = 0;
+    uint64_t samplingTime = 0; // CPU time in microseconds
+    uint64_t finalInterval = 0; // In microseconds
+
+    MemoryTimelineSampler(pid_t pid, MemoryTimelineOptions options) : pid(pid), options(options) {
+        timeline.reserve(options.points * 2);
+        thread = std::thread([this] () { run(); });
+    }
+
+    ~MemoryTimelineSampler() {
+        stop();
+    }
+
+    // Stop and downsample the timeline to at most `points` points
+    void stop() {
+        if (stopped) return;
+        stopped = true;
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        stopCondition.notify_one();
+        thread.join();
+
+        while (timeline.size() > options.points) halve(timeline);
+    }
+};
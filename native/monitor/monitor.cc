@@ -0,0 +1,178 @@
+#include <napi.h>
+#include <memory>
+#include <vector>
+
+#include "idle.h"
+#include "cgroup.h"
+#include "memory.h"
+#include "timing.h"
+
+Napi::Object Init(Napi::Env env, Napi::Object exports) {
+    // watchIdle(pids, { window, interval, requirePipeRead }, onIdle) -> { stop() }
+    exports.Set("watchIdle", Napi::Function::New(env, [] (const Napi::CallbackInfo &info) -> Napi::Value {
+        auto pidsArray = info[0].As<Napi::Array>();
+        std::vector<pid_t> pids(pidsArray.Length());
+        for (uint32_t i = 0; i < pidsArray.Length(); i++)
+            pids[i] = pidsArray.Get(i).As<Napi::Number>().Int32Value();
+
+        auto optionsObject = info[1].As<Napi::Object>();
+        IdleWatchOptions options;
+        options.window = optionsObject.Get("window").As<Napi::Number>().Int64Value();
+        options.interval = optionsObject.Get("interval").As<Napi::Number>().Int64Value();
+        options.requirePipeRead = optionsObject.Get("requirePipeRead").ToBoolean().Value();
+
+        // Don't keep the event loop alive just for the watch
+        auto onIdle = Napi::ThreadSafeFunction::New(info.Env(), info[2].As<Napi::Function>(), "IdleWatch", 0, 1);
+        onIdle.Unref(info.Env());
+
+        auto watch = std::make_shared<IdleWatch>(std::move(pids), options, [onIdle] () mutable {
+            onIdle.BlockingCall();
+        });
+
+        auto result = Napi::Object::New(info.Env());
+
+        // Must be called to release the callback, even if it has been called
+        result["stop"] = Napi::Function::New(info.Env(), [watch, onIdle] (const Napi::CallbackInfo &info) mutable {
+            if (!watch) return;
+            watch->stop();
+            watch = nullptr;
+            onIdle.Release();
+        });
+
+        return result;
+    }));
+
+    // startCgroupSampler(pid, interval) -> { stop() }, stop() returns the last sample or null
+    exports.Set("startCgroupSampler", Napi::Function::New(env, [] (const Napi::CallbackInfo &info) -> Napi::Value {
+        pid_t pid = info[0].As<Napi::Number>().Int32Value();
+        uint64_t interval = info[1].As<Napi::Number>().Int64Value();
+        auto sampler = std::make_shared<CgroupSampler>(pid, interval);
+
+        auto result = Napi::Object::New(info.Env());
+        result["stop"] = Napi::Function::New(info.Env(), [sampler] (const Napi::CallbackInfo &info) -> Napi::Value {
+            sampler->stop();
+
+            const auto &stats = sampler->stats;
+            if (!stats.valid) return info.Env().Null();
+
+            auto result = Napi::Object::New(info.Env());
+            result["cpuUsage"] = (double)stats.cpuUsage;
+            result["cpuUser"] = (double)stats.cpuUser;
+            result["cpuSystem"] = (double)stats.cpuSystem;
+            result["cpuThrottled"] = (double)stats.cpuThrottled;
+            result["memoryPeak"] = (double)stats.memoryPeak;
+            result["majorFaults"] = (double)stats.majorFaults;
+            result["minorFaults"] = (double)stats.minorFaults;
+            result["ioReadBytes"] = (double)stats.ioReadBytes;
+            result["ioWriteBytes"] = (double)stats.ioWriteBytes;
+            result["ioReadOperations"] = (double)stats.ioReadOperations;
+            result["ioWriteOperations"] = (double)stats.ioWriteOperations;
+            result["cpuPressureSome"] = (double)stats.cpuPressureSome;
+            result["cpuPressureFull"] = (double)stats.cpuPressureFull;
+            result["memoryPressureSome"] = (double)stats.memoryPressureSome;
+            result["memoryPressureFull"] = (double)stats.memoryPressureFull;
+            result["ioPressureSome"] = (double)stats.ioPressureSome;
+            result["ioPressureFull"] = (double)stats.ioPressureFull;
+            return result;
+        });
+
+        return result;
+    }));
+
+    // startMemoryTimeline(pid, { points, minInterval, maxInterval, maxOverhead }) -> { stop() }
+    // Intervals are in milliseconds
+    exports.Set("startMemoryTimeline", Napi::Function::New(env, [] (const Napi::CallbackInfo &info) -> Napi::Value {
+        pid_t pid = info[0].As<Napi::Number>().Int32Value();
+        auto optionsObject = info[1].As<Napi::Object>();
+        MemoryTimelineOptions options;
+        options.points = optionsObject.Get("points").As<Napi::Number>().Uint32Value();
+        options.minInterval = optionsObject.Get("minInterval").As<Napi::Number>().DoubleValue() * 1000;
+        options.maxInterval = optionsObject.Get("maxInterval").As<Napi::Number>().DoubleValue() * 1000;
+        options.maxOverhead = optionsObject.Get("maxOverhead").As<Napi::Number>().DoubleValue();
+        auto sampler = std::make_shared<MemoryTimelineSampler>(pid, options);
+
+        auto result = Napi::Object::New(info.Env());
+        result["stop"] = Napi::Function::New(info.Env(), [sampler] (const Napi::CallbackInfo &info) -> Napi::Value {
+            sampler->stop();
+
+            // [time (ms), memory (KiB)]
+            auto points = Napi::Array::New(info.Env(), sampler->timeline.size());
+            for (uint32_t i = 0; i < sampler->timeline.size(); i++) {
+                auto point = Napi::Array::New(info.Env(), 2);
+                point[0u] = sampler->timeline[i].time / 1e3;
+                point[1u] = sampler->timeline[i].memory / 1024.0;
+                points[i] = point;
+            }
+
+            auto result = Napi::Object::New(info.Env());
+            result["points"] = points;
+            result["samples"] = (double)sampler->samples;
+            result["samplingTime"] = sampler->samplingTime / 1e3;
+            result["interval"] = sampler->finalInterval / 1e3;
+            return result;
+        });
+
+        return result;
+    }));
+
+    // startTimingProbe({ cpus, window, maxBusyRatio }, onSample) -> { requestRound(), stop() }
+    // onSample is called with each sample of a round, then with null at the end of the round
+    exports.Set("startTimingProbe", Napi::Function::New(env, [] (const Napi::CallbackInfo &info) -> Napi::Value {
+        auto optionsObject = info[0].As<Napi::Object>();
+        TimingProbeOptions options;
+        auto cpusArray = optionsObject.Get("cpus").As<Napi::Array>();
+        for (uint32_t i = 0; i < cpusArray.Length(); i++)
+            options.cpus.push_back(cpusArray.Get(i).As<Napi::Number>().Int32Value());
+        options.window = optionsObject.Get("window").As<Napi::Number>().Uint32Value();
+        options.maxBusyRatio = optionsObject.Get("maxBusyRatio").As<Napi::Number>().DoubleValue();
+
+        auto onSample = Napi::ThreadSafeFunction::New(info.Env(), info[1].As<Napi::Function>(), "TimingProbe", 0, 1);
+        onSample.Unref(info.Env());
+
+        auto callJs = [] (Napi::Env env, Napi::Function callback, TimingProbeSample *sample) {
+            if (!sample) {
+                callback.Call({ env.Null() });
+                return;
+            }
+
+            auto object = Napi::Object::New(env);
+            object["cpu"] = sample->cpu;
+            object["duration"] = sample->duration / 1e6;
+            object["mean"] = sample->mean / 1e6;
+            object["variation"] = sample->variation;
+            object["windowSize"] = (double)sample->windowSize;
+            object["frequency"] = (double)sample->frequency;
+            object["stealRatio"] = sample->stealRatio;
+            delete sample;
+            callback.Call({ object });
+        };
+        auto probe = std::make_shared<TimingProbe>(
+            std::move(options),
+            [onSample, callJs] (const TimingProbeSample &sample) mutable {
+                onSample.BlockingCall(new TimingProbeSample(sample), callJs);
+            },
+            [onSample, callJs] () mutable {
+                onSample.BlockingCall(static_cast<TimingProbeSample *>(nullptr), callJs);
+            }
+        );
+
+        auto result = Napi::Object::New(info.Env());
+        result["requestRound"] = Napi::Function::New(info.Env(), [probe] (const Napi::CallbackInfo &info) {
+            return Napi::Boolean::New(info.Env(), probe->requestRound());
+        });
+
+        // Must be called to release the callback
+        result["stop"] = Napi::Function::New(info.Env(), [probe, onSample] (const Napi::CallbackInfo &info) mutable {
+            if (!probe) return;
+            probe->stop();
+            probe = nullptr;
+            onSample.Release();
+        });
+
+        return result;
+    }));
+
+    return exports;
+}
+
+NODE_API_MODULE(NODE_MODULE_NAME, Init)
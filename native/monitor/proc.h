@@ -0,0 +1,170 @@
+#pragma once
+
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/syscall.h>
+#include <cstdint>
+#include <cstdlib>
+#include <string>
+#include <utility>
+#include <vector>
+#include <fstream>
+#include <sstream>
+
+// Helpers to read the state of process trees from procfs. All functions tolerate the processes exiting while
+// being read, in which case the data of the exited ones are just missing.
+
+inline bool readFile(const std::string &path, std::string &content) {
+    std::ifstream stream(path);
+    if (!stream) return false;
+
+    std::stringstream buffer;
+    buffer << stream.rdbuf();
+    content = buffer.str();
+    return !stream.bad();
+}
+
+inline std::vector<std::string> splitWhitespace(const std::string &str) {
+    std::vector<std::string> result;
+    std::istringstream stream(str);
+    std::string item;
+    while (stream >> item) result.push_back(item);
+    return result;
+}
+
+inline std::vector<pid_t> listThreads(pid_t pid) {
+    std::vector<pid_t> result;
+    DIR *dir = opendir(("/proc/" + std::to_string(pid) + "/task").c_str());
+    if (!dir) return result;
+
+    while (dirent *entry = readdir(dir))
+        if (entry->d_name[0] != '.') result.push_back(std::atoi(entry->d_name));
+
+    closedir(dir);
+    return result;
+}
+
+// Return the parent pid of each process by scanning /proc
+inline std::vector<std::pair<pid_t, pid_t>> listProcessParents() {
+    std::vector<std::pair<pid_t, pid_t>> result;
+    DIR *dir = opendir("/proc");
+    if (!dir) return result;
+
+    while (dirent *entry = readdir(dir)) {
+        if (entry->d_name[0] < '0' || entry->d_name[0] > '9') continue;
+
+        std::string stat;
+        if (!readFile(std::string("/proc/") + entry->d_name + "/stat", stat)) continue;
+        auto commEnd = stat.rfind(')');
+        if (commEnd == std::string::npos || commEnd + 2 >= stat.length()) continue;
+        auto fields = splitWhitespace(stat.substr(commEnd + 2));
+        if (fields.size() < 2) continue;
+        result.emplace_back(std::atoi(entry->d_name), std::atoi(fields[1].c_str()));
+    }
+
+    closedir(dir);
+    return result;
+}
+
+// Return the pids of the process tree rooted at `pid`, including itself. Uses the `children` files if the kernel
+// has CONFIG_PROC_CHILDREN, otherwise scans all processes.
+inline std::vector<pid_t> getProcessTree(pid_t pid) {
+    static const bool hasChildrenFile = [] {
+        std::string self = std::to_string(getpid());
+        return access(("/proc/" + self + "/task/" + self + "/children").c_str(), F_OK) == 0;
+    }();
+
+    std::vector<pid_t> result;
+    std::vector<std::pair<pid_t, pid_t>> parents;
+    if (!hasChildrenFile) parents = listProcessParents();
+
+    std::vector<pid_t> queue = { pid };
+    while (!queue.empty()) {
+        pid_t current = queue.back();
+        queue.pop_back();
+
+        auto threads = listThreads(current);
+        if (threads.empty()) continue;
+        result.push_back(current);
+
+        if (!hasChildrenFile) {
+            for (auto &[child, parent] : parents)
+                if (parent == current) queue.push_back(child);
+            continue;
+        }
+
+        // A child is listed in the `children` file of the thread which created it
+        for (pid_t tid : threads) {
+            std::string children;
+            if (!readFile("/proc/" + std::to_string(current) + "/task/" + std::to_string(tid) + "/children", children))
+                continue;
+            for (auto &child : splitWhitespace(children)) queue.push_back(std::atoi(child.c_str()));
+        }
+    }
+    return result;
+}
+
+struct ThreadState {
+    pid_t pid, tid;
+    char state; // R, S, D, ...
+    uint64_t cpuTime; // In nanoseconds (in clock ticks granularity if schedstat is unavailable)
+    uint64_t runCount; // The number of times the thread was scheduled on a CPU, 0 if schedstat is unavailable
+    bool pipeRead; // Sleeping in a read() from a pipe
+};
+
+// Whether the sleeping thread is blocked reading a pipe, by `wchan` or by the syscall and its fd
+inline bool isBlockedOnPipeRead(const std::string &taskPath, pid_t pid) {
+    std::string wchan;
+    if (readFile(taskPath + "/wchan", wchan) && wchan.find("pipe") != std::string::npos) return true;
+
+    std::string syscall;
+    if (!readFile(taskPath + "/syscall", syscall)) return false;
+    auto fields = splitWhitespace(syscall);
+    if (fields.size() < 2) return false;
+
+    long number = std::strtol(fields[0].c_str(), nullptr, 10);
+    if (number != SYS_read && number != SYS_readv && number != SYS_pread64) return false;
+
+    long fd = std::strtol(fields[1].c_str(), nullptr, 16);
+    std::string fdPath = "/proc/" + std::to_string(pid) + "/fd/" + std::to_string(fd);
+    char target[64];
+    ssize_t length = readlink(fdPath.c_str(), target, sizeof(target) - 1);
+    if (length <= 0) return false;
+    target[length] = '\0';
+    return std::string(target).compare(0, 5, "pipe:") == 0;
+}
+
+inline bool readThreadState(pid_t pid, pid_t tid, bool checkPipeRead, ThreadState &result) {
+    std::string taskPath = "/proc/" + std::to_string(pid) + "/task/" + std::to_string(tid);
+
+    std::string stat;
+    if (!readFile(taskPath + "/stat", stat)) return false;
+
+    // The command name may contain spaces and parentheses, skip to the last ')'
+    auto commEnd = stat.rfind(')');
+    if (commEnd == std::string::npos || commEnd + 2 >= stat.length()) return false;
+    auto fields = splitWhitespace(stat.substr(commEnd + 2));
+    // fields[0] is the 3rd field (state), utime and stime are the 14th and 15th fields
+    if (fields.size() < 13) return false;
+
+    result.pid = pid;
+    result.tid = tid;
+    result.state = fields[0][0];
+
+    std::string schedstat;
+    std::vector<std::string> schedstatFields;
+    if (readFile(taskPath + "/schedstat", schedstat)) schedstatFields = splitWhitespace(schedstat);
+    if (schedstatFields.size() >= 3) {
+        result.cpuTime = std::strtoull(schedstatFields[0].c_str(), nullptr, 10);
+        result.runCount = std::strtoull(schedstatFields[2].c_str(), nullptr, 10);
+    } else {
+        static const long ticksPerSecond = sysconf(_SC_CLK_TCK);
+        uint64_t ticks = std::strtoull(fields[11].c_str(), nullptr, 10)
+                       + std::strtoull(fields[12].c_str(), nullptr, 10);
+        result.cpuTime = ticks * (1000000000ull / ticksPerSecond);
+        result.runCount = 0;
+    }
+
+    result.pipeRead = checkPipeRead && result.state == 'S' && isBlockedOnPipeRead(taskPath, pid);
+    return true;
+}
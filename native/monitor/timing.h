@@ -0,0 +1,205 @@
+#pragma once
+
+#include <sched.h>
+#include <ctime>
+#include <cmath>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "proc.h"
+
+// On each requested round, run a fixed micro-workload pinned to each of the given CPU cores (skipping the ones
+// which are busy right before, e.g. running a user program) and track the variance of its duration, together
+// with the core's current frequency and steal time, to tell when the node's timing is unreliable. The rounds are
+// requested by the caller only when no user program could start meanwhile (i.e. with a task queue slot held).
+
+struct TimingProbeOptions {
+    std::vector<int> cpus;
+    size_t window; // The number of recent durations of each core the variance is calculated on
+    double maxBusyRatio; // A core busier than this in the moment before probing is skipped
+};
+
+struct TimingProbeSample {
+    int cpu;
+    uint64_t duration; // In nanoseconds
+    double mean; // In nanoseconds, of the window
+    double variation; // The coefficient of variation (stddev / mean) of the window
+    size_t windowSize;
+    uint64_t frequency; // In kHz, 0 if unknown
+    double stealRatio; // The ratio of steal time since the last round
+};
+
+// The jiffies of a core in /proc/stat
+struct CpuTimes {
+    uint64_t total = 0, idle = 0, steal = 0;
+};
+
+inline std::map<int, CpuTimes> readCpuTimes() {
+    std::map<int, CpuTimes> result;
+    std::string content;
+    if (!readFile("/proc/stat", content)) return result;
+
+    std::istringstream stream(content);
+    std::string line;
+    while (std::getline(stream, line)) {
+        // Only "cpuN ..." lines, not the total "cpu ..." line
+        if (line.compare(0, 3, "cpu") != 0 || line.length() < 4 || line[3] < '0' || line[3] > '9') continue;
+
+        auto fields = splitWhitespace(line);
+        if (fields.size() < 9) continue;
+
+        CpuTimes times;
+        for (size_t i = 1; i <= 8; i++) times.total += std::strtoull(fields[i].c_str(), nullptr, 10);
+        times.idle = std::strtoull(fields[4].c_str(), nullptr, 10) + std::strtoull(fields[5].c_str(), nullptr, 10);
+        times.steal = std::strtoull(fields[8].c_str(), nullptr, 10);
+        result[std::atoi(fields[0].c_str() + 3)] = times;
+    }
+    return result;
+}
+
+class TimingProbe {
+    TimingProbeOptions options;
+    std::function<void (const TimingProbeSample &)> onSample;
+    std::function<void ()> onRoundEnd;
+
+    // In milliseconds, the busy ratio of the cores is measured in, a few jiffies
+    static constexpr uint64_t BUSY_WINDOW = 100;
+
+    std::thread thread;
+    std::mutex mutex;
+    std::condition_variable condition;
+    bool roundRequested = false, stopping = false, stopped = false;
+
+    std::map<int, std::deque<uint64_t>> durations;
+
+    static uint64_t now() {
+        timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+    }
+
+    // The workload is fixed, so its duration on the same core only changes with the environment
+    static uint64_t runWorkload() {
+        const size_t ITERATIONS = 4000000;
+
+        uint64_t startTime = now();
+        volatile uint64_t sink;
+        uint64_t x = 88172645463325252ull;
+        for (size_t i = 0; i < ITERATIONS; i++) {
+            x ^= x << 13;
+            x ^= x >> 7;
+            x ^= x << 17;
+        }
+        sink = x;
+        (void)sink;
+        return now() - startTime;
+    }
+
+    static uint64_t readFrequency(int cpu) {
+        std::string content;
+        if (!readFile("/sys/devices/system/cpu/cpu" + std::to_string(cpu) + "/cpufreq/scaling_cur_freq", content))
+            return 0;
+        return std::strtoull(content.c_str(), nullptr, 10);
+    }
+
+    void probe(int cpu, const CpuTimes &previous, const CpuTimes &current) {
+        uint64_t total = current.total - previous.total;
+        if (total == 0) return;
+        double busyRatio = 1 - (double)(current.idle - previous.idle) / total;
+        if (busyRatio > options.maxBusyRatio) return;
+
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cpu, &set);
+        if (sched_setaffinity(0, sizeof(set), &set) != 0) return;
+
+        TimingProbeSample sample;
+        sample.cpu = cpu;
+        sample.duration = runWorkload();
+        sample.frequency = readFrequency(cpu);
+        sample.stealRatio = (double)(current.steal - previous.steal) / total;
+
+        auto &window = durations[cpu];
+        window.push_back(sample.duration);
+        if (window.size() > options.window) window.pop_front();
+
+        double sum = 0, squareSum = 0;
+        for (uint64_t duration : window) {
+            sum += duration;
+            squareSum += (double)duration * duration;
+        }
+        sample.windowSize = window.size();
+        sample.mean = sum / window.size();
+        double variance = std::max(0.0, squareSum / window.size() - sample.mean * sample.mean);
+        sample.variation = std::sqrt(variance) / sample.mean;
+
+        onSample(sample);
+    }
+
+    void run() {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true) {
+            condition.wait(lock, [this] { return roundRequested || stopping; });
+            if (stopping) return;
+
+            // Measure how busy the cores are right now, not since the last round
+            auto previousTimes = readCpuTimes();
+            if (condition.wait_for(lock, std::chrono::milliseconds(BUSY_WINDOW), [this] { return stopping; }))
+                return;
+            lock.unlock();
+
+            auto currentTimes = readCpuTimes();
+            for (int cpu : options.cpus)
+                if (previousTimes.count(cpu) && currentTimes.count(cpu))
+                    probe(cpu, previousTimes[cpu], currentTimes[cpu]);
+
+            lock.lock();
+            roundRequested = false;
+            lock.unlock();
+            onRoundEnd();
+            lock.lock();
+        }
+    }
+
+public:
+    TimingProbe(
+        TimingProbeOptions &&options,
+        std::function<void (const TimingProbeSample &)> &&onSample,
+        std::function<void ()> &&onRoundEnd
+    ) : options(std::move(options)), onSample(std::move(onSample)), onRoundEnd(std::move(onRoundEnd)) {
+        thread = std::thread([this] () { run(); });
+    }
+
+    // Start a round if none is running, `onRoundEnd` is called after it
+    bool requestRound() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (roundRequested || stopping) return false;
+            roundRequested = true;
+        }
+        condition.notify_one();
+        return true;
+    }
+
+    ~TimingProbe() {
+        stop();
+    }
+
+    void stop() {
+        if (stopped) return;
+        stopped = true;
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        condition.notify_one();
+        thread.join();
+    }
+};
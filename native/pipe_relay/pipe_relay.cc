@@ -0,0 +1,324 @@
+#include <napi.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <ctime>
+#include <thread>
+#include <string>
+#include <algorithm>
+#include <memory>
+#include <vector>
+
+// The relay forwards data between pipes with splice(), so the data is never copied to userspace.
+// Each channel is a (from, to) pair of pipe fds, all channels of a relay are served by one thread.
+//
+// If a transcript file is specified, the data is duplicated with tee() and then spliced to the file (until
+// the limit is reached), with a header line written every time the direction changes. The duplicated data past
+// the limit is read and dropped, counting its characters for the omitted length of the transcript.
+
+uint64_t getMonotonicTime() {
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+struct RelayChannel {
+    int from, to;
+    std::string transcriptHeader;
+
+    enum class State {
+        Transferring,
+        WaitingForInput,
+        WaitingForOutput,
+        Closed
+    } state = State::Transferring;
+    uint64_t waitingSince = 0;
+
+    // Statistics
+    uint64_t bytes = 0;
+    uint64_t writes = 0; // The number of forwarded chunks, approximately the number of writes by the producer
+    uint64_t inputWaitTime = 0; // In nanoseconds, the time waiting for the producer to write
+    uint64_t outputWaitTime = 0; // In nanoseconds, the time waiting for the consumer to read (the pipe is full)
+
+    void wait(State newState, uint64_t now) {
+        if (state == newState) return;
+        state = newState;
+        waitingSince = now;
+    }
+
+    void stopWaiting(uint64_t now) {
+        if (state == State::WaitingForInput)
+            inputWaitTime += now - waitingSince;
+        else if (state == State::WaitingForOutput)
+            outputWaitTime += now - waitingSince;
+        else
+            return;
+
+        state = State::Transferring;
+    }
+};
+
+// The number of UTF-16 code units (i.e. the length of a JavaScript string) of the UTF-8 data, counted by the first
+// byte of each sequence, so a sequence split between two calls is counted once
+static uint64_t countUtf16Units(const unsigned char *data, size_t size) {
+    uint64_t units = 0;
+    for (size_t i = 0; i < size; i++) {
+        if ((data[i] & 0xc0) != 0x80) units++;
+        // A supplementary character is a surrogate pair
+        if (data[i] >= 0xf0) units++;
+    }
+    return units;
+}
+
+struct RelayTranscript {
+    int fd = -1;
+    uint64_t limit = 0;
+
+    uint64_t capturedBytes = 0;
+    uint64_t totalBytes = 0;
+    // The length (in UTF-16 code units, like the length of OmittableString) of the data not captured
+    uint64_t omittedLength = 0;
+    const RelayChannel *lastChannel = nullptr;
+    std::unique_ptr<unsigned char[]> dropBuffer;
+
+    static constexpr size_t DROP_BUFFER_SIZE = 64 * 1024;
+
+    // Move exactly `size` bytes from the pipe, which have been tee()-ed, to the transcript file
+    void capture(const RelayChannel &channel, size_t size) {
+        if (lastChannel != &channel) {
+            lastChannel = &channel;
+            const auto &header = channel.transcriptHeader;
+            totalBytes += header.length();
+            if (capturedBytes + header.length() <= limit) {
+                if (pwrite(fd, header.data(), header.length(), capturedBytes) != (ssize_t)header.length())
+                    throw std::system_error(errno, std::system_category(), "pwrite");
+                capturedBytes += header.length();
+            } else {
+                capturedBytes = limit;
+                omittedLength += countUtf16Units((const unsigned char *)header.data(), header.length());
+            }
+        }
+
+        totalBytes += size;
+        while (size > 0) {
+            loff_t offset = capturedBytes;
+            bool toFile = capturedBytes < limit;
+            ssize_t moved;
+            if (toFile)
+                moved = splice(channel.from, NULL, fd, &offset, std::min<uint64_t>(size, limit - capturedBytes),
+                               SPLICE_F_MOVE);
+            else {
+                if (!dropBuffer) dropBuffer.reset(new unsigned char[DROP_BUFFER_SIZE]);
+                moved = read(channel.from, dropBuffer.get(), std::min(size, DROP_BUFFER_SIZE));
+            }
+            if (moved == -1) {
+                if (errno == EINTR) continue;
+                throw std::system_error(errno, std::system_category(), toFile ? "splice" : "read");
+            }
+
+            if (toFile) capturedBytes += moved;
+            else omittedLength += countUtf16Units(dropBuffer.get(), moved);
+            size -= moved;
+        }
+    }
+};
+
+class PipeRelay {
+    std::thread thread;
+    int stopEventFd;
+    bool stopped = false;
+
+    void run() {
+        try {
+            loop();
+        } catch (std::exception &ex) {
+            error = ex.what();
+        }
+    }
+
+    // Forward as much data as possible without blocking, then determine what the channel is waiting for
+    void transfer(RelayChannel &channel) {
+        const size_t CHUNK_SIZE = 1024 * 1024;
+
+        for (;;) {
+            bool capturing = transcript.fd != -1;
+            ssize_t size = capturing
+                         ? tee(channel.from, channel.to, CHUNK_SIZE, SPLICE_F_NONBLOCK)
+                         : splice(channel.from, NULL, channel.to, NULL, CHUNK_SIZE, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+            if (size > 0) {
+                if (capturing) transcript.capture(channel, size);
+                channel.bytes += size;
+                channel.writes++;
+            } else if (size == 0) {
+                // All writers of the input pipe are closed
+                channel.state = RelayChannel::State::Closed;
+                return;
+            } else if (errno == EINTR) {
+                continue;
+            } else if (errno == EAGAIN) {
+                // Either the input pipe is empty or the output pipe is full
+                pollfd input = { channel.from, POLLIN, 0 };
+                bool readable = poll(&input, 1, 0) > 0 && (input.revents & POLLIN);
+                channel.wait(
+                    readable ? RelayChannel::State::WaitingForOutput : RelayChannel::State::WaitingForInput,
+                    getMonotonicTime()
+                );
+                return;
+            } else if (errno == EPIPE) {
+                // All readers of the output pipe are closed
+                channel.state = RelayChannel::State::Closed;
+                return;
+            } else
+                throw std::system_error(errno, std::system_category(), "splice");
+        }
+    }
+
+    void loop() {
+        std::vector<pollfd> pollFds(channels.size() + 1);
+        std::vector<RelayChannel *> pollChannels(channels.size());
+
+        for (;;) {
+            size_t count = 0;
+            for (auto &channel : channels) {
+                if (channel.state == RelayChannel::State::Transferring)
+                    transfer(channel);
+
+                if (channel.state == RelayChannel::State::WaitingForInput)
+                    pollFds[count] = { channel.from, POLLIN, 0 };
+                else if (channel.state == RelayChannel::State::WaitingForOutput)
+                    pollFds[count] = { channel.to, POLLOUT, 0 };
+                else
+                    continue;
+
+                pollChannels[count++] = &channel;
+            }
+            pollFds[count] = { stopEventFd, POLLIN, 0 };
+
+            if (poll(pollFds.data(), count + 1, -1) == -1) {
+                if (errno == EINTR) continue;
+                throw std::system_error(errno, std::system_category(), "poll");
+            }
+
+            auto now = getMonotonicTime();
+            if (pollFds[count].revents) {
+                for (auto &channel : channels)
+                    channel.stopWaiting(now);
+                return;
+            }
+
+            for (size_t i = 0; i < count; i++)
+                if (pollFds[i].revents)
+                    pollChannels[i]->stopWaiting(now);
+        }
+    }
+
+public:
+    std::vector<RelayChannel> channels;
+    RelayTranscript transcript;
+    std::string error;
+
+    PipeRelay(std::vector<RelayChannel> &&channels, int transcriptFd, uint64_t transcriptLimit)
+        : channels(std::move(channels)) {
+        if (transcriptFd != -1) {
+            transcript.fd = transcriptFd;
+            transcript.limit = transcriptLimit;
+        }
+
+        stopEventFd = eventfd(0, EFD_CLOEXEC);
+        if (stopEventFd == -1)
+            throw std::system_error(errno, std::system_category(), "eventfd");
+
+        thread = std::thread([this] () { run(); });
+    }
+
+    ~PipeRelay() {
+        stop();
+    }
+
+    void stop() {
+        if (stopped) return;
+        stopped = true;
+
+        uint64_t value = 1;
+        if (write(stopEventFd, &value, sizeof(value)) != sizeof(value)) {
+            // Couldn't happen unless the counter overflows
+        }
+        thread.join();
+        close(stopEventFd);
+    }
+};
+
+Napi::Object Init(Napi::Env env, Napi::Object exports) {
+    exports.Set("start", Napi::Function::New(env, [] (const Napi::CallbackInfo &info) -> Napi::Value {
+        auto channelsArray = info[0].As<Napi::Array>();
+        std::vector<RelayChannel> channels(channelsArray.Length());
+        for (uint32_t i = 0; i < channelsArray.Length(); i++) {
+            auto channel = channelsArray.Get(i).As<Napi::Object>();
+            channels[i].from = channel.Get("from").As<Napi::Number>().Int32Value();
+            channels[i].to = channel.Get("to").As<Napi::Number>().Int32Value();
+
+            auto transcriptHeader = channel.Get("transcriptHeader");
+            if (transcriptHeader.IsString())
+                channels[i].transcriptHeader = transcriptHeader.As<Napi::String>().Utf8Value();
+        }
+
+        // Optional: { fd, limit }
+        int transcriptFd = -1;
+        uint64_t transcriptLimit = 0;
+        if (info[1].IsObject()) {
+            auto transcript = info[1].As<Napi::Object>();
+            transcriptFd = transcript.Get("fd").As<Napi::Number>().Int32Value();
+            transcriptLimit = transcript.Get("limit").As<Napi::Number>().Int64Value();
+        }
+
+        std::shared_ptr<PipeRelay> relay;
+        try {
+            relay = std::make_shared<PipeRelay>(std::move(channels), transcriptFd, transcriptLimit);
+        } catch (std::exception &ex) {
+            Napi::Error::New(info.Env(), ex.what()).ThrowAsJavaScriptException();
+            return info.Env().Undefined();
+        }
+
+        auto result = Napi::Object::New(info.Env());
+
+        // The relay MUST be stopped before closing any of its fds
+        result["stop"] = Napi::Function::New(info.Env(), [relay] (const Napi::CallbackInfo &info) -> Napi::Value {
+            relay->stop();
+
+            if (!relay->error.empty()) {
+                Napi::Error::New(info.Env(), "Pipe relay failed: " + relay->error).ThrowAsJavaScriptException();
+                return info.Env().Undefined();
+            }
+
+            auto stats = Napi::Array::New(info.Env(), relay->channels.size());
+            for (uint32_t i = 0; i < relay->channels.size(); i++) {
+                const auto &channel = relay->channels[i];
+                auto channelStats = Napi::Object::New(info.Env());
+                channelStats["bytes"] = (double)channel.bytes;
+                channelStats["writes"] = (double)channel.writes;
+                channelStats["inputWaitTime"] = channel.inputWaitTime / 1e6;
+                channelStats["outputWaitTime"] = channel.outputWaitTime / 1e6;
+                stats[i] = channelStats;
+            }
+
+            auto result = Napi::Object::New(info.Env());
+            result["channels"] = stats;
+            if (relay->transcript.fd != -1) {
+                auto transcript = Napi::Object::New(info.Env());
+                transcript["capturedBytes"] = (double)relay->transcript.capturedBytes;
+                transcript["totalBytes"] = (double)relay->transcript.totalBytes;
+                transcript["omittedLength"] = (double)relay->transcript.omittedLength;
+                result["transcript"] = transcript;
+            }
+
+            return result;
+        });
+
+        return result;
+    }));
+
+    return exports;
+}
+
+NODE_API_MODULE(NODE_MODULE_NAME, Init)
@@ -2,6 +2,9 @@
 #include <unistd.h>
 #include <fcntl.h>
 #include <sys/mman.h>
+#include <sys/file.h>
+
+#include "shm_channel.h"
 
 auto Init(Napi::Env env, Napi::Object exports) {
     exports.Set("pipe", Napi::Function::New(env, [] (const Napi::CallbackInfo &info) {
@@ -18,6 +21,19 @@ auto Init(Napi::Env env, Napi::Object exports) {
         return result;
     }));
 
+    exports.Set("fcntl_set_pipe_size", Napi::Function::New(env, [] (const Napi::CallbackInfo &info) {
+        auto fd = info[0].As<Napi::Number>().Int32Value();
+        auto size = info[1].As<Napi::Number>().Int32Value();
+
+        auto actualSize = fcntl(fd, F_SETPIPE_SZ, size);
+        if (actualSize == -1) {
+            auto err = errno;
+            Napi::Error::New(info.Env(), "fcntl: " + std::system_category().message(err)).ThrowAsJavaScriptException();
+        }
+
+        return Napi::Number::New(info.Env(), actualSize);
+    }));
+
     exports.Set("close", Napi::Function::New(env, [] (const Napi::CallbackInfo &info) {
         return Napi::Number::New(info.Env(), close(info[0].As<Napi::Number>().Int32Value()));
     }));
@@ -45,6 +61,69 @@ auto Init(Napi::Env env, Napi::Object exports) {
         }
     }));
 
+    exports.Set("fcntl_add_seals", Napi::Function::New(env, [] (const Napi::CallbackInfo &info) {
+        auto fd = info[0].As<Napi::Number>().Int32Value();
+        auto seals = info[1].As<Napi::Number>().Int32Value();
+
+        if (fcntl(fd, F_ADD_SEALS, seals) != 0) {
+            auto err = errno;
+            Napi::Error::New(info.Env(), "fcntl: " + std::system_category().message(err)).ThrowAsJavaScriptException();
+        }
+    }));
+
+    // Map the shared memory once on our side to reserve (for hugetlbfs) and optionally populate its pages,
+    // so the sandboxed programs won't pay for the page allocation on first touch.
+    exports.Set("shared_memory_prepare", Napi::Function::New(env, [] (const Napi::CallbackInfo &info) {
+        auto fd = info[0].As<Napi::Number>().Int32Value();
+        auto length = info[1].As<Napi::Number>().Int64Value();
+        auto transparentHugePages = info[2].As<Napi::Boolean>().Value();
+        auto prefault = info[3].As<Napi::Boolean>().Value();
+
+        void *memory = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (memory == MAP_FAILED) {
+            auto err = errno;
+            Napi::Error::New(info.Env(), "mmap: " + std::system_category().message(err)).ThrowAsJavaScriptException();
+            return Napi::Boolean::New(info.Env(), false);
+        }
+
+        // The advice is of this mapping only, which is unmapped below, not the sandboxed programs' mappings. It only
+        // takes effect on the pages allocated (as huge pages in the file) by prefaulting through this mapping.
+        // It's only an advice, so failing to advise (e.g. THP disabled for shmem) isn't an error
+        bool advised = transparentHugePages && prefault && madvise(memory, length, MADV_HUGEPAGE) == 0;
+
+#ifndef MADV_POPULATE_WRITE
+#define MADV_POPULATE_WRITE 23
+#endif
+        std::string error;
+        if (prefault && madvise(memory, length, MADV_POPULATE_WRITE) != 0) {
+            if (errno == EINVAL) {
+                // Kernel older than 5.14, touch each page instead. The memory is still zeroed.
+                auto pageSize = sysconf(_SC_PAGESIZE);
+                for (int64_t offset = 0; offset < length; offset += pageSize)
+                    ((volatile char *)memory)[offset] = 0;
+            } else
+                error = "madvise(MADV_POPULATE_WRITE): " + std::system_category().message(errno);
+        }
+
+        munmap(memory, length);
+
+        if (!error.empty())
+            Napi::Error::New(info.Env(), error).ThrowAsJavaScriptException();
+
+        return Napi::Boolean::New(info.Env(), advised);
+    }));
+
+    auto constants = Napi::Object::New(env);
+    constants["MFD_ALLOW_SEALING"] = MFD_ALLOW_SEALING;
+    constants["MFD_HUGETLB"] = MFD_HUGETLB;
+    constants["F_SEAL_SEAL"] = F_SEAL_SEAL;
+    constants["F_SEAL_SHRINK"] = F_SEAL_SHRINK;
+    constants["F_SEAL_GROW"] = F_SEAL_GROW;
+    constants["LOCK_SH"] = LOCK_SH;
+    constants["LOCK_EX"] = LOCK_EX;
+    constants["LOCK_UN"] = LOCK_UN;
+    exports.Set("constants", constants);
+
     exports.Set("fcntl_set_cloexec", Napi::Function::New(env, [] (const Napi::CallbackInfo &info) {
         auto fd = info[0].As<Napi::Number>().Int32Value();
         auto cloexec = info[1].As<Napi::Boolean>().Value();
@@ -62,6 +141,39 @@ auto Init(Napi::Env env, Napi::Object exports) {
         }
     }));
 
+    exports.Set("shm_channel_initialize", Napi::Function::New(env, [] (const Napi::CallbackInfo &info) {
+        auto fd = info[0].As<Napi::Number>().Int32Value();
+        auto size = info[1].As<Napi::Number>().Int64Value();
+
+        void *memory = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (memory == MAP_FAILED) {
+            auto err = errno;
+            Napi::Error::New(info.Env(), "mmap: " + std::system_category().message(err)).ThrowAsJavaScriptException();
+            return;
+        }
+
+        auto retval = shm_channel_initialize(memory, size);
+        munmap(memory, size);
+
+        if (retval != 0) {
+            Napi::Error::New(info.Env(), "shm_channel_initialize: shared memory too small").ThrowAsJavaScriptException();
+        }
+    }));
+
+    // Never blocks (LOCK_NB is always added), returns false if the lock is held by others
+    exports.Set("flock", Napi::Function::New(env, [] (const Napi::CallbackInfo &info) {
+        auto fd = info[0].As<Napi::Number>().Int32Value();
+        auto operation = info[1].As<Napi::Number>().Int32Value();
+
+        if (flock(fd, operation | LOCK_NB) != 0) {
+            auto err = errno;
+            if (err == EWOULDBLOCK) return Napi::Boolean::New(info.Env(), false);
+            Napi::Error::New(info.Env(), "flock: " + std::system_category().message(err)).ThrowAsJavaScriptException();
+        }
+
+        return Napi::Boolean::New(info.Env(), true);
+    }));
+
     return exports;
 }
 
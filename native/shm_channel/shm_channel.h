@@ -0,0 +1,328 @@
+/*
+ * Lyrio Judge shared memory interaction channel.
+ *
+ * For interaction problems with the "shm-channel" interface, the judge creates a shared memory file
+ * (whose fd is passed in the INTERACTOR_SHARED_MEMORY_FD environment variable) and initializes it with
+ * the layout below before starting the interactor and the user program. It contains two single-producer
+ * single-consumer byte rings:
+ *
+ *   SHM_CHANNEL_USER_TO_INTERACTOR: written by the user program, read by the interactor
+ *   SHM_CHANNEL_INTERACTOR_TO_USER: written by the interactor, read by the user program
+ *
+ * Reading from an empty ring or writing to a full ring spins for a short while and then sleeps on a futex,
+ * so a program waiting for its peer doesn't burn its CPU time. The memory after the rings (the "user area")
+ * is left zeroed for problem-specific use.
+ *
+ * This header works with both C and C++ (GCC or Clang). Example (in the user program):
+ *
+ *   shm_channel *channel = shm_channel_open_from_env();
+ *   shm_channel_write(channel, SHM_CHANNEL_USER_TO_INTERACTOR, &query, sizeof(query));
+ *   shm_channel_read_all(channel, SHM_CHANNEL_INTERACTOR_TO_USER, &answer, sizeof(answer));
+ */
+
+#ifndef _LYRIO_SHM_CHANNEL_H
+#define _LYRIO_SHM_CHANNEL_H
+
+/* For syscall(), only declared with _GNU_SOURCE or _DEFAULT_SOURCE (not with -std=c11 etc.) */
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+#ifdef __cplusplus
+extern "C" {
+#else
+/* In case <unistd.h> was included before this header without _GNU_SOURCE, compatible with glibc's declaration */
+long syscall(long number, ...);
+#endif
+
+#define SHM_CHANNEL_MAGIC 0x4c4e4843444a594cULL /* "LYJDCHNL" in little endian */
+#define SHM_CHANNEL_VERSION 1
+#define SHM_CHANNEL_HEADER_SIZE 4096
+#define SHM_CHANNEL_MAX_CAPACITY (1u << 30)
+
+/* How many times to poll the peer before sleeping on the futex */
+#ifndef SHM_CHANNEL_SPIN_COUNT
+#define SHM_CHANNEL_SPIN_COUNT 256
+#endif
+
+enum shm_channel_direction {
+    SHM_CHANNEL_USER_TO_INTERACTOR = 0,
+    SHM_CHANNEL_INTERACTOR_TO_USER = 1
+};
+
+/*
+ * The `*_waiting` flags are also the futex words the waiters sleep on: set by the waiting side, and cleared by
+ * the other side (or by the waiter itself) when it's woken.
+ */
+typedef struct shm_channel_ring {
+    /* Written by the consumer only, except `producer_waiting` */
+    uint32_t head;             /* Total bytes read, wrapping around 2^32 */
+    uint32_t consumer_waiting; /* Non-zero if the consumer may be sleeping, waiting for `tail` or `closed` */
+    uint8_t padding0[56];
+
+    /* Written by the producer only, except `consumer_waiting` */
+    uint32_t tail;             /* Total bytes written, wrapping around 2^32 */
+    uint32_t producer_waiting; /* Non-zero if the producer may be sleeping, waiting for `head` */
+    uint32_t closed;           /* Non-zero if the producer won't write anymore */
+    uint8_t padding1[52];
+
+    /* Written by the judge only */
+    uint64_t data_offset;      /* Offset of the ring's data from the beginning of the shared memory */
+    uint32_t capacity;         /* Always a power of two */
+    uint8_t padding2[52];
+} shm_channel_ring;
+
+typedef struct shm_channel_header {
+    uint64_t magic;
+    uint32_t version;
+    uint32_t header_size;
+    uint64_t total_size;
+    uint64_t user_area_offset;
+    uint64_t user_area_size;
+    uint8_t padding[24];
+
+    shm_channel_ring rings[2];
+} shm_channel_header;
+
+typedef shm_channel_header shm_channel;
+
+#ifdef __cplusplus
+static_assert(sizeof(shm_channel_ring) == 192, "Unexpected shm_channel_ring layout");
+static_assert(sizeof(shm_channel_header) == 64 + 2 * 192, "Unexpected shm_channel_header layout");
+#else
+_Static_assert(sizeof(shm_channel_ring) == 192, "Unexpected shm_channel_ring layout");
+_Static_assert(sizeof(shm_channel_header) == 64 + 2 * 192, "Unexpected shm_channel_header layout");
+#endif
+
+static inline void shm_channel_cpu_relax(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    __asm__ __volatile__("yield");
+#endif
+}
+
+/* The shared memory is mapped by different processes, so the futexes must NOT be FUTEX_PRIVATE_FLAG */
+static inline void shm_channel_futex_wait(uint32_t *address, uint32_t expected) {
+    syscall(SYS_futex, address, FUTEX_WAIT, expected, NULL, NULL, 0);
+}
+
+static inline void shm_channel_futex_wake(uint32_t *address) {
+    syscall(SYS_futex, address, FUTEX_WAKE, 1, NULL, NULL, 0);
+}
+
+/*
+ * Sleep until `*position != current` (or `*closed` becomes non-zero if `closed` is not NULL).
+ *
+ * The waiter sleeps on `*waiting` instead of `*position`, since closing doesn't change the position. The peer
+ * must change `*position` or `*closed` and then clear `*waiting` to wake us (see shm_channel_wake), so the futex
+ * word has always changed if we missed the wakeup between checking and sleeping.
+ */
+static inline uint32_t shm_channel_wait(uint32_t *position, uint32_t *waiting, uint32_t *closed, uint32_t current) {
+    uint32_t value;
+    int i;
+
+    for (i = 0; i < SHM_CHANNEL_SPIN_COUNT; i++) {
+        value = __atomic_load_n(position, __ATOMIC_ACQUIRE);
+        if (value != current || (closed && __atomic_load_n(closed, __ATOMIC_ACQUIRE))) return value;
+        shm_channel_cpu_relax();
+    }
+
+    for (;;) {
+        __atomic_store_n(waiting, 1, __ATOMIC_SEQ_CST);
+        value = __atomic_load_n(position, __ATOMIC_SEQ_CST);
+        if (value != current || (closed && __atomic_load_n(closed, __ATOMIC_SEQ_CST))) {
+            __atomic_store_n(waiting, 0, __ATOMIC_RELAXED);
+            return value;
+        }
+        shm_channel_futex_wait(waiting, 1);
+    }
+}
+
+/* Wake the peer if it's waiting, after changing what it waits for */
+static inline void shm_channel_wake(uint32_t *waiting) {
+    /* Clear and check in one step, not to clear the flag the peer set again for its next wait */
+    if (__atomic_exchange_n(waiting, 0, __ATOMIC_SEQ_CST)) shm_channel_futex_wake(waiting);
+}
+
+static inline void shm_channel_notify(uint32_t *position, uint32_t *waiting, uint32_t value) {
+    __atomic_store_n(position, value, __ATOMIC_SEQ_CST);
+    shm_channel_wake(waiting);
+}
+
+/*
+ * Initialize the layout of a zeroed shared memory of `size` bytes. Called by the judge.
+ *
+ * Returns 0 on success, -1 if the size is too small.
+ */
+static inline int shm_channel_initialize(void *memory, uint64_t size) {
+    shm_channel_header *header = (shm_channel_header *)memory;
+    uint64_t available, capacity;
+    int i;
+
+    if (size < SHM_CHANNEL_HEADER_SIZE + 2 * 4096) return -1;
+
+    available = (size - SHM_CHANNEL_HEADER_SIZE) / 2;
+    capacity = SHM_CHANNEL_MAX_CAPACITY;
+    while (capacity > available) capacity >>= 1;
+
+    memset(header, 0, sizeof(shm_channel_header));
+    header->version = SHM_CHANNEL_VERSION;
+    header->header_size = SHM_CHANNEL_HEADER_SIZE;
+    header->total_size = size;
+    for (i = 0; i < 2; i++) {
+        header->rings[i].data_offset = SHM_CHANNEL_HEADER_SIZE + i * capacity;
+        header->rings[i].capacity = (uint32_t)capacity;
+    }
+    header->user_area_offset = SHM_CHANNEL_HEADER_SIZE + 2 * capacity;
+    header->user_area_size = size - header->user_area_offset;
+
+    /* Publish the magic number at last */
+    __atomic_store_n(&header->magic, SHM_CHANNEL_MAGIC, __ATOMIC_RELEASE);
+    return 0;
+}
+
+/*
+ * Check the layout of a mapped shared memory.
+ *
+ * Returns NULL if it's not an initialized channel of the supported version.
+ */
+static inline shm_channel *shm_channel_attach(void *memory, uint64_t size) {
+    shm_channel_header *header = (shm_channel_header *)memory;
+    if (size < sizeof(shm_channel_header)) return NULL;
+    if (__atomic_load_n(&header->magic, __ATOMIC_ACQUIRE) != SHM_CHANNEL_MAGIC) return NULL;
+    if (header->version != SHM_CHANNEL_VERSION || header->total_size != size) return NULL;
+    return header;
+}
+
+/*
+ * Map the shared memory passed by the judge with INTERACTOR_SHARED_MEMORY_FD.
+ *
+ * Returns NULL on failure.
+ */
+static inline shm_channel *shm_channel_open_from_env(void) {
+    const char *fdString = getenv("INTERACTOR_SHARED_MEMORY_FD");
+    struct stat status;
+    void *memory;
+    int fd;
+
+    if (!fdString) return NULL;
+    fd = atoi(fdString);
+    if (fd < 0 || fstat(fd, &status) != 0) return NULL;
+
+    memory = mmap(NULL, (size_t)status.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (memory == MAP_FAILED) return NULL;
+
+    return shm_channel_attach(memory, (uint64_t)status.st_size);
+}
+
+static inline void *shm_channel_user_area(shm_channel *channel) {
+    return (uint8_t *)channel + channel->user_area_offset;
+}
+
+/*
+ * Write all `length` bytes to the ring, blocking while it's full.
+ */
+static inline void shm_channel_write(shm_channel *channel, int direction, const void *data, size_t length) {
+    shm_channel_ring *ring = &channel->rings[direction];
+    uint8_t *buffer = (uint8_t *)channel + ring->data_offset;
+    const uint8_t *source = (const uint8_t *)data;
+    uint32_t mask = ring->capacity - 1;
+    uint32_t tail = __atomic_load_n(&ring->tail, __ATOMIC_RELAXED);
+
+    while (length > 0) {
+        uint32_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+        uint32_t space, chunk, offset, first;
+
+        while ((space = ring->capacity - (tail - head)) == 0)
+            head = shm_channel_wait(&ring->head, &ring->producer_waiting, NULL, head);
+
+        chunk = length < space ? (uint32_t)length : space;
+        offset = tail & mask;
+        first = chunk < ring->capacity - offset ? chunk : ring->capacity - offset;
+        memcpy(buffer + offset, source, first);
+        memcpy(buffer, source + first, chunk - first);
+
+        tail += chunk;
+        source += chunk;
+        length -= chunk;
+        shm_channel_notify(&ring->tail, &ring->consumer_waiting, tail);
+    }
+}
+
+/*
+ * Read at most `length` bytes from the ring, blocking while it's empty.
+ *
+ * Returns the number of bytes read, which is 0 only if the ring is closed and drained.
+ */
+static inline size_t shm_channel_read(shm_channel *channel, int direction, void *data, size_t length) {
+    shm_channel_ring *ring = &channel->rings[direction];
+    const uint8_t *buffer = (const uint8_t *)channel + ring->data_offset;
+    uint8_t *destination = (uint8_t *)data;
+    uint32_t mask = ring->capacity - 1;
+    uint32_t head = __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
+    uint32_t tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+    uint32_t available, chunk, offset, first;
+
+    if (length == 0) return 0;
+
+    while (tail == head) {
+        if (__atomic_load_n(&ring->closed, __ATOMIC_ACQUIRE)) {
+            /* Data may be written just before closing */
+            tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+            if (tail == head) return 0;
+            break;
+        }
+        tail = shm_channel_wait(&ring->tail, &ring->consumer_waiting, &ring->closed, head);
+    }
+
+    available = tail - head;
+    chunk = length < available ? (uint32_t)length : available;
+    offset = head & mask;
+    first = chunk < ring->capacity - offset ? chunk : ring->capacity - offset;
+    memcpy(destination, buffer + offset, first);
+    memcpy(destination + first, buffer, chunk - first);
+
+    shm_channel_notify(&ring->head, &ring->producer_waiting, head + chunk);
+    return chunk;
+}
+
+/*
+ * Read exactly `length` bytes from the ring.
+ *
+ * Returns the number of bytes read, which is less than `length` only if the ring is closed.
+ */
+static inline size_t shm_channel_read_all(shm_channel *channel, int direction, void *data, size_t length) {
+    size_t total = 0, size;
+    while (total < length) {
+        size = shm_channel_read(channel, direction, (uint8_t *)data + total, length - total);
+        if (size == 0) break;
+        total += size;
+    }
+    return total;
+}
+
+/*
+ * Mark the ring as closed by its producer. The consumer reads 0 bytes after draining it.
+ */
+static inline void shm_channel_close(shm_channel *channel, int direction) {
+    shm_channel_ring *ring = &channel->rings[direction];
+    __atomic_store_n(&ring->closed, 1, __ATOMIC_SEQ_CST);
+    shm_channel_wake(&ring->consumer_waiting);
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _LYRIO_SHM_CHANNEL_H */
@@ -0,0 +1,57 @@
+import java.io.*;
+import java.math.*;
+import java.util.*;
+import java.util.stream.*;
+
+// Loads the classes commonly used by Java and Kotlin programs, to dump them into the class data sharing archive
+// Reads "1 2\n3.5\n4 hello\n" from stdin
+public class Training {
+    public static void main(String[] args) throws IOException {
+        BufferedReader reader = new BufferedReader(new InputStreamReader(System.in));
+        StringTokenizer tokenizer = new StringTokenizer(reader.readLine());
+        long a = Long.parseLong(tokenizer.nextToken()), b = Integer.parseInt(tokenizer.nextToken());
+
+        StreamTokenizer streamTokenizer = new StreamTokenizer(new StringReader(reader.readLine()));
+        streamTokenizer.nextToken();
+        double c = streamTokenizer.nval;
+
+        Scanner scanner = new Scanner(reader);
+        int d = scanner.nextInt();
+        String e = scanner.next();
+
+        int[] array = { 3, 1, 2 };
+        Arrays.sort(array);
+        Integer[] boxed = { 3, 1, 2 };
+        Arrays.sort(boxed, (x, y) -> y - x);
+        List<Integer> list = new ArrayList<>(Arrays.asList(boxed));
+        Collections.sort(list, Comparator.reverseOrder());
+        List<Integer> linkedList = new LinkedList<>(list);
+        Map<String, Integer> hashMap = new HashMap<>();
+        hashMap.put(e, d);
+        hashMap.merge(e, 1, Integer::sum);
+        TreeMap<Integer, Integer> treeMap = new TreeMap<>();
+        treeMap.put(d, d);
+        Set<Integer> hashSet = new HashSet<>(list);
+        TreeSet<Integer> treeSet = new TreeSet<>(list);
+        Deque<Integer> deque = new ArrayDeque<>(list);
+        PriorityQueue<Long> queue = new PriorityQueue<>(Collections.reverseOrder());
+        queue.add(a);
+        BitSet bitSet = new BitSet();
+        bitSet.set(d);
+
+        BigInteger bigInteger = BigInteger.valueOf(a).multiply(BigInteger.valueOf(b)).pow(10).mod(BigInteger.TEN);
+        BigDecimal bigDecimal = new BigDecimal(c).setScale(2, RoundingMode.HALF_UP);
+        long sum = IntStream.of(array).sum() + list.stream().mapToInt(Integer::intValue).sum();
+        String joined = list.stream().map(String::valueOf).collect(Collectors.joining(" "));
+
+        PrintWriter writer = new PrintWriter(new BufferedWriter(new OutputStreamWriter(System.out)));
+        StringBuilder builder = new StringBuilder();
+        builder.append(a + b).append(' ').append(Math.max(c, Math.sqrt(d))).append('\n');
+        writer.print(builder);
+        writer.println(String.format("%d %.3f %s", sum, bigDecimal.doubleValue(), bigInteger));
+        writer.printf("%s %d %d %d %d %d %d %d%n", joined, linkedList.size(), hashMap.get(e), treeMap.firstKey(),
+                hashSet.size(), treeSet.last(), deque.peekFirst(), queue.peek() + bitSet.cardinality());
+        writer.flush();
+        System.out.println(Objects.hash(a, b));
+    }
+}
@@ -3,6 +3,8 @@
 
 CONFIG_FILE="$(dirname "${BASH_SOURCE[0]}")/config.json"
 RENAMEAT2_SOURCE_FILE="$(dirname "${BASH_SOURCE[0]}")/renameat2.c"
+SHM_CHANNEL_HEADER_FILE="$(dirname "${BASH_SOURCE[0]}")/../native/shm_channel/shm_channel.h"
+JAVA_TRAINING_SOURCE_FILE="$(dirname "${BASH_SOURCE[0]}")/Training.java"
 
 if ! [ -f "$CONFIG_FILE" ]; then
     echo "Configuration file $CONFIG_FILE not found"
@@ -39,6 +41,58 @@ callGitHubApi "actions/artifacts/$LATEST_ARTIFACT_ID/zip" -L | zcat > "$EXTRACT_
 # Extract tar
 tar -xJf "$EXTRACT_DIR/rootfs.tar.xz" -C "$EXTRACT_DIR"
 rm -rf "$ROOTFS_OLD_DIR"
+
+# Install the shared memory channel header for interactors and user programs
+install -D -m 644 "$SHM_CHANNEL_HEADER_FILE" "$EXTRACT_DIR/rootfs/usr/local/include/lyrio/shm_channel.h"
+
+# Dump a class data sharing archive of the JDK's default classes and the ones loaded by Training.java, which the
+# Java and Kotlin programs are run with (see src/languages/jvm.ts). The archive has no application classes so it
+# works with any classpath
+function dumpJavaArchive() {
+    ROOTFS="$1"
+    mkdir -p "$ROOTFS/tmp/java-training"
+    cp "$JAVA_TRAINING_SOURCE_FILE" "$ROOTFS/tmp/java-training/Training.java"
+    mount -t proc proc "$ROOTFS/proc"
+    chroot "$ROOTFS" /bin/bash -e -c '
+        cd /tmp/java-training
+        javac Training.java
+        printf "1 2\n3.5\n4 hello\n" | java -XX:DumpLoadedClassList=loaded.txt -cp . Training > /dev/null
+        JAVA_HOME="$(dirname "$(dirname "$(readlink -f "$(command -v java)")")")"
+        cat "$JAVA_HOME/lib/classlist" loaded.txt | grep -v "Training" | awk "!seen[\$0]++" > classlist.txt
+        mkdir -p /usr/local/lib/lyrio
+        java -Xshare:dump -XX:SharedClassListFile=classlist.txt -XX:SharedArchiveFile=/usr/local/lib/lyrio/java-base.jsa
+        chmod 644 /usr/local/lib/lyrio/java-base.jsa
+    '
+    EXIT_CODE=$?
+    umount "$ROOTFS/proc"
+    rm -rf "$ROOTFS/tmp/java-training"
+    return $EXIT_CODE
+}
+if [ -x "$EXTRACT_DIR/rootfs/usr/bin/javac" ]; then
+    dumpJavaArchive "$EXTRACT_DIR/rootfs" || echo "Failed to dump the class data sharing archive of Java, skipping"
+fi
+
+# Compile the framework assemblies used by most C# and F# programs ahead of time, mono loads the images
+# ("<assembly>.so" next to the assembly, so the real file of a GAC symlink) instead of JIT-compiling them in each run
+function compileMonoAssemblies() {
+    ROOTFS="$1"
+    mount -t proc proc "$ROOTFS/proc"
+    chroot "$ROOTFS" /bin/bash -e -c '
+        for ASSEMBLY in /usr/lib/mono/4.5/mscorlib.dll /usr/lib/mono/4.5/System.dll /usr/lib/mono/4.5/System.Core.dll \
+                        /usr/lib/mono/fsharp/FSharp.Core.dll; do
+            if [ -f "$ASSEMBLY" ]; then
+                mono --aot -O=all "$(readlink -f "$ASSEMBLY")" > /dev/null
+            fi
+        done
+    '
+    EXIT_CODE=$?
+    umount "$ROOTFS/proc"
+    return $EXIT_CODE
+}
+if [ -x "$EXTRACT_DIR/rootfs/usr/bin/mono" ]; then
+    compileMonoAssemblies "$EXTRACT_DIR/rootfs" || echo "Failed to compile the mono assemblies ahead of time, skipping"
+fi
+
 mkdir -p "$ROOTFS_DIR" "$ROOTFS_OLD_DIR"
 
 # Rename file atomically
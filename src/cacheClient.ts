@@ -0,0 +1,128 @@
+import net from "net";
+
+import winston from "winston";
+
+import config from "./config";
+import { OmittableString } from "./omittableString";
+
+/**
+ * The client of the cache daemon (see cacheDaemon.ts), with `config.cacheDaemon`. It's connected on the first
+ * request, and reconnected on the next request after the connection is lost (the pending requests fail, and the
+ * leases of the compile results still in use are renewed).
+ */
+
+export interface SharedCompileResult {
+  success: boolean;
+  message: OmittableString;
+  // The others are only for a successful compile result
+  binaryDirectory?: string;
+  binaryDirectorySize?: number;
+  extraInfo?: string;
+}
+
+// The index file written beside a shared compile result's directory (`${binaryDirectory}.json`) before publishing it
+export interface SharedCompileResultIndex {
+  compileTaskHash: string;
+  result: SharedCompileResult;
+}
+
+// The response to "claimCompileResult": the result with a lease if cached, or `compile` if the caller should compile
+// and then call "publishCompileResult" (or "abandonCompileResult")
+export interface ClaimCompileResultResponse {
+  result?: SharedCompileResult;
+  lease?: number;
+  compile?: boolean;
+}
+
+let socket: net.Socket = null;
+let lastRequestId = 0;
+const pendingRequests: Map<number, { resolve: (result: unknown) => void; reject: (error: Error) => void }> =
+  new Map();
+
+function connect() {
+  const newSocket = net.createConnection(config.cacheDaemon.socket);
+
+  let buffer = "";
+  newSocket.setEncoding("utf-8");
+  newSocket.on("data", (data: string) => {
+    const lines = (buffer + data).split("\n");
+    buffer = lines.pop();
+    for (const line of lines) {
+      const { id, result, error } = JSON.parse(line);
+      const request = pendingRequests.get(id);
+      if (!request) continue;
+
+      pendingRequests.delete(id);
+      if (error) request.reject(new Error(`Cache daemon: ${error}`));
+      else request.resolve(result);
+    }
+  });
+
+  newSocket.on("error", e => winston.error(`Cache daemon connection error: ${e}`));
+  newSocket.on("close", () => {
+    if (socket === newSocket) socket = null;
+    for (const request of pendingRequests.values()) request.reject(new Error("Lost connection to the cache daemon"));
+    pendingRequests.clear();
+  });
+
+  // Don't keep the process alive for it
+  newSocket.unref();
+  return newSocket;
+}
+
+interface HeldLease {
+  compileTaskHash: string;
+  binaryDirectory: string;
+  // The lease is only valid on the connection it's got from, `null` while renewing
+  lease: number;
+  socket: net.Socket;
+}
+
+const heldLeases: Set<HeldLease> = new Set();
+
+function renewLeases() {
+  for (const held of heldLeases) {
+    held.lease = null;
+    held.socket = socket;
+    requestCacheDaemon<{ lease?: number }>("renewCompileResultLease", {
+      compileTaskHash: held.compileTaskHash,
+      binaryDirectory: held.binaryDirectory
+    }).then(
+      ({ lease }) => {
+        if (lease == null) winston.warn(`Couldn't renew the lease of compile result ${held.compileTaskHash}`);
+        else if (!heldLeases.has(held)) requestCacheDaemon("releaseCompileResult", { lease }).catch(() => {});
+        else held.lease = lease;
+      },
+      e => winston.error(`Failed to renew the lease of compile result ${held.compileTaskHash}: ${e.message}`)
+    );
+  }
+}
+
+/**
+ * Track a leased compile result while it's in use, so its lease is renewed after reconnecting. Return the function
+ * to release it.
+ */
+export function holdCompileResultLease(compileTaskHash: string, binaryDirectory: string, lease: number) {
+  const held: HeldLease = { compileTaskHash, binaryDirectory, lease, socket };
+  heldLeases.add(held);
+
+  return async () => {
+    heldLeases.delete(held);
+    // The leases of a lost connection are released by the daemon, and the ones being renewed are released after it
+    if (held.socket !== socket || held.lease == null) return;
+    await requestCacheDaemon<void>("releaseCompileResult", { lease: held.lease });
+  };
+}
+
+export function requestCacheDaemon<T>(method: string, params: unknown): Promise<T> {
+  if (!socket) {
+    socket = connect();
+    renewLeases();
+  }
+
+  const id = ++lastRequestId;
+  return new Promise<T>((resolve, reject) => {
+    pendingRequests.set(id, { resolve, reject });
+    socket.write(`${JSON.stringify({ id, method, params })}\n`);
+  });
+}
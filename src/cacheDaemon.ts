@@ -0,0 +1,299 @@
+import fs from "fs";
+import net from "net";
+import crypto from "crypto";
+
+import LRUCache from "lru-cache";
+import winston from "winston";
+
+import config, { removeStaleBinaryCacheScratchStores } from "./config";
+import * as fsNative from "./fsNative";
+import { safelyJoinPath } from "./utils";
+import { ClaimCompileResultResponse, SharedCompileResult, SharedCompileResultIndex } from "./cacheClient";
+
+/**
+ * A daemon shared by the judge processes on the same host (with `config.cacheDaemon`), so a large machine could run
+ * many judge processes without each of them hashing the same testdata and compiling the same code. The testdata
+ * store is shared with file locks instead (see file.ts).
+ *
+ * It keeps the index of the testdata files' hashes, and the compile results in the shared `binaryCacheStore`. The
+ * compile result of a code is claimed by the first process needing it, the others wait for it. The cached results
+ * are leased to the processes using them, so they're not removed until released. The leases and claims of a
+ * process are released when it disconnects, and the leases are renewed when it reconnects.
+ *
+ * Each compile result has an index file beside it, so a restarted daemon adopts the results in the store instead of
+ * removing them, since the running processes may still be using them.
+ *
+ * The protocol is newline-delimited JSON on a Unix socket, `{ id, method, params }` for a request and
+ * `{ id, result }` or `{ id, error }` for its response, see cacheClient.ts.
+ */
+
+interface Connection {
+  socket: net.Socket;
+  leases: Set<number>;
+  claims: Set<string>;
+}
+
+interface CacheEntry {
+  result: SharedCompileResult;
+  leases: number;
+  evicted: boolean;
+}
+
+type Waiter = (response: ClaimCompileResultResponse) => void;
+
+const fileHashes = new LRUCache<string, Promise<string>>({ max: 1024 * 1024 });
+
+function hashFile(fileUuid: string) {
+  if (!fileHashes.has(fileUuid)) {
+    const promise = new Promise<string>((resolve, reject) => {
+      const hash = crypto.createHash("sha256");
+      const file = fs.createReadStream(safelyJoinPath(config.dataStore, fileUuid));
+      file.pipe(hash);
+      file.on("error", reject);
+      hash.on("error", reject);
+      hash.on("finish", () => resolve(hash.digest("hex")));
+    });
+    // Don't cache a failure, e.g. the file is not downloaded yet
+    promise.catch(() => fileHashes.delete(fileUuid));
+    fileHashes.set(fileUuid, promise);
+  }
+
+  return fileHashes.get(fileUuid);
+}
+
+function removeCompileResultFiles(binaryDirectory: string) {
+  return Promise.all([fsNative.remove(binaryDirectory), fsNative.remove(`${binaryDirectory}.json`)]);
+}
+
+function removeEntry(compileTaskHash: string, entry: CacheEntry) {
+  removeCompileResultFiles(entry.result.binaryDirectory).catch(e =>
+    winston.error(`Failed to remove compile result ${compileTaskHash}: ${e.stack}`)
+  );
+}
+
+const compileResults = new LRUCache<string, CacheEntry>({
+  maxSize: config.binaryCacheMaxSize,
+  sizeCalculation: entry => entry.result.binaryDirectorySize || 1,
+  dispose: (entry, compileTaskHash) => {
+    entry.evicted = true;
+    if (entry.leases === 0) removeEntry(compileTaskHash, entry);
+  }
+});
+
+interface Claim {
+  connection: Connection;
+  waiters: { connection: Connection; waiter: Waiter }[];
+}
+
+// The compile results being compiled by a process, and the processes waiting for them
+const claimedCompileResults: Map<string, Claim> = new Map();
+
+let lastLease = 0;
+const leases: Map<number, { compileTaskHash: string; entry: CacheEntry }> = new Map();
+
+function lease(connection: Connection, compileTaskHash: string, entry: CacheEntry) {
+  const id = ++lastLease;
+  entry.leases++;
+  leases.set(id, { compileTaskHash, entry });
+  connection.leases.add(id);
+  return id;
+}
+
+function release(connection: Connection, id: number) {
+  const leased = leases.get(id);
+  if (!leased || !connection.leases.delete(id)) return;
+
+  leases.delete(id);
+  if (--leased.entry.leases === 0 && leased.entry.evicted) removeEntry(leased.compileTaskHash, leased.entry);
+}
+
+function respondCached(connection: Connection, compileTaskHash: string, entry: CacheEntry): ClaimCompileResultResponse {
+  return { result: entry.result, lease: lease(connection, compileTaskHash, entry) };
+}
+
+// Hand the claim of a compile result to the first waiter, if its compiler disconnected or failed unexpectedly
+function abandonClaim(compileTaskHash: string) {
+  const claim = claimedCompileResults.get(compileTaskHash);
+  if (!claim) return;
+
+  claim.connection.claims.delete(compileTaskHash);
+  const next = claim.waiters.shift();
+  if (!next) {
+    claimedCompileResults.delete(compileTaskHash);
+    return;
+  }
+
+  claim.connection = next.connection;
+  next.connection.claims.add(compileTaskHash);
+  next.waiter({ compile: true });
+}
+
+const methods: Record<string, (connection: Connection, params: any) => Promise<unknown> | unknown> = {
+  getFileHash: async (connection, { fileUuid }: { fileUuid: string }) => hashFile(fileUuid),
+
+  claimCompileResult: (connection, { compileTaskHash }: { compileTaskHash: string }) => {
+    const entry = compileResults.get(compileTaskHash);
+    if (entry) return respondCached(connection, compileTaskHash, entry);
+
+    const claim = claimedCompileResults.get(compileTaskHash);
+    if (!claim) {
+      claimedCompileResults.set(compileTaskHash, { connection, waiters: [] });
+      connection.claims.add(compileTaskHash);
+      return { compile: true };
+    }
+
+    return new Promise<ClaimCompileResultResponse>(resolve => claim.waiters.push({ connection, waiter: resolve }));
+  },
+
+  publishCompileResult: (
+    connection,
+    { compileTaskHash, result }: { compileTaskHash: string; result: SharedCompileResult }
+  ) => {
+    // The claim could be abandoned and handed to another process, which will publish its result too
+    const claim = claimedCompileResults.get(compileTaskHash);
+    const waiters = claim?.connection === connection ? claim.waiters : [];
+    if (claim?.connection === connection) {
+      claimedCompileResults.delete(compileTaskHash);
+      connection.claims.delete(compileTaskHash);
+    }
+
+    if (!result.success) {
+      // A failed result is not cached, but shared with the ones waiting for it
+      for (const { waiter } of waiters) waiter({ result });
+      return {};
+    }
+
+    let entry = compileResults.get(compileTaskHash);
+    if (entry) {
+      // Already published by the process the claim was handed to, use the existing one
+      removeCompileResultFiles(result.binaryDirectory).catch(() => {});
+    } else {
+      entry = { result, leases: 0, evicted: false };
+      compileResults.set(compileTaskHash, entry);
+    }
+
+    for (const waiting of waiters) waiting.waiter(respondCached(waiting.connection, compileTaskHash, entry));
+    return respondCached(connection, compileTaskHash, entry);
+  },
+
+  abandonCompileResult: (connection, { compileTaskHash }: { compileTaskHash: string }) => {
+    if (claimedCompileResults.get(compileTaskHash)?.connection === connection) abandonClaim(compileTaskHash);
+    return {};
+  },
+
+  releaseCompileResult: (connection, { lease: id }: { lease: number }) => {
+    release(connection, id);
+    return {};
+  },
+
+  // Lease a result again after reconnecting, since the leases of the lost connection (or of a stopped daemon) are gone
+  renewCompileResultLease: (
+    connection,
+    { compileTaskHash, binaryDirectory }: { compileTaskHash: string; binaryDirectory: string }
+  ) => {
+    const entry = compileResults.get(compileTaskHash);
+    if (entry?.result.binaryDirectory !== binaryDirectory) return {};
+    return { lease: lease(connection, compileTaskHash, entry) };
+  }
+};
+
+/**
+ * Adopt the compile results published before the daemon (re)started, and remove the stale files in the binary
+ * cache store, i.e. an index without its result or a result whose index is not written (not published).
+ */
+function recoverCompileResults() {
+  removeStaleBinaryCacheScratchStores();
+
+  const filenames = new Set(fs.readdirSync(config.binaryCacheStore));
+  for (const filename of filenames) {
+    if (filename.startsWith("process-")) continue;
+
+    const path = safelyJoinPath(config.binaryCacheStore, filename);
+    if (filename.endsWith(".json")) {
+      let index: SharedCompileResultIndex = null;
+      try {
+        index = JSON.parse(fs.readFileSync(path, "utf-8"));
+      } catch (e) {
+        winston.warn(`Removing the broken compile result index ${filename}: ${e.message}`);
+      }
+
+      const binaryDirectory = filename.slice(0, -".json".length);
+      const valid =
+        filenames.has(binaryDirectory) &&
+        index?.result.binaryDirectory === safelyJoinPath(config.binaryCacheStore, binaryDirectory);
+      if (valid) compileResults.set(index.compileTaskHash, { result: index.result, leases: 0, evicted: false });
+      else fsNative.removeSync(path);
+    } else if (!filenames.has(`${filename}.json`)) fsNative.removeSync(path);
+  }
+
+  if (compileResults.size > 0) winston.info(`Cache daemon adopted ${compileResults.size} compile results in the store`);
+}
+
+function onConnection(socket: net.Socket) {
+  const connection: Connection = { socket, leases: new Set(), claims: new Set() };
+
+  const send = (message: unknown) => {
+    if (!socket.destroyed) socket.write(`${JSON.stringify(message)}\n`);
+  };
+
+  let buffer = "";
+  socket.setEncoding("utf-8");
+  socket.on("data", (data: string) => {
+    const lines = (buffer + data).split("\n");
+    buffer = lines.pop();
+    for (const line of lines) {
+      let request: { id: number; method: string; params: unknown };
+      try {
+        request = JSON.parse(line);
+      } catch (e) {
+        // Not a client of this protocol (or a broken one), don't let it affect the others
+        winston.warn(`Cache daemon received a malformed request, closing the connection: ${e.message}`);
+        send({ id: null, error: `Malformed request: ${e.message}` });
+        socket.end();
+        socket.removeAllListeners("data");
+        return;
+      }
+
+      const { id, method, params } = request;
+      Promise.resolve()
+        .then(() => {
+          if (!(method in methods)) throw new Error(`Unknown method ${method}`);
+          return methods[method](connection, params);
+        })
+        .then(
+          result => send({ id, result }),
+          e => send({ id, error: String(e.message || e) })
+        );
+    }
+  });
+
+  socket.on("error", e => winston.verbose(`Cache daemon connection error: ${e}`));
+  socket.on("close", () => {
+    for (const id of connection.leases) release(connection, id);
+    for (const compileTaskHash of connection.claims) abandonClaim(compileTaskHash);
+    for (const claim of claimedCompileResults.values())
+      claim.waiters = claim.waiters.filter(waiting => waiting.connection !== connection);
+  });
+}
+
+export function startCacheDaemon() {
+  if (!config.cacheDaemon) {
+    winston.error("Please specify config.cacheDaemon.socket to start the cache daemon");
+    process.exit(1);
+  }
+
+  recoverCompileResults();
+
+  // A stale socket of a previous daemon
+  if (fs.existsSync(config.cacheDaemon.socket)) fs.unlinkSync(config.cacheDaemon.socket);
+
+  const server = net.createServer(onConnection);
+  server.on("error", e => {
+    winston.error(`Cache daemon error: ${e.stack}`);
+    process.exit(1);
+  });
+  server.listen(config.cacheDaemon.socket, () => {
+    fs.chmodSync(config.cacheDaemon.socket, 0o600);
+    winston.info(`Cache daemon listening on ${config.cacheDaemon.socket}`);
+  });
+}
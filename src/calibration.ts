@@ -0,0 +1,236 @@
+import fs from "fs";
+
+import { SandboxStatus } from "simple-sandbox";
+import objectHash from "object-hash";
+import winston from "winston";
+
+import config from "./config";
+import getLanguage from "./languages";
+import { compile, CompileResultSuccess } from "./compile";
+import { runTaskQueued } from "./taskQueue";
+import { runSandbox, CpuAffinityStrategy, SANDBOX_INSIDE_PATH_BINARY, SANDBOX_INSIDE_PATH_WORKING } from "./sandbox";
+import { safelyJoinPath } from "./utils";
+
+/**
+ * The fixed cost of each run of the languages (e.g. starting the JVM, mono or the Python interpreter, or loading
+ * the shared libraries of Haskell with `-dynamic`) on this node, measured with `config.calibration` by compiling and
+ * running an empty program of each language and compile options. It's reported in `systemInfo.languages`.
+ *
+ * It's calibrated before consuming tasks, and again on demand by sending SIGHUP to the judge process (in parallel
+ * with the tasks, so it's less accurate).
+ */
+
+export interface LanguageStartupCost {
+  compileAndRunOptions: unknown;
+  // The median CPU time of the empty run, in ms
+  time: number;
+  // The median peak memory of the empty run, in KiB
+  memory: number;
+}
+
+interface CalibrationProgram {
+  code: string;
+  // The compile and run options making a difference to the startup cost
+  compileAndRunOptions: unknown[];
+}
+
+const CALIBRATION_PROGRAMS: Record<string, CalibrationProgram> = {
+  cpp: {
+    code: "int main() {}\n",
+    compileAndRunOptions: [
+      { compiler: "g++", std: "c++17", O: "2", m: "64" },
+      { compiler: "clang++", std: "c++17", O: "2", m: "64" }
+    ]
+  },
+  c: {
+    code: "int main() { return 0; }\n",
+    compileAndRunOptions: [
+      { compiler: "gcc", std: "c11", O: "2", m: "64" },
+      { compiler: "clang", std: "c11", O: "2", m: "64" }
+    ]
+  },
+  java: {
+    code: "public class Main {\n    public static void main(String[] args) {}\n}\n",
+    compileAndRunOptions: [{}]
+  },
+  kotlin: {
+    code: "fun main() {}\n",
+    compileAndRunOptions: [{ version: "1.5", platform: "jvm" }]
+  },
+  pascal: {
+    code: "begin\nend.\n",
+    compileAndRunOptions: [{ optimize: "2" }]
+  },
+  python: {
+    code: "pass\n",
+    compileAndRunOptions: [{ version: "2.7" }, { version: "3.9" }]
+  },
+  rust: {
+    code: "fn main() {}\n",
+    compileAndRunOptions: [{ version: "2018", optimize: "2" }]
+  },
+  swift: {
+    code: "\n",
+    compileAndRunOptions: [{ version: "5", optimize: "O" }]
+  },
+  go: {
+    code: "package main\n\nfunc main() {}\n",
+    compileAndRunOptions: [{ version: "1.x" }]
+  },
+  haskell: {
+    code: "main :: IO ()\nmain = return ()\n",
+    compileAndRunOptions: [{ version: "2010" }]
+  },
+  csharp: {
+    code: "public class Program {\n    public static void Main() {}\n}\n",
+    compileAndRunOptions: [{ version: "9" }]
+  },
+  fsharp: {
+    code: "()\n",
+    compileAndRunOptions: [{}]
+  }
+};
+
+// languageName => the calibrated compile and run options, the failed ones are omitted
+let startupCosts: Record<string, LanguageStartupCost[]> = {};
+
+function median(values: number[]) {
+  const sorted = [...values].sort((a, b) => a - b);
+  return sorted[Math.floor(sorted.length / 2)];
+}
+
+async function measureStartupCost(language: string, compileAndRunOptions: unknown): Promise<LanguageStartupCost> {
+  const compileResult = await compile({ language, code: CALIBRATION_PROGRAMS[language].code, compileAndRunOptions });
+  if (!compileResult.success) throw new Error(`Compilation failed: ${JSON.stringify(compileResult.message)}`);
+  const binary = compileResult as CompileResultSuccess;
+
+  const times: number[] = [];
+  const memories: number[] = [];
+  try {
+    for (let i = 0; i < (config.calibration.runs || 5); i++) {
+      await runTaskQueued(async taskWorkingDirectory => {
+        const workingDirectory = {
+          outside: safelyJoinPath(taskWorkingDirectory, "working"),
+          inside: SANDBOX_INSIDE_PATH_WORKING
+        };
+        const tempDirectoryOutside = safelyJoinPath(taskWorkingDirectory, "temp");
+        await Promise.all([fs.promises.mkdir(workingDirectory.outside), fs.promises.mkdir(tempDirectoryOutside)]);
+
+        const sandboxResult = await runSandbox(null, {
+          ...getLanguage(language).run({
+            binaryDirectoryInside: SANDBOX_INSIDE_PATH_BINARY,
+            workingDirectoryInside: workingDirectory.inside,
+            compileAndRunOptions,
+            time: 10000,
+            memory: 1024,
+            stdoutFile: `${workingDirectory.inside}/output`,
+            stderrFile: `${workingDirectory.inside}/error`,
+            parameters: [],
+            compileResultExtraInfo: binary.extraInfo
+          }),
+          time: 10000,
+          memory: 1024 * 1024 * 1024,
+          workingDirectory: workingDirectory.inside,
+          tempDirectoryOutside,
+          extraMounts: [
+            { mappedPath: { outside: binary.binaryDirectory, inside: SANDBOX_INSIDE_PATH_BINARY }, readOnly: true },
+            { mappedPath: workingDirectory, readOnly: false }
+          ],
+          cpuAffinity: CpuAffinityStrategy.UserProgram
+        });
+        if (sandboxResult.status !== SandboxStatus.OK) {
+          throw new Error(`${SandboxStatus[sandboxResult.status]} (code = ${sandboxResult.code})`);
+        }
+
+        times.push(sandboxResult.time / 1e6);
+        memories.push(sandboxResult.memory / 1024);
+      });
+    }
+  } finally {
+    await binary.dereference();
+  }
+
+  return { compileAndRunOptions, time: median(times), memory: median(memories) };
+}
+
+/**
+ * Measure the startup cost of each language and compile options one by one, and replace the reported ones.
+ */
+export async function calibrateLanguages() {
+  winston.info("Calibrating the startup cost of the languages");
+
+  const result: Record<string, LanguageStartupCost[]> = {};
+  for (const language of config.calibration.languages || Object.keys(CALIBRATION_PROGRAMS)) {
+    if (!CALIBRATION_PROGRAMS[language]) {
+      winston.warn(`No calibration program for language ${language}, skipping`);
+      continue;
+    }
+
+    const optionsList = [
+      ...CALIBRATION_PROGRAMS[language].compileAndRunOptions,
+      ...(config.calibration.compileAndRunOptions?.[language] || [])
+    ];
+    for (const compileAndRunOptions of optionsList) {
+      try {
+        const startupCost = await measureStartupCost(language, compileAndRunOptions);
+        if (!result[language]) result[language] = [];
+        result[language].push(startupCost);
+        winston.info(
+          `Startup cost of ${language} ${JSON.stringify(compileAndRunOptions)}: ` +
+            `${startupCost.time.toFixed(1)} ms, ${startupCost.memory.toFixed(0)} KiB`
+        );
+      } catch (e) {
+        // e.g. the compiler is not in the rootfs
+        winston.warn(`Failed to calibrate ${language} ${JSON.stringify(compileAndRunOptions)}: ${e.message}`);
+      }
+    }
+  }
+
+  startupCosts = result;
+}
+
+export function getLanguageStartupCosts() {
+  return startupCosts;
+}
+
+/**
+ * Return the calibrated startup time (in ms) to add to the time limit of a user's program and subtract from its
+ * measured time with `calibration.adjustTimeLimit`, or 0 if disabled. The smallest one of the language is used if
+ * its compile options are not calibrated.
+ */
+export function getStartupTimeAdjustment(language: string, compileAndRunOptions: unknown) {
+  const costs = config.calibration?.adjustTimeLimit && startupCosts[language];
+  if (!costs || costs.length === 0) return 0;
+
+  const optionsHash = objectHash(compileAndRunOptions);
+  const cost = costs.find(c => objectHash(c.compileAndRunOptions) === optionsHash);
+  return Math.floor(cost ? cost.time : Math.min(...costs.map(c => c.time)));
+}
+
+/**
+ * Calibrate before consuming tasks, and on each SIGHUP. `onCalibrated` is called after each calibration.
+ */
+export async function startCalibration(onCalibrated: () => void) {
+  if (!config.calibration) return;
+
+  let calibrating = false;
+  const calibrate = async () => {
+    calibrating = true;
+    try {
+      await calibrateLanguages();
+      onCalibrated();
+    } catch (e) {
+      winston.error(`Failed to calibrate the languages: ${e.stack}`);
+    } finally {
+      calibrating = false;
+    }
+  };
+
+  process.on("SIGHUP", () => {
+    if (calibrating) return;
+    winston.info("Received SIGHUP, calibrating the languages");
+    calibrate();
+  });
+
+  await calibrate();
+}
@@ -1,19 +1,37 @@
-import { promisify } from "util";
+import { performance } from "perf_hooks";
 
 import bindings from "bindings";
 
 import { OmittableString } from "@/omittableString";
+import { createNativeTiming, traceNativeSpan } from "@/tracing";
+import { threadpoolOperationStarted, threadpoolOperationFinished } from "@/metrics";
 
-import { Checker, CheckerResult, parseTestlibMessage } from ".";
+import { Checker, CheckerResult, parseTestlibMessage, checkerDurationSeconds } from ".";
 
 const native = bindings("builtin_checkers");
-const nativeRunBuiltinChecker = promisify(native.runBuiltinChecker);
 
 export async function runBuiltinChecker(
   outputFilePath: string,
   answerFilePath: string,
   checker: Checker
 ): Promise<CheckerResult | OmittableString> {
-  const message = await nativeRunBuiltinChecker(outputFilePath, answerFilePath, checker);
-  return parseTestlibMessage(message);
+  const startTime = performance.now();
+  const timing = createNativeTiming(checker.type);
+  threadpoolOperationStarted();
+  try {
+    const message = await new Promise<string>((resolve, reject) =>
+      native.runBuiltinChecker(
+        outputFilePath,
+        answerFilePath,
+        checker,
+        (error: Error, result: string) => (error ? reject(error) : resolve(result)),
+        timing
+      )
+    );
+    return parseTestlibMessage(message);
+  } finally {
+    threadpoolOperationFinished("builtinChecker", timing);
+    traceNativeSpan("builtinChecker", "checker", timing, { type: checker.type });
+    checkerDurationSeconds.observe({ type: checker.type }, (performance.now() - startTime) / 1e3);
+  }
 }
@@ -1,3 +1,5 @@
+import { performance } from "perf_hooks";
+
 import { SandboxResult } from "simple-sandbox";
 
 import { CpuAffinityStrategy, runSandbox, SANDBOX_INSIDE_PATH_BINARY } from "@/sandbox";
@@ -6,8 +8,9 @@ import getLanguage from "@/languages";
 import { ConfigurationError } from "@/error";
 import { MappedPath } from "@/utils";
 import { OmittableString } from "@/omittableString";
+import { traceSpan } from "@/tracing";
 
-import { CheckerResult, CheckerTypeCustom } from "..";
+import { CheckerResult, CheckerTypeCustom, checkerDurationSeconds } from "..";
 
 export interface CustomChecker {
   /**
@@ -69,45 +72,54 @@ export async function runCustomChecker(
   workingDirectory: MappedPath,
   tempDirectoryOutside: string
 ) {
-  return await customCheckerInterfaces[checker.interface].runChecker(
-    checker,
-    inputFile,
-    outputFile,
-    answerFile,
-    code,
-    workingDirectory,
-    async (stdin, stdout, stderr, parameters) =>
-      await runSandbox(taskId, {
-        ...getLanguage(checker.language).run({
-          binaryDirectoryInside: SANDBOX_INSIDE_PATH_BINARY,
-          workingDirectoryInside: workingDirectory.inside,
-          compileAndRunOptions: checker.compileAndRunOptions,
-          time: timeLimit,
-          memory: memoryLimit,
-          stdinFile: stdin,
-          stdoutFile: stdout,
-          stderrFile: stderr,
-          parameters,
-          compileResultExtraInfo: checkerCompileResult.extraInfo
-        }),
-        time: timeLimit,
-        memory: memoryLimit * 1024 * 1024,
-        workingDirectory: workingDirectory.inside,
-        tempDirectoryOutside,
-        extraMounts: [
-          {
-            mappedPath: {
-              outside: checkerCompileResult.binaryDirectory,
-              inside: SANDBOX_INSIDE_PATH_BINARY
-            },
-            readOnly: true
-          },
-          {
-            mappedPath: workingDirectory,
-            readOnly: false
-          }
-        ],
-        cpuAffinity: CpuAffinityStrategy.Checker
-      })
+  const startTime = performance.now();
+  const result = await traceSpan(
+    "customChecker",
+    "checker",
+    () =>
+      customCheckerInterfaces[checker.interface].runChecker(
+        checker,
+        inputFile,
+        outputFile,
+        answerFile,
+        code,
+        workingDirectory,
+        async (stdin, stdout, stderr, parameters) =>
+          await runSandbox(taskId, {
+            ...getLanguage(checker.language).run({
+              binaryDirectoryInside: SANDBOX_INSIDE_PATH_BINARY,
+              workingDirectoryInside: workingDirectory.inside,
+              compileAndRunOptions: checker.compileAndRunOptions,
+              time: timeLimit,
+              memory: memoryLimit,
+              stdinFile: stdin,
+              stdoutFile: stdout,
+              stderrFile: stderr,
+              parameters,
+              compileResultExtraInfo: checkerCompileResult.extraInfo
+            }),
+            time: timeLimit,
+            memory: memoryLimit * 1024 * 1024,
+            workingDirectory: workingDirectory.inside,
+            tempDirectoryOutside,
+            extraMounts: [
+              {
+                mappedPath: {
+                  outside: checkerCompileResult.binaryDirectory,
+                  inside: SANDBOX_INSIDE_PATH_BINARY
+                },
+                readOnly: true
+              },
+              {
+                mappedPath: workingDirectory,
+                readOnly: false
+              }
+            ],
+            cpuAffinity: CpuAffinityStrategy.Checker
+          })
+      ),
+    { interface: checker.interface }
   );
+  checkerDurationSeconds.observe({ type: "custom" }, (performance.now() - startTime) / 1e3);
+  return result;
 }
@@ -1,4 +1,5 @@
 import { OmittableString, omittableStringToString, prependOmittableString } from "@/omittableString";
+import { Histogram } from "@/metrics";
 
 // integers: check the equivalent of each integer in user's output and answer
 export interface CheckerTypeIntegers {
@@ -20,6 +21,13 @@ export interface CheckerTypeLines {
   caseSensitive: boolean;
 }
 
+// tokens:   check the equivalent of each token (separated by any space characters), maybe case-insensitive
+//           the same as testlib's wcmp, case-sensitive unless [tokens.caseSensitive] is false
+export interface CheckerTypeTokens {
+  type: "tokens";
+  caseSensitive?: boolean;
+}
+
 // binary:   check if the user's output and answer files are equal in binary
 export interface CheckerTypeBinary {
   type: "binary";
@@ -40,9 +48,15 @@ export type Checker =
   | CheckerTypeIntegers
   | CheckerTypeFloats
   | CheckerTypeLines
+  | CheckerTypeTokens
   | CheckerTypeBinary
   | CheckerTypeCustom;
 
+export const checkerDurationSeconds = new Histogram(
+  "judge_checker_duration_seconds",
+  "Wall time of running a checker on a testcase, by checker type"
+);
+
 export interface CheckerResult {
   /**
    * `score == null` means JudgementFailed.
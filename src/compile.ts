@@ -1,4 +1,5 @@
 import fs from "fs";
+import { performance } from "perf_hooks";
 
 import { SandboxStatus } from "simple-sandbox";
 import objectHash from "object-hash";
@@ -14,12 +15,25 @@ import {
   runSandbox,
   SANDBOX_INSIDE_PATH_SOURCE,
   SANDBOX_INSIDE_PATH_BINARY,
+  SANDBOX_INSIDE_PATH_PRECOMPILED_HEADER,
   CpuAffinityStrategy
 } from "./sandbox";
-import config, { serverSideConfig } from "./config";
+import config, { serverSideConfig, binaryCacheScratchStore } from "./config";
 import { runTaskQueued } from "./taskQueue";
 import { getFile, getFileHash } from "./file";
 import * as fsNative from "./fsNative";
+import { traceSpan, traceInstant } from "./tracing";
+import { Counter, Gauge, Histogram } from "./metrics";
+import {
+  requestCacheDaemon,
+  holdCompileResultLease,
+  ClaimCompileResultResponse,
+  SharedCompileResult,
+  SharedCompileResultIndex
+} from "./cacheClient";
+import { fetchRemoteCompileResult, uploadRemoteCompileResult } from "./remoteCompileStore";
+import { acquirePrecompiledHeader, releasePrecompiledHeader, PrecompiledHeader } from "./precompiledHeaders";
+import { compileWithServer } from "./compileServer";
 
 export interface CompilationConfig extends SandboxConfigBase {
   messageFile?: string; // The file contains the message to display for user (in the binary directory)
@@ -32,6 +46,8 @@ export interface CompileTask {
   code: string;
   compileAndRunOptions: unknown;
   extraSourceFiles?: Record<string, string>;
+  // A checker or interactor, compiled by each judge node judging the problem, so shared in the remote compile store
+  shareRemotely?: boolean;
 }
 
 async function hashCompileTask(compileTask: CompileTask): Promise<string> {
@@ -66,7 +82,9 @@ export class CompileResultSuccess implements CompileResult {
     public readonly message: OmittableString,
     public readonly binaryDirectory: string,
     public readonly binaryDirectorySize: number,
-    public readonly extraInfo: string
+    public readonly extraInfo: string,
+    // If the directory is owned by someone else (e.g. the cache daemon), called instead of removing it
+    private readonly release?: () => Promise<void>
   ) {}
 
   // The referenceCount is initially zero, the result must be referenced at least once
@@ -80,7 +98,8 @@ export class CompileResultSuccess implements CompileResult {
 
   public async dereference() {
     if (--this.referenceCount === 0) {
-      await fsNative.remove(this.binaryDirectory);
+      if (this.release) await this.release();
+      else await fsNative.remove(this.binaryDirectory);
     }
   }
 
@@ -98,17 +117,50 @@ export class CompileResultSuccess implements CompileResult {
   }
 }
 
+const compileCacheRequests = new Counter(
+  "judge_compile_cache_requests_total",
+  "Compilations requested, by whether the result is cached, shared with a pending one, or compiled"
+);
+const compileCacheEvictions = new Counter("judge_compile_cache_evictions_total", "Compile results evicted");
+
+const compileSeconds = new Histogram(
+  "judge_compile_seconds",
+  "Time taken to run the compiler, by language and whether it's compiled by a compile server or in its own sandbox",
+  [0.1, 0.25, 0.5, 1, 2.5, 5, 10, 20]
+);
+
+/**
+ * Where the compile results are cached. All returned results are reference()-ed and must be dereference()-ed.
+ */
+interface CompileResultStore {
+  // Only the ones in this process, without waiting
+  get(compileTaskHash: string): CompileResultSuccess;
+
+  /**
+   * Return the result cached or compiled by others, or `null` if the caller should compile it and then call
+   * `set()` (if succeeded), `setFailed()` or `abandon()`.
+   */
+  claim(compileTaskHash: string): Promise<CompileResult>;
+
+  set(compileTaskHash: string, result: CompileResultSuccess): Promise<CompileResultSuccess>;
+
+  setFailed(compileTaskHash: string, result: CompileResult): Promise<void>;
+
+  abandon(compileTaskHash: string): Promise<void>;
+}
+
 // Why NOT using the task hash as the directory name? Because there'll be a race condition
 // If a compile result is disposed from the cache, but still have at least one reference
 // e.g. referenced by a judge task which have not finished copying the binary files to its working directory
 // Another cache set operation with the same task will overwrite the files (and may cause the judge task using a corrupted file)
 // Use a random uuid as the key instead to prevent this
-class CompileResultCache {
+class CompileResultCache implements CompileResultStore {
   private readonly lruCache = new LruCache<string, CompileResultSuccess>({
     maxSize: config.binaryCacheMaxSize,
     sizeCalculation: result => result.binaryDirectorySize,
-    dispose: (result, compileTaskHash) => {
+    dispose: (result, compileTaskHash, reason) => {
       winston.verbose(`dispose() from compile result cache: ${compileTaskHash}`);
+      if (reason === "evict") compileCacheEvictions.inc();
       setImmediate(() => {
         // It's safe NOT to await it..
         result.dereference().catch(e => winston.error(`Failed to remove compile result on evicting cache: ${e.stack}`));
@@ -116,6 +168,15 @@ class CompileResultCache {
     }
   });
 
+  constructor() {
+    // eslint-disable-next-line no-new
+    new Gauge("judge_compile_cache_size_bytes", "Total size of the cached compile results", () => [
+      [{}, this.lruCache.calculatedSize]
+    ]);
+    // eslint-disable-next-line no-new
+    new Gauge("judge_compile_cache_entries", "Compile results in the cache", () => [[{}, this.lruCache.size]]);
+  }
+
   // The set()/get()'s returned result is reference()-ed
   // and must be dereference()-ed
 
@@ -134,6 +195,80 @@ class CompileResultCache {
     this.lruCache.set(compileTaskHash, newCompileResult);
     return newCompileResult.reference();
   }
+
+  // The pending compilations are shared in compile() within this process
+  public async claim(): Promise<CompileResult> {
+    return null;
+  }
+
+  public async setFailed() {}
+
+  public async abandon() {}
+}
+
+/**
+ * The compile results shared by the judge processes on the same host with the cache daemon, see cacheDaemon.ts.
+ */
+class SharedCompileResultCache implements CompileResultStore {
+  public get(): CompileResultSuccess {
+    return null;
+  }
+
+  private toCompileResult(compileTaskHash: string, { result, lease }: ClaimCompileResultResponse): CompileResult {
+    if (!result.success) return { compileTaskHash, success: false, message: result.message };
+
+    const release = holdCompileResultLease(compileTaskHash, result.binaryDirectory, lease);
+    return new CompileResultSuccess(
+      compileTaskHash,
+      result.message,
+      result.binaryDirectory,
+      result.binaryDirectorySize,
+      result.extraInfo,
+      () => release().catch(e => winston.error(`Failed to release compile result ${compileTaskHash}: ${e.message}`))
+    ).reference();
+  }
+
+  public async claim(compileTaskHash: string): Promise<CompileResult> {
+    const response = await requestCacheDaemon<ClaimCompileResultResponse>("claimCompileResult", { compileTaskHash });
+    if (response.compile) return null;
+    return this.toCompileResult(compileTaskHash, response);
+  }
+
+  public async set(compileTaskHash: string, result: CompileResultSuccess): Promise<CompileResultSuccess> {
+    // Copied in this process's own directory and moved to the store with its index, so a (re)starting daemon never
+    // sees a partial one, see cacheDaemon.ts
+    const id = uuid();
+    const binaryDirectory = safelyJoinPath(config.binaryCacheStore, id);
+    const newCompileResult = await result.copyTo(safelyJoinPath(binaryCacheScratchStore, id));
+    const sharedResult: SharedCompileResult = {
+      success: true,
+      message: newCompileResult.message,
+      binaryDirectory,
+      binaryDirectorySize: newCompileResult.binaryDirectorySize,
+      extraInfo: newCompileResult.extraInfo
+    };
+    const index: SharedCompileResultIndex = { compileTaskHash, result: sharedResult };
+    await fs.promises.writeFile(`${binaryDirectory}.json`, JSON.stringify(index));
+    await fs.promises.rename(newCompileResult.binaryDirectory, binaryDirectory);
+
+    // If the daemon is lost before it's published, it's adopted or removed when the daemon restarts
+    const response = await requestCacheDaemon<ClaimCompileResultResponse>("publishCompileResult", {
+      compileTaskHash,
+      result: sharedResult
+    });
+    return this.toCompileResult(compileTaskHash, response) as CompileResultSuccess;
+  }
+
+  public async setFailed(compileTaskHash: string, result: CompileResult) {
+    await requestCacheDaemon("publishCompileResult", {
+      compileTaskHash,
+      result: { success: false, message: result.message }
+    });
+  }
+
+  public async abandon(compileTaskHash: string) {
+    await requestCacheDaemon("abandonCompileResult", { compileTaskHash });
+  }
 }
 
 interface PendingCompileTask {
@@ -144,7 +279,9 @@ interface PendingCompileTask {
 // If there're multiple calls to compile() with the same compileTask, it's to prevent the task to be compiled multiple times
 // compileTaskHash -> Promise of task
 const pendingCompileTasks: Map<string, PendingCompileTask> = new Map();
-const compileResultCache = new CompileResultCache();
+const compileResultCache: CompileResultStore = config.cacheDaemon
+  ? new SharedCompileResultCache()
+  : new CompileResultCache();
 
 export async function compile(compileTask: CompileTask): Promise<CompileResult> {
   const languageConfig = getLanguage(compileTask.language);
@@ -154,10 +291,13 @@ export async function compile(compileTask: CompileTask): Promise<CompileResult>
   const cachedResult = compileResultCache.get(compileTaskHash);
   if (cachedResult) {
     winston.verbose(`Use cached compile reslt for ${compileTaskHash}`);
+    traceInstant("compileCacheHit", "compile", { language: compileTask.language });
+    compileCacheRequests.inc({ result: "hit" });
     return cachedResult;
   }
 
   let pendingCompileTask = pendingCompileTasks.get(compileTaskHash);
+  compileCacheRequests.inc({ result: pendingCompileTask ? "shared" : "miss" });
   if (!pendingCompileTask) {
     // Use a array of functions to ensure every calls to compile() of this task could get
     // a valid CompileResultSuccess object (with positive referenceCount)
@@ -167,16 +307,33 @@ export async function compile(compileTask: CompileTask): Promise<CompileResult>
       compileTaskHash,
       (pendingCompileTask = {
         resultConsumers,
-        promise: runTaskQueued(async taskWorkingDirectory => {
+        promise: (async () => {
           // The compileResult is already reference()-ed
-          const compileResult = await doCompile(compileTask, compileTaskHash, languageConfig, taskWorkingDirectory);
+          const compileResult =
+            (await compileResultCache.claim(compileTaskHash)) ||
+            (await runTaskQueued(async taskWorkingDirectory => {
+              try {
+                const fetchedResult =
+                  compileTask.shareRemotely && (await fetchCompileResult(compileTaskHash, taskWorkingDirectory));
+                if (fetchedResult) return fetchedResult;
+
+                const result = await doCompile(compileTask, compileTaskHash, languageConfig, taskWorkingDirectory);
+                if (result instanceof CompileResultSuccess) {
+                  if (compileTask.shareRemotely) uploadCompileResult(result);
+                } else await compileResultCache.setFailed(compileTaskHash, result);
+                return result;
+              } catch (e) {
+                await compileResultCache.abandon(compileTaskHash);
+                throw e;
+              }
+            }));
           winston.verbose(`Compile result: ${JSON.stringify(compileResult)}`);
 
           for (const resultConsumer of resultConsumers)
             resultConsumer(compileResult instanceof CompileResultSuccess ? compileResult.reference() : compileResult);
 
           if (compileResult instanceof CompileResultSuccess) await compileResult.dereference();
-        }).finally(() => pendingCompileTasks.delete(compileTaskHash))
+        })().finally(() => pendingCompileTasks.delete(compileTaskHash))
       })
     );
   }
@@ -185,11 +342,37 @@ export async function compile(compileTask: CompileTask): Promise<CompileResult>
   pendingCompileTask.resultConsumers.push(r => {
     result = r;
   });
-  await pendingCompileTask.promise;
+  await traceSpan("compile", "compile", () => pendingCompileTask.promise, { language: compileTask.language });
 
   return result;
 }
 
+// Return reference()-ed result if found in the remote compile store
+async function fetchCompileResult(compileTaskHash: string, taskWorkingDirectory: string) {
+  const fetched = await fetchRemoteCompileResult(compileTaskHash, taskWorkingDirectory);
+  if (!fetched) return null;
+
+  winston.verbose(`Use compile result from the remote store for ${compileTaskHash}`);
+  return await compileResultCache.set(
+    compileTaskHash,
+    new CompileResultSuccess(
+      compileTaskHash,
+      fetched.message,
+      fetched.binaryDirectory,
+      fetched.binaryDirectorySize,
+      fetched.extraInfo
+    )
+  );
+}
+
+// Upload in the background, the result is referenced until it's uploaded
+function uploadCompileResult(result: CompileResultSuccess) {
+  result.reference();
+  uploadRemoteCompileResult(result.compileTaskHash, result)
+    .then(() => result.dereference())
+    .catch(e => winston.error(`Failed to remove compile result after uploading: ${e.stack}`));
+}
+
 // Return reference()-ed result if success
 async function doCompile(
   compileTask: CompileTask,
@@ -197,7 +380,10 @@ async function doCompile(
   languageConfig: LanguageConfig<unknown>,
   taskWorkingDirectory: string
 ): Promise<CompileResult> {
-  const { sourceFilename, binarySizeLimit } = languageConfig.getMetaOptions(compileTask.compileAndRunOptions);
+  const { sourceFilename, binarySizeLimit } = languageConfig.getMetaOptions(
+    compileTask.compileAndRunOptions,
+    compileTask.code
+  );
 
   const sourceDirectory: MappedPath = {
     outside: safelyJoinPath(taskWorkingDirectory, "source"),
@@ -225,45 +411,101 @@ async function doCompile(
   const sourceFile = safelyJoinPath(sourceDirectory, sourceFilename);
   await fs.promises.writeFile(sourceFile.outside, compileTask.code);
 
-  const compileConfig = languageConfig.compile({
-    sourceDirectoryInside: sourceDirectory.inside,
-    sourcePathInside: sourceFile.inside,
-    binaryDirectoryInside: binaryDirectory.inside,
-    compileAndRunOptions: compileTask.compileAndRunOptions
-  });
+  const runCompiler = async (precompiledHeader: PrecompiledHeader) => {
+    const compileConfig = languageConfig.compile({
+      sourceDirectoryInside: sourceDirectory.inside,
+      sourcePathInside: sourceFile.inside,
+      binaryDirectoryInside: binaryDirectory.inside,
+      compileAndRunOptions: compileTask.compileAndRunOptions,
+      precompiledHeaderDirectoryInside: precompiledHeader ? SANDBOX_INSIDE_PATH_PRECOMPILED_HEADER : null
+    });
+
+    // The `taskId` parameter of `runSandbox` is just used to cancel the sandbox
+    // But compilation couldn't be cancelled since multiple submissions may share the same compilation
+    const sandboxResult = await runSandbox(null, {
+      ...compileConfig,
+      tempDirectoryOutside,
+      extraMounts: [
+        {
+          mappedPath: sourceDirectory,
+          readOnly: true
+        },
+        {
+          mappedPath: binaryDirectory,
+          readOnly: false
+        },
+        ...(precompiledHeader
+          ? [
+              {
+                mappedPath: { outside: precompiledHeader.directory, inside: SANDBOX_INSIDE_PATH_PRECOMPILED_HEADER },
+                readOnly: true
+              }
+            ]
+          : [])
+      ],
+      cpuAffinity: CpuAffinityStrategy.Compiler
+    });
+
+    const messageFile = safelyJoinPath(binaryDirectory, compileConfig.messageFile);
+    const extraInfoFile = compileConfig.extraInfoFile && safelyJoinPath(binaryDirectory, compileConfig.extraInfoFile);
+    const [message, extraInfo] = await Promise.all([
+      readFileOmitted(messageFile.outside, serverSideConfig.limit.compilerMessage).then(result => result || ""),
+      extraInfoFile
+        ? fsNative
+            .exists(extraInfoFile.outside)
+            .then(exists => (exists ? fs.promises.readFile(extraInfoFile.outside, "utf-8") : null))
+        : null
+    ]);
+    await Promise.all([
+      fsNative.remove(messageFile.outside),
+      extraInfoFile ? fsNative.remove(extraInfoFile.outside) : null
+    ]);
+
+    return { sandboxResult, message, extraInfo };
+  };
 
-  // The `taskId` parameter of `runSandbox` is just used to cancel the sandbox
-  // But compilation couldn't be cancelled since multiple submissions may share the same compilation
-  const sandboxResult = await runSandbox(null, {
-    ...compileConfig,
-    tempDirectoryOutside,
-    extraMounts: [
-      {
-        mappedPath: sourceDirectory,
-        readOnly: true
-      },
-      {
-        mappedPath: binaryDirectory,
-        readOnly: false
-      }
-    ],
-    cpuAffinity: CpuAffinityStrategy.Compiler
-  });
+  const startTime = performance.now();
+  let compiled: Awaited<ReturnType<typeof runCompiler>>;
+  const served = await compileWithServer(
+    languageConfig,
+    compileTask.compileAndRunOptions,
+    sourceFilename,
+    sourceDirectory.outside,
+    binaryDirectory.outside
+  );
+  if (served) {
+    compiled = {
+      sandboxResult: { status: SandboxStatus.OK, code: served.code, time: 0, memory: 0 },
+      message: served.message,
+      extraInfo: null
+    };
+  } else {
+    const precompiledHeader = await acquirePrecompiledHeader(
+      languageConfig,
+      compileTask.compileAndRunOptions,
+      compileTask.code,
+      taskWorkingDirectory
+    );
+    try {
+      compiled = await runCompiler(precompiledHeader);
+    } finally {
+      if (precompiledHeader) releasePrecompiledHeader(precompiledHeader);
+    }
 
-  const messageFile = safelyJoinPath(binaryDirectory, compileConfig.messageFile);
-  const extraInfoFile = compileConfig.extraInfoFile && safelyJoinPath(binaryDirectory, compileConfig.extraInfoFile);
-  const [message, extraInfo] = await Promise.all([
-    readFileOmitted(messageFile.outside, serverSideConfig.limit.compilerMessage).then(result => result || ""),
-    extraInfoFile
-      ? fsNative
-          .exists(extraInfoFile.outside)
-          .then(exists => (exists ? fs.promises.readFile(extraInfoFile.outside, "utf-8") : null))
-      : null
-  ]);
-  await Promise.all([
-    fsNative.remove(messageFile.outside),
-    extraInfoFile ? fsNative.remove(extraInfoFile.outside) : null
-  ]);
+    // The message must be the same as without the precompiled header, otherwise compile again without it
+    if (
+      precompiledHeader &&
+      (typeof compiled.message !== "string" || languageConfig.precompiledHeader.isMessageAffected(compiled.message))
+    ) {
+      await Promise.all([ensureDirectoryEmpty(binaryDirectory.outside), ensureDirectoryEmpty(tempDirectoryOutside)]);
+      compiled = await runCompiler(null);
+    }
+  }
+  compileSeconds.observe(
+    { language: languageConfig.name, mode: served ? "server" : "sandbox" },
+    (performance.now() - startTime) / 1000
+  );
+  const { sandboxResult, message, extraInfo } = compiled;
 
   if (sandboxResult.status === SandboxStatus.OK) {
     if (sandboxResult.code === 0) {
@@ -0,0 +1,358 @@
+import fs from "fs";
+import net from "net";
+import { execFile } from "child_process";
+import { promisify } from "util";
+
+import winston from "winston";
+import { v4 as uuid } from "uuid";
+
+import config, { serverSideConfig, binaryCacheScratchStore } from "./config";
+import * as fsNative from "./fsNative";
+import { LanguageConfig } from "./languages";
+import { safelyJoinPath, ensureDirectoryEmpty, MappedPath } from "./utils";
+import { readFileOmitted, OmittableString } from "./omittableString";
+import {
+  startSandbox,
+  setSandboxUserPermission,
+  CpuAffinityStrategy,
+  SANDBOX_INSIDE_PATH_COMPILE_SERVER,
+  SANDBOX_INSIDE_PATH_SOURCE,
+  SANDBOX_INSIDE_PATH_BINARY
+} from "./sandbox";
+import { Counter } from "./metrics";
+
+/**
+ * The compile servers of the languages with `LanguageConfig.compileServer` in `config.compileServers.languages`.
+ * Each one is a persistent compiler (e.g. the Kotlin compiler in a JVM, which spends most of a cold compilation
+ * warming up) in a long-lived sandbox with the compiler's CPU affinity, started on the first compilation of the
+ * language, in a directory of `binaryCacheStore`.
+ *
+ * A compilation is copied to the server's source directory and requested by a line of its arguments on the
+ * server's stdin, which is answered by a line of the exit code on its stdout (both are FIFOs). The source and binary
+ * directories are mounted at the same paths as in the compiler's own sandbox, so the compiler's messages (which
+ * contain the source path) don't depend on whether it's compiled by the server. The server compiles
+ * one at a time, a compilation is compiled in its own sandbox as usual if the server is busy. The server is
+ * recycled after `maxCompilations` compilations, or on any anomaly (e.g. timed out or exited), in which case the
+ * compilation is also compiled in its own sandbox.
+ */
+
+export interface CompileServerResult {
+  code: number;
+  message: OmittableString;
+}
+
+// Not to start a failing compile server again for each compilation
+const START_RETRY_INTERVAL = 60 * 1000;
+
+const execFileAsync = promisify(execFile);
+
+const compileServerRequests = new Counter(
+  "judge_compile_server_requests_total",
+  "Compilations of the languages with a compile server, by whether it's compiled by the server, the server is busy " +
+    "or unavailable, or failed"
+);
+
+let enabledLanguages: string[];
+
+class CompileServer {
+  public busy = false;
+
+  public compilations = 0;
+
+  private stopped = false;
+
+  private responseBuffer = "";
+
+  private onResponse: (line: string) => void = null;
+
+  private onStop: () => void = null;
+
+  constructor(
+    public readonly language: string,
+    private readonly directory: string,
+    private readonly sourceDirectory: MappedPath,
+    private readonly binaryDirectory: MappedPath,
+    private readonly timeLimit: number,
+    private readonly sandbox: Awaited<ReturnType<typeof startSandbox>>,
+    private readonly requests: net.Socket,
+    private readonly responses: net.Socket
+  ) {
+    responses.setEncoding("utf-8");
+    responses.on("data", (data: string) => {
+      this.responseBuffer += data;
+      let index: number;
+      while ((index = this.responseBuffer.indexOf("\n")) !== -1) {
+        const line = this.responseBuffer.slice(0, index);
+        this.responseBuffer = this.responseBuffer.slice(index + 1);
+        if (this.onResponse) this.onResponse(line);
+      }
+    });
+    requests.on("error", e => this.stop(`request error: ${e}`));
+    responses.on("error", e => this.stop(`response error: ${e}`));
+
+    sandbox.waitForStop().then(
+      result => this.stop(`exited with ${JSON.stringify(result)}`),
+      e => this.stop(`sandbox error: ${e}`)
+    );
+  }
+
+  get isStopped() {
+    return this.stopped;
+  }
+
+  private waitForResponse() {
+    return new Promise<string>((resolve, reject) => {
+      if (this.stopped) return reject(new Error("The compile server stopped"));
+
+      const timer = setTimeout(() => {
+        this.stop("timed out");
+        reject(new Error("Timed out"));
+      }, this.timeLimit);
+      this.onResponse = line => {
+        clearTimeout(timer);
+        this.onResponse = this.onStop = null;
+        resolve(line);
+      };
+      this.onStop = () => {
+        clearTimeout(timer);
+        this.onResponse = this.onStop = null;
+        reject(new Error("The compile server stopped"));
+      };
+    });
+  }
+
+  async compile(
+    languageConfig: LanguageConfig<unknown>,
+    compileAndRunOptions: unknown,
+    sourceFilename: string,
+    sourceDirectoryOutside: string,
+    binaryDirectoryOutside: string
+  ): Promise<CompileServerResult> {
+    // The same as the compiler's message file in its own sandbox, removed before copying the binary
+    const messageFile = safelyJoinPath(this.binaryDirectory, "message.txt");
+
+    const compilerArguments = languageConfig.compileServer.getArguments({
+      sourcePathInside: `${this.sourceDirectory.inside}/${sourceFilename}`,
+      binaryDirectoryInside: this.binaryDirectory.inside,
+      compileAndRunOptions
+    });
+    const request = [messageFile.inside, ...compilerArguments];
+    // The user could pass anything in the options, leave it to the compiler in its own sandbox
+    if (request.some(field => /[\t\n]/.test(field))) return null;
+
+    // Emptied instead of removed, since they're mounted in the server's sandbox
+    await Promise.all([
+      ensureDirectoryEmpty(this.sourceDirectory.outside),
+      ensureDirectoryEmpty(this.binaryDirectory.outside)
+    ]);
+    await fsNative.copy(sourceDirectoryOutside, this.sourceDirectory.outside);
+    if (this.stopped) throw new Error("The compile server stopped");
+
+    const response = this.waitForResponse();
+    this.requests.write(`${request.join("\t")}\n`);
+    const code = Number(await response);
+    if (!Number.isInteger(code)) throw new Error(`Invalid response from the compile server: ${code}`);
+    this.compilations++;
+
+    const message = (await readFileOmitted(messageFile.outside, serverSideConfig.limit.compilerMessage)) || "";
+    await fsNative.remove(messageFile.outside);
+    await fsNative.copy(this.binaryDirectory.outside, binaryDirectoryOutside);
+    await Promise.all([
+      ensureDirectoryEmpty(this.sourceDirectory.outside),
+      ensureDirectoryEmpty(this.binaryDirectory.outside)
+    ]);
+
+    return { code, message };
+  }
+
+  stop(reason: string) {
+    if (this.stopped) return;
+    this.stopped = true;
+
+    winston.verbose(`Stopping the compile server of ${this.language}: ${reason}`);
+    if (this.onStop) this.onStop();
+    // eslint-disable-next-line @typescript-eslint/no-use-before-define
+    removeCompileServer(this);
+    this.requests.destroy();
+    this.responses.destroy();
+    this.sandbox.stop();
+    this.sandbox
+      .waitForStop()
+      .catch(() => {})
+      .then(() => fsNative.remove(this.directory))
+      .catch(e => winston.error(`Failed to remove compile server directory ${this.directory}: ${e.stack}`));
+  }
+}
+
+async function startCompileServer(languageConfig: LanguageConfig<unknown>) {
+  winston.info(`Starting the compile server of ${languageConfig.name}`);
+
+  const directory = safelyJoinPath(binaryCacheScratchStore, `compile-server-${uuid()}`);
+  const serverDirectory: MappedPath = {
+    outside: safelyJoinPath(directory, "server"),
+    inside: SANDBOX_INSIDE_PATH_COMPILE_SERVER
+  };
+  const sourceDirectory: MappedPath = {
+    outside: safelyJoinPath(directory, "source"),
+    inside: SANDBOX_INSIDE_PATH_SOURCE
+  };
+  const binaryDirectory: MappedPath = {
+    outside: safelyJoinPath(directory, "binary"),
+    inside: SANDBOX_INSIDE_PATH_BINARY
+  };
+  const tempDirectoryOutside = safelyJoinPath(directory, "temp");
+  await Promise.all(
+    [serverDirectory.outside, sourceDirectory.outside, binaryDirectory.outside, tempDirectoryOutside].map(path =>
+      ensureDirectoryEmpty(path)
+    )
+  );
+  await setSandboxUserPermission(binaryDirectory.outside, true);
+
+  const { files, time, ...startConfig } = languageConfig.compileServer.start({
+    serverDirectoryInside: serverDirectory.inside
+  });
+  await Promise.all(
+    Object.entries(files || {}).map(([filename, content]) =>
+      fs.promises.writeFile(safelyJoinPath(serverDirectory.outside, filename), content)
+    )
+  );
+
+  // Opened read-write and non-blocking by the judge first, so the server's opening doesn't block waiting for it
+  const requestFifo = safelyJoinPath(serverDirectory, "request");
+  const responseFifo = safelyJoinPath(serverDirectory, "response");
+  await execFileAsync("mkfifo", ["-m", "666", requestFifo.outside, responseFifo.outside]);
+  const openFifo = (path: string) => fs.openSync(path, fs.constants.O_RDWR | fs.constants.O_NONBLOCK);
+  const requests = new net.Socket({ fd: openFifo(requestFifo.outside), readable: false, writable: true });
+  const responses = new net.Socket({ fd: openFifo(responseFifo.outside), readable: true, writable: false });
+
+  try {
+    const sandbox = await startSandbox(null, {
+      ...startConfig,
+      stdin: requestFifo.inside,
+      stdout: responseFifo.inside,
+      stderr: `${serverDirectory.inside}/stderr.txt`,
+      // The CPU time of all its compilations
+      time: time * (config.compileServers?.maxCompilations || 100),
+      // The same as the compiler's own sandbox
+      workingDirectory: binaryDirectory.inside,
+      tempDirectoryOutside,
+      extraMounts: [
+        { mappedPath: serverDirectory, readOnly: false },
+        { mappedPath: sourceDirectory, readOnly: true },
+        { mappedPath: binaryDirectory, readOnly: false }
+      ],
+      cpuAffinity: CpuAffinityStrategy.Compiler
+    });
+
+    return new CompileServer(
+      languageConfig.name,
+      directory,
+      sourceDirectory,
+      binaryDirectory,
+      time,
+      sandbox,
+      requests,
+      responses
+    );
+  } catch (e) {
+    requests.destroy();
+    responses.destroy();
+    await fsNative.remove(directory);
+    throw e;
+  }
+}
+
+// languageName => the compile server, rejected if failed to start
+const compileServers: Map<string, Promise<CompileServer>> = new Map();
+
+function getCompileServer(languageConfig: LanguageConfig<unknown>) {
+  const server = compileServers.get(languageConfig.name);
+  if (server) return server;
+
+  const promise = startCompileServer(languageConfig);
+  compileServers.set(languageConfig.name, promise);
+  promise.catch(e => {
+    winston.warn(`Failed to start the compile server of ${languageConfig.name}: ${e.stack}`);
+    setTimeout(() => {
+      if (compileServers.get(languageConfig.name) === promise) compileServers.delete(languageConfig.name);
+    }, START_RETRY_INTERVAL);
+  });
+  return promise;
+}
+
+// Remove a stopped compile server, so the next compilation starts a new one
+function removeCompileServer(server: CompileServer) {
+  const promise = compileServers.get(server.language);
+  if (!promise) return;
+  promise.then(current => {
+    if (current !== server || compileServers.get(server.language) !== promise) return;
+    if (server.compilations > 0) compileServers.delete(server.language);
+    else {
+      // Exited before compiling anything, e.g. the compiler is not in the rootfs
+      winston.warn(`The compile server of ${server.language} failed before its first compilation`);
+      setTimeout(() => {
+        if (compileServers.get(server.language) === promise) compileServers.delete(server.language);
+      }, START_RETRY_INTERVAL);
+    }
+  });
+}
+
+/**
+ * Compile with the language's compile server, into the binary directory. Return `null` if it's not enabled, busy or
+ * failed, then the binary directory is empty and the code should be compiled in its own sandbox.
+ */
+export async function compileWithServer(
+  languageConfig: LanguageConfig<unknown>,
+  compileAndRunOptions: unknown,
+  sourceFilename: string,
+  sourceDirectoryOutside: string,
+  binaryDirectoryOutside: string
+): Promise<CompileServerResult> {
+  if (!enabledLanguages) enabledLanguages = config.compileServers?.languages || [];
+  if (!languageConfig.compileServer || !enabledLanguages.includes(languageConfig.name)) return null;
+
+  let server: CompileServer;
+  try {
+    server = await getCompileServer(languageConfig);
+  } catch (e) {
+    compileServerRequests.inc({ language: languageConfig.name, result: "unavailable" });
+    return null;
+  }
+
+  if (server.busy || server.isStopped) {
+    compileServerRequests.inc({ language: languageConfig.name, result: server.busy ? "busy" : "unavailable" });
+    return null;
+  }
+
+  server.busy = true;
+  try {
+    const result = await server.compile(
+      languageConfig,
+      compileAndRunOptions,
+      sourceFilename,
+      sourceDirectoryOutside,
+      binaryDirectoryOutside
+    );
+    if (!result) {
+      compileServerRequests.inc({ language: languageConfig.name, result: "unavailable" });
+      return null;
+    }
+
+    compileServerRequests.inc({ language: languageConfig.name, result: "compiled" });
+    if (server.compilations >= (config.compileServers?.maxCompilations || 100)) server.stop("recycled");
+    return result;
+  } catch (e) {
+    winston.warn(`Failed to compile with the compile server of ${languageConfig.name}: ${e.message}`);
+    compileServerRequests.inc({ language: languageConfig.name, result: "failed" });
+    server.stop(`failed to compile: ${e.message}`);
+    await ensureDirectoryEmpty(binaryDirectoryOutside);
+    return null;
+  } finally {
+    server.busy = false;
+  }
+}
+
+// bench/compile.ts compiles each language with and without its compile server, regardless of the config
+export function setCompileServerLanguages(languages: string[]) {
+  enabledLanguages = languages;
+}
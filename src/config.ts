@@ -15,13 +15,20 @@ import {
   IsArray,
   ArrayMinSize,
   IsOptional,
-  IsObject
+  IsObject,
+  IsBoolean,
+  IsNumber,
+  IsIn,
+  Min,
+  Max
 } from "class-validator";
 import winston from "winston";
 import yaml from "js-yaml";
+import { v4 as uuid } from "uuid";
 
 import { ensureDirectoryEmptySync } from "./utils";
 import * as fsNative from "./fsNative";
+import { tryLockFileSync } from "./posixUtils";
 
 winston.add(
   new winston.transports.Console({
@@ -63,6 +70,376 @@ export class CpuAffinityConfig {
   checker?: number[];
 }
 
+export class InteractionConfig {
+  /**
+   * Back the shared memory of interaction problems with huge pages (hugetlbfs, or THP as fallback with
+   * `sharedMemoryPrefault`).
+   */
+  @IsBoolean()
+  @IsOptional()
+  sharedMemoryHugePages?: boolean;
+
+  /**
+   * Allocate the pages of the shared memory before starting the sandboxes.
+   */
+  @IsBoolean()
+  @IsOptional()
+  sharedMemoryPrefault?: boolean;
+
+  /**
+   * Seal the shared memory's size so the programs can't resize it.
+   */
+  @IsBoolean()
+  @IsOptional()
+  sharedMemorySeal?: boolean;
+
+  /**
+   * The capacity (in bytes) of the pipes between the interactor and the user program. Leave null for default.
+   */
+  @IsPositive()
+  @IsInt()
+  @IsOptional()
+  pipeSize?: number;
+
+  /**
+   * Forward the data between the interactor and the user program with a native relay to collect pipe statistics.
+   */
+  @IsBoolean()
+  @IsOptional()
+  pipeRelay?: boolean;
+
+  /**
+   * Capture the data between the interactor and the user program, up to this number of bytes, and attach it to
+   * the testcase result. This implies `pipeRelay`. Leave null to disable.
+   */
+  @IsPositive()
+  @IsInt()
+  @IsOptional()
+  transcriptLimit?: number;
+}
+
+export class IdleDetectionConfig {
+  /**
+   * Stop a testcase as Idle/Deadlock (TLE) after its processes sleep without being scheduled for this long (ms).
+   */
+  @IsPositive()
+  @IsInt()
+  window: number;
+
+  /**
+   * The interval (ms) of sampling the processes' state.
+   */
+  @IsPositive()
+  @IsInt()
+  interval: number;
+}
+
+export class DiagnosticsConfig {
+  /**
+   * The interval (ms) of sampling each sandbox's cgroup.
+   */
+  @IsPositive()
+  @IsInt()
+  interval: number;
+
+  /**
+   * Log the histograms of all sandboxed runs every this seconds. Leave null to disable.
+   */
+  @IsPositive()
+  @IsInt()
+  @IsOptional()
+  logInterval?: number;
+}
+
+export class MemoryTimelineConfig {
+  /**
+   * The maximum number of points in a user program's memory timeline.
+   */
+  @IsPositive()
+  @IsInt()
+  points: number;
+
+  /**
+   * The initial sampling interval (ms), doubled each time the buffer is full.
+   */
+  @IsPositive()
+  @IsNumber()
+  minInterval: number;
+
+  @IsPositive()
+  @IsNumber()
+  maxInterval: number;
+
+  /**
+   * The maximum ratio of the CPU time spent sampling to the elapsed time, e.g. 0.01.
+   */
+  @IsPositive()
+  @IsNumber()
+  maxOverhead: number;
+}
+
+export class TimingRerunConfig {
+  /**
+   * Testcases whose time is in [lowerBound * timeLimit, upperBound * timeLimit] are re-run, e.g. 0.9 and 1.1. Only
+   * the ones accepted, partially correct or time limit exceeded, since the time can't change the others' verdict.
+   */
+  @IsPositive()
+  @IsNumber()
+  lowerBound: number;
+
+  @IsPositive()
+  @IsNumber()
+  upperBound: number;
+
+  /**
+   * The total number of runs (including the first one) of such a testcase.
+   */
+  @IsPositive()
+  @IsInt()
+  runs: number;
+
+  /**
+   * Report the run with the minimum or median time.
+   */
+  @IsIn(["min", "median"])
+  report: "min" | "median";
+
+  @IsPositive()
+  @IsInt()
+  maxRerunsPerSubmission: number;
+}
+
+export class TimingMonitorConfig {
+  /**
+   * The cores to probe, by default the user program cores.
+   */
+  @IsInt({ each: true })
+  @IsOptional()
+  cpus?: number[];
+
+  /**
+   * The interval (ms) between probes. A probe only runs while no task is running, and delays the tasks queued
+   * meanwhile.
+   */
+  @IsPositive()
+  @IsInt()
+  interval: number;
+
+  /**
+   * The number of recent probes of each core the variation is calculated on.
+   */
+  @IsPositive()
+  @IsInt()
+  window: number;
+
+  /**
+   * Flag the node when the coefficient of variation (stddev / mean) of any core exceeds this, e.g. 0.05.
+   */
+  @IsPositive()
+  @IsNumber()
+  maxVariation: number;
+
+  /**
+   * Skip probing a core if it's busier than this ratio right before the probe, e.g. running a user program.
+   */
+  @IsPositive()
+  @IsNumber()
+  maxBusyRatio: number;
+
+  /**
+   * Stop consuming new tasks while the node is flagged.
+   */
+  @IsBoolean()
+  @IsOptional()
+  pauseConsuming?: boolean;
+}
+
+export class TracingConfig {
+  /**
+   * The directory to write a Chrome trace event format JSON file of each traced task to.
+   */
+  @IsString()
+  directory: string;
+
+  /**
+   * The ratio of tasks traced. Send SIGUSR2 to the judge process to trace the next task on demand.
+   */
+  @Min(0)
+  @Max(1)
+  @IsNumber()
+  sampleRate: number;
+}
+
+export class MetricsConfig {
+  /**
+   * The port to serve the Prometheus-style metrics on, at `/metrics`.
+   */
+  @IsInt()
+  @IsPositive()
+  port: number;
+
+  /**
+   * The address to listen on, 127.0.0.1 by default.
+   */
+  @IsString()
+  @IsOptional()
+  host?: string;
+}
+
+export class EventRingConfig {
+  /**
+   * The events kept for each thread, rounded up to a power of 2. 1024 by default.
+   */
+  @IsInt()
+  @IsPositive()
+  @IsOptional()
+  ringCapacity?: number;
+
+  /**
+   * The threads which could record events, including the main thread and the threadpool threads of each native
+   * addon. The events of the others are dropped. 32 by default.
+   */
+  @IsInt()
+  @IsPositive()
+  @IsOptional()
+  rings?: number;
+
+  /**
+   * If set, drain the events every `drainInterval` seconds to the verbose log.
+   */
+  @IsPositive()
+  @IsNumber()
+  @IsOptional()
+  drainInterval?: number;
+}
+
+export class MemoryAdmissionConfig {
+  /**
+   * The memory (MiB) the running testcases could reserve in total. By default the memory limit of the judge's
+   * cgroup (or the total memory if not limited) minus `reserved`.
+   */
+  @IsInt()
+  @IsPositive()
+  @IsOptional()
+  budget?: number;
+
+  /**
+   * The memory (MiB) kept for the judge and the system when `budget` is not set. 512 by default.
+   */
+  @IsInt()
+  @Min(0)
+  @IsOptional()
+  reserved?: number;
+}
+
+export class CacheDaemonConfig {
+  /**
+   * The Unix socket of the cache daemon, shared by the judge processes on the same host with the same
+   * `dataStore` and `binaryCacheStore`.
+   */
+  @IsString()
+  socket: string;
+}
+
+export class RemoteCompileStoreConfig {
+  /**
+   * "directory" stores the compile results in a directory shared by the judge nodes (e.g. a NFS mount), "http" GETs
+   * and PUTs them under a URL.
+   */
+  @IsIn(["directory", "http"])
+  type: "directory" | "http";
+
+  @IsString()
+  @IsOptional()
+  path?: string;
+
+  @IsString()
+  @IsOptional()
+  url?: string;
+
+  /**
+   * The extra headers of the HTTP requests, e.g. `Authorization`.
+   */
+  @IsObject()
+  @IsOptional()
+  headers?: Record<string, string>;
+
+  /**
+   * Prepended to the archives' filenames, to separate the judge nodes with different compilers.
+   */
+  @IsString()
+  @IsOptional()
+  prefix?: string;
+
+  /**
+   * Only fetch the compile results, don't upload the ones compiled by this node.
+   */
+  @IsBoolean()
+  @IsOptional()
+  readOnly?: boolean;
+}
+
+export class PrecompiledHeadersConfig {
+  /**
+   * The number of precompiled headers kept in `binaryCacheStore` (one of bits/stdc++.h is about 100 MiB), the least
+   * recently used one is removed. 8 by default.
+   */
+  @IsInt()
+  @IsPositive()
+  @IsOptional()
+  maxCount?: number;
+}
+
+export class CompileServersConfig {
+  /**
+   * The languages compiled with a compile server, of the ones supporting it (e.g. "kotlin").
+   */
+  @IsString({ each: true })
+  @IsArray()
+  languages: string[];
+
+  /**
+   * The compilations of a compile server before it's recycled. 100 by default.
+   */
+  @IsInt()
+  @IsPositive()
+  @IsOptional()
+  maxCompilations?: number;
+}
+
+export class CalibrationConfig {
+  /**
+   * The runs of each language and compile options, the median is reported. 5 by default.
+   */
+  @IsInt()
+  @IsPositive()
+  @IsOptional()
+  runs?: number;
+
+  /**
+   * The languages to calibrate, all by default.
+   */
+  @IsString({ each: true })
+  @IsArray()
+  @IsOptional()
+  languages?: string[];
+
+  /**
+   * languageName => the compile and run options to calibrate, besides the default ones (see calibration.ts).
+   */
+  @IsObject()
+  @IsOptional()
+  compileAndRunOptions?: Record<string, unknown[]>;
+
+  /**
+   * If true, the calibrated startup time of the user's program's language is added to its time limit, and
+   * subtracted from its measured time.
+   */
+  @IsBoolean()
+  @IsOptional()
+  adjustTimeLimit?: boolean;
+}
+
 export class Config {
   @IsString()
   serverUrl: string;
@@ -102,10 +479,28 @@ export class Config {
   @IsArray()
   taskWorkingDirectories: string[];
 
+  /**
+   * If set, each testcase reserves its memory limit and the size of its input and output files while running, and
+   * waits for headroom instead of starting if the reserved memory would exceed the budget.
+   */
+  @ValidateNested()
+  @Type(() => MemoryAdmissionConfig)
+  @IsOptional()
+  memoryAdmission: MemoryAdmissionConfig;
+
   @IsPositive()
   @IsInt()
   rpcTimeout: number;
 
+  /**
+   * "full" (the default) reports the whole progress of a submission each time. "delta" reports the changes since
+   * the version acknowledged by the server, which must support it, and sends the last progress of a task before its
+   * ack (with "full" it's sent after the ack as before).
+   */
+  @IsIn(["full", "delta"])
+  @IsOptional()
+  progressProtocol?: "full" | "delta";
+
   @IsPositive()
   @IsInt()
   downloadTimeout: number;
@@ -122,8 +517,99 @@ export class Config {
   @Type(() => CpuAffinityConfig)
   @IsOptional()
   cpuAffinity: CpuAffinityConfig;
+
+  @ValidateNested()
+  @Type(() => InteractionConfig)
+  @IsOptional()
+  interaction: InteractionConfig;
+
+  @ValidateNested()
+  @Type(() => IdleDetectionConfig)
+  @IsOptional()
+  idleDetection: IdleDetectionConfig;
+
+  @ValidateNested()
+  @Type(() => DiagnosticsConfig)
+  @IsOptional()
+  diagnostics: DiagnosticsConfig;
+
+  @ValidateNested()
+  @Type(() => MemoryTimelineConfig)
+  @IsOptional()
+  memoryTimeline: MemoryTimelineConfig;
+
+  @ValidateNested()
+  @Type(() => TimingRerunConfig)
+  @IsOptional()
+  timingRerun: TimingRerunConfig;
+
+  @ValidateNested()
+  @Type(() => TimingMonitorConfig)
+  @IsOptional()
+  timingMonitor: TimingMonitorConfig;
+
+  @ValidateNested()
+  @Type(() => TracingConfig)
+  @IsOptional()
+  tracing: TracingConfig;
+
+  @ValidateNested()
+  @Type(() => MetricsConfig)
+  @IsOptional()
+  metrics: MetricsConfig;
+
+  @ValidateNested()
+  @Type(() => EventRingConfig)
+  @IsOptional()
+  eventRing: EventRingConfig;
+
+  @ValidateNested()
+  @Type(() => CacheDaemonConfig)
+  @IsOptional()
+  cacheDaemon: CacheDaemonConfig;
+
+  @ValidateNested()
+  @Type(() => RemoteCompileStoreConfig)
+  @IsOptional()
+  remoteCompileStore: RemoteCompileStoreConfig;
+
+  /**
+   * If set, the common headers (e.g. bits/stdc++.h with g++) are precompiled once for each combination of the
+   * compile options and used in the compilations including them.
+   */
+  @ValidateNested()
+  @Type(() => PrecompiledHeadersConfig)
+  @IsOptional()
+  precompiledHeaders: PrecompiledHeadersConfig;
+
+  /**
+   * If true, the compiled C# and F# programs are also compiled ahead of time with `mono --aot`, so their methods are
+   * not JIT-compiled in each run.
+   */
+  @IsBoolean()
+  @IsOptional()
+  monoAot?: boolean;
+
+  /**
+   * If set, the languages' compilers are kept warm in long-lived sandboxes instead of started for each compilation.
+   */
+  @ValidateNested()
+  @Type(() => CompileServersConfig)
+  @IsOptional()
+  compileServers: CompileServersConfig;
+
+  /**
+   * If set, the startup cost of each language is measured before consuming tasks, and reported to the server.
+   */
+  @ValidateNested()
+  @Type(() => CalibrationConfig)
+  @IsOptional()
+  calibration: CalibrationConfig;
 }
 
+// Started with `yarn start:cache-daemon`, see cacheDaemon.ts
+export const isCacheDaemon = process.argv.includes("--cache-daemon");
+
 const filePath = process.env.LYRIO_JUDGE_CONFIG_FILE;
 if (!filePath) {
   winston.error("Please specify configuration file with environment variable LYRIO_JUDGE_CONFIG_FILE");
@@ -144,13 +630,66 @@ if (new Set(config.taskWorkingDirectories.map(path => resolve(path))).size !== c
   process.exit(1);
 }
 
+const remoteCompileStoreLocation = { directory: "path", http: "url" }[config.remoteCompileStore?.type];
+if (remoteCompileStoreLocation && !config.remoteCompileStore[remoteCompileStoreLocation]) {
+  winston.error(`Please specify config.remoteCompileStore.${remoteCompileStoreLocation}.`);
+  process.exit(1);
+}
+
 // Create directories
-for (const dir of config.taskWorkingDirectories) {
-  checkTaskWorkingDirectory(dir);
+if (!isCacheDaemon) {
+  for (const dir of config.taskWorkingDirectories) {
+    checkTaskWorkingDirectory(dir);
+  }
 }
 
 fsNative.ensureDirSync(config.dataStore);
-ensureDirectoryEmptySync(config.binaryCacheStore);
+// With the cache daemon, the binary cache store is shared by the judge processes and the daemon, and never emptied
+// since the others may be using it, see `removeStaleBinaryCacheScratchStores()` and cacheDaemon.ts
+if (!config.cacheDaemon) ensureDirectoryEmptySync(config.binaryCacheStore);
+else fsNative.ensureDirSync(config.binaryCacheStore);
+
+/**
+ * Remove the temporary directories of the judge processes stopped (or crashed) without cleaning them, i.e. the ones
+ * whose lock is not held, see `binaryCacheScratchStore`.
+ */
+export function removeStaleBinaryCacheScratchStores() {
+  for (const filename of fs.readdirSync(config.binaryCacheStore)) {
+    const match = /^process-(.+)\.lock$/.exec(filename);
+    if (!match) continue;
+
+    const lockFd = tryLockFileSync(resolve(config.binaryCacheStore, filename));
+    if (lockFd == null) continue;
+    try {
+      winston.info(`Removing the binary cache store's temporary directories of a stopped judge process ${match[1]}`);
+      fsNative.removeSync(resolve(config.binaryCacheStore, `process-${match[1]}`));
+      fs.unlinkSync(resolve(config.binaryCacheStore, filename));
+    } finally {
+      fs.closeSync(lockFd);
+    }
+  }
+}
+
+/**
+ * The directory of this judge process's own temporary directories in the binary cache store (e.g. the precompiled
+ * headers and the compile servers). It's locked while the process runs, so with the cache daemon (where the store
+ * isn't emptied on starting) the ones left by crashed processes are removed when another process starts.
+ */
+function createBinaryCacheScratchStore() {
+  removeStaleBinaryCacheScratchStores();
+
+  // Locked before it's visible to the others' cleaning with the final name, the lock is held until the process exits
+  const id = uuid();
+  const lockFile = resolve(config.binaryCacheStore, `process-${id}.lock`);
+  tryLockFileSync(`${lockFile}.tmp`, "wx");
+  fs.renameSync(`${lockFile}.tmp`, lockFile);
+
+  const directory = resolve(config.binaryCacheStore, `process-${id}`);
+  fsNative.ensureDirSync(directory);
+  return directory;
+}
+
+export const binaryCacheScratchStore = isCacheDaemon ? null : createBinaryCacheScratchStore();
 
 // Check config (warnings)
 if (config.taskConsumingThreads > 3) {
@@ -178,8 +717,10 @@ if (config.taskWorkingDirectories.length < config.maxConcurrentTasks) {
   );
 }
 
-for (const dir of config.taskWorkingDirectories) {
-  ensureDirectoryEmptySync(dir);
+if (!isCacheDaemon) {
+  for (const dir of config.taskWorkingDirectories) {
+    ensureDirectoryEmptySync(dir);
+  }
 }
 
 // Some config are from server
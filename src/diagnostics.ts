@@ -0,0 +1,192 @@
+import bindings from "bindings";
+import winston from "winston";
+
+import config from "./config";
+import { formatHistogram, registerCollector } from "./metrics";
+
+const monitor = bindings("monitor");
+
+/**
+ * The cgroup v2 accounting of a sandboxed run. Times are in ms, memory is in KiB (as `result.memory`).
+ *
+ * The values are sampled periodically since the sandbox's cgroup is removed once it exits, so they're accurate
+ * to the sampling interval.
+ */
+export interface SandboxDiagnostics {
+  cpu: {
+    usage: number;
+    user: number;
+    system: number;
+    throttled: number;
+  };
+  memory: {
+    peak: number;
+    majorFaults: number;
+    minorFaults: number;
+  };
+  io: {
+    readBytes: number;
+    writeBytes: number;
+    readOperations: number;
+    writeOperations: number;
+  };
+  /**
+   * The time (ms) in which some / all processes in the sandbox were stalled on the resource (PSI).
+   */
+  pressure: Record<"cpu" | "memory" | "io", { some: number; full: number }>;
+}
+
+/**
+ * A histogram with power-of-2 buckets. Bucket `i` counts the values in `(2 ^ (i - 1), 2 ^ i]`, bucket 0 counts
+ * the values not greater than 1, so the upper bounds are inclusive as Prometheus's `le`.
+ */
+export class Log2Histogram {
+  buckets: number[] = [];
+
+  count = 0;
+
+  sum = 0;
+
+  add(value: number) {
+    const index = value <= 1 ? 0 : Math.ceil(Math.log2(value));
+    while (this.buckets.length <= index) this.buckets.push(0);
+    this.buckets[index]++;
+    this.count++;
+    this.sum += value;
+  }
+
+  /**
+   * Return the upper bound of the bucket containing the `q`-quantile.
+   */
+  quantile(q: number) {
+    let remaining = q * this.count;
+    for (let i = 0; i < this.buckets.length; i++) {
+      remaining -= this.buckets[i];
+      if (remaining <= 0) return 2 ** i;
+    }
+    return 2 ** this.buckets.length;
+  }
+}
+
+const HISTOGRAM_METRICS = {
+  cpuUsage: (diagnostics: SandboxDiagnostics) => diagnostics.cpu.usage,
+  memoryPeak: (diagnostics: SandboxDiagnostics) => diagnostics.memory.peak,
+  majorFaults: (diagnostics: SandboxDiagnostics) => diagnostics.memory.majorFaults,
+  cpuPressure: (diagnostics: SandboxDiagnostics) => diagnostics.pressure.cpu.some,
+  memoryPressure: (diagnostics: SandboxDiagnostics) => diagnostics.pressure.memory.some,
+  ioPressure: (diagnostics: SandboxDiagnostics) => diagnostics.pressure.io.some
+};
+
+type HistogramMetric = keyof typeof HISTOGRAM_METRICS;
+
+// kind => metric => histogram, for all sandboxed runs of this judge node
+const histograms = new Map<string, Record<HistogramMetric, Log2Histogram>>();
+
+function recordHistograms(kind: string, diagnostics: SandboxDiagnostics) {
+  const metrics = Object.keys(HISTOGRAM_METRICS) as HistogramMetric[];
+  if (!histograms.has(kind)) {
+    const kindHistograms = {} as Record<HistogramMetric, Log2Histogram>;
+    metrics.forEach(metric => {
+      kindHistograms[metric] = new Log2Histogram();
+    });
+    histograms.set(kind, kindHistograms);
+  }
+
+  const kindHistograms = histograms.get(kind);
+  metrics.forEach(metric => kindHistograms[metric].add(HISTOGRAM_METRICS[metric](diagnostics)));
+}
+
+export function getDiagnosticsHistograms(): ReadonlyMap<string, Record<HistogramMetric, Log2Histogram>> {
+  return histograms;
+}
+
+const HISTOGRAM_METRIC_NAMES: Record<HistogramMetric, [string, string]> = {
+  cpuUsage: ["judge_sandbox_cpu_usage_ms", "CPU time of sandboxed runs"],
+  memoryPeak: ["judge_sandbox_memory_peak_kib", "Peak memory of sandboxed runs"],
+  majorFaults: ["judge_sandbox_major_faults", "Major page faults of sandboxed runs"],
+  cpuPressure: ["judge_sandbox_cpu_pressure_ms", "Time some processes of sandboxed runs stalled on CPU"],
+  memoryPressure: ["judge_sandbox_memory_pressure_ms", "Time some processes of sandboxed runs stalled on memory"],
+  ioPressure: ["judge_sandbox_io_pressure_ms", "Time some processes of sandboxed runs stalled on IO"]
+};
+
+registerCollector(() =>
+  Object.entries(HISTOGRAM_METRIC_NAMES).flatMap(([metric, [name, help]]) => [
+    `# HELP ${name} ${help}`,
+    `# TYPE ${name} histogram`,
+    ...[...histograms].flatMap(([kind, kindHistograms]) => {
+      const histogram = kindHistograms[metric as HistogramMetric];
+      let cumulative = 0;
+      const buckets = histogram.buckets.map((count, i): [number, number] => [2 ** i, (cumulative += count)]);
+      return formatHistogram(name, { kind }, buckets, histogram.count, histogram.sum);
+    })
+  ])
+);
+
+function logHistograms() {
+  histograms.forEach((kindHistograms, kind) => {
+    const summary = Object.entries(kindHistograms)
+      .map(([metric, histogram]) => `${metric} p50<=${histogram.quantile(0.5)} p99<=${histogram.quantile(0.99)}`)
+      .join(", ");
+    winston.info(`Diagnostics of ${kindHistograms.cpuUsage.count} ${kind} runs: ${summary}`);
+  });
+}
+
+if (config.diagnostics?.logInterval) setInterval(logHistograms, config.diagnostics.logInterval * 1000).unref();
+
+export interface DiagnosticsCollector {
+  /**
+   * Stop sampling and return the diagnostics, or null if unavailable (e.g. not on cgroup v2). It's safe to call
+   * more than once.
+   */
+  stop(): SandboxDiagnostics;
+}
+
+/**
+ * Start sampling the cgroup of a sandbox. Return null if diagnostics are disabled.
+ *
+ * @param kind The kind of the sandboxed run, e.g. the CPU affinity strategy, for the node's histograms.
+ */
+export function startDiagnostics(pid: number, kind: string): DiagnosticsCollector {
+  if (!config.diagnostics) return null;
+
+  const sampler = monitor.startCgroupSampler(pid, config.diagnostics.interval);
+
+  let stopped = false;
+  let result: SandboxDiagnostics = null;
+  return {
+    stop: () => {
+      if (stopped) return result;
+      stopped = true;
+
+      const stats = sampler.stop();
+      if (!stats) return null;
+
+      result = {
+        cpu: {
+          usage: stats.cpuUsage / 1e3,
+          user: stats.cpuUser / 1e3,
+          system: stats.cpuSystem / 1e3,
+          throttled: stats.cpuThrottled / 1e3
+        },
+        memory: {
+          peak: stats.memoryPeak / 1024,
+          majorFaults: stats.majorFaults,
+          minorFaults: stats.minorFaults
+        },
+        io: {
+          readBytes: stats.ioReadBytes,
+          writeBytes: stats.ioWriteBytes,
+          readOperations: stats.ioReadOperations,
+          writeOperations: stats.ioWriteOperations
+        },
+        pressure: {
+          cpu: { some: stats.cpuPressureSome / 1e3, full: stats.cpuPressureFull / 1e3 },
+          memory: { some: stats.memoryPressureSome / 1e3, full: stats.memoryPressureFull / 1e3 },
+          io: { some: stats.ioPressureSome / 1e3, full: stats.ioPressureFull / 1e3 }
+        }
+      };
+      recordHistograms(kind, result);
+      return result;
+    }
+  };
+}
@@ -0,0 +1,227 @@
+import { AsyncLocalStorage } from "async_hooks";
+
+import bindings from "bindings";
+import winston from "winston";
+
+import config from "./config";
+import { traceNow } from "./tracing";
+import { Counter, registerEndpoint } from "./metrics";
+
+/**
+ * Always-on instrumentation of hot paths, which costs a few typed array stores per event instead of formatting a
+ * log message. Fixed-size binary events (time, event ID, task, 4 integer args) are written to a ring for each
+ * thread in a buffer shared with the native addons (see native/common/event_ring.h), the main thread writes the
+ * ring 0 here. The oldest events are overwritten when a ring is full.
+ *
+ * The events are decoded when drained: on demand from `/events` of the metrics server (as log lines, or a Chrome
+ * trace with `?format=trace`), or periodically to the verbose log with `eventRing.drainInterval`. Each drain also
+ * counts the events in the `judge_events_total` metric.
+ */
+
+// Keep in sync with native/common/event_ring.h
+export enum EventId {
+  FsOperation = 1,
+  BuiltinChecker = 2,
+  TestcaseRunning = 100,
+  TestcaseRerunning = 101,
+  TestcaseFinished = 102,
+  ReportProgress = 103
+}
+
+interface EventDefinition {
+  name: string;
+  args: string[];
+  // The args which are strings, see `eventString()`
+  stringArgs?: string[];
+  // If the first arg is the duration (in microseconds) from the event's time
+  span?: boolean;
+}
+
+// The sample testcases are recorded with `subtaskIndex = -1` and `testcaseIndex = sampleId`
+const EVENTS: Record<EventId, EventDefinition> = {
+  [EventId.FsOperation]: { name: "fs", args: ["duration", "operation"], stringArgs: ["operation"], span: true },
+  [EventId.BuiltinChecker]: { name: "builtinChecker", args: ["duration", "type"], stringArgs: ["type"], span: true },
+  [EventId.TestcaseRunning]: { name: "testcaseRunning", args: ["subtaskIndex", "testcaseIndex"] },
+  [EventId.TestcaseRerunning]: { name: "testcaseRerunning", args: ["subtaskIndex", "testcaseIndex"] },
+  [EventId.TestcaseFinished]: {
+    name: "testcaseFinished",
+    args: ["subtaskIndex", "testcaseIndex", "status", "time"],
+    stringArgs: ["status"]
+  },
+  [EventId.ReportProgress]: { name: "reportProgress", args: ["consumerThread"] }
+};
+
+const HEADER_SIZE = 64;
+const RING_HEADER_SIZE = 64;
+const EVENT_SIZE = 32;
+
+// The indexes in the Uint32Array of the buffer
+const MAIN_RING_WRITING = HEADER_SIZE / 4;
+const MAIN_RING_WRITTEN = MAIN_RING_WRITING + 1;
+const MAIN_RING_THREAD = MAIN_RING_WRITING + 3;
+const MAIN_RING_EVENTS = (HEADER_SIZE + RING_HEADER_SIZE) / 4;
+
+const addons = [bindings("fs_native"), bindings("builtin_checkers")];
+
+let buffer: ArrayBuffer;
+let float64: Float64Array;
+let uint32: Uint32Array;
+let int32: Int32Array;
+let capacityMask: number;
+
+// Strings passed as args are recorded as their indexes here, so they should be from a small set (e.g. statuses)
+const strings: string[] = [""];
+const stringIndexes: Map<string, number> = new Map([["", 0]]);
+
+export function eventString(value: string) {
+  let index = stringIndexes.get(value);
+  if (index == null) {
+    index = strings.push(value) - 1;
+    stringIndexes.set(value, index);
+  }
+  return index;
+}
+
+// The events are recorded with a task number instead of the task ID. The IDs of the recent tasks are kept.
+const MAX_TASK_IDS = 1024;
+const taskStorage = new AsyncLocalStorage<number>();
+const taskIds: Map<number, string> = new Map();
+let lastTaskNumber = 0;
+
+export function runWithEventTask<T>(taskId: string, callback: () => T): T {
+  const taskNumber = ++lastTaskNumber;
+  taskIds.set(taskNumber, taskId);
+  if (taskIds.size > MAX_TASK_IDS) taskIds.delete(taskIds.keys().next().value);
+  return taskStorage.run(taskNumber, callback);
+}
+
+export function getEventTask() {
+  return taskStorage.getStore() || 0;
+}
+
+export function recordEvent(id: EventId, arg0 = 0, arg1 = 0, arg2 = 0, arg3 = 0) {
+  if (!buffer) return;
+
+  const position = uint32[MAIN_RING_WRITTEN];
+  const index = MAIN_RING_EVENTS + (position & capacityMask) * (EVENT_SIZE / 4);
+  float64[index / 2] = traceNow();
+  uint32[index + 2] = id;
+  uint32[index + 3] = getEventTask();
+  int32[index + 4] = arg0;
+  int32[index + 5] = arg1;
+  int32[index + 6] = arg2;
+  int32[index + 7] = arg3;
+
+  // The drain is also on the main thread so no need to order them
+  uint32[MAIN_RING_WRITING] = uint32[MAIN_RING_WRITTEN] = position + 1;
+}
+
+export interface DecodedEvent {
+  // Microseconds of CLOCK_MONOTONIC
+  time: number;
+  thread: number;
+  name: string;
+  // `null` if not in a task, or the task is too old
+  taskId: string;
+  args: Record<string, string | number>;
+  span: boolean;
+}
+
+const eventsDrained = new Counter("judge_events_total", "Events drained from the event ring");
+const eventsLost = new Counter("judge_events_lost_total", "Events overwritten before drained from the event ring");
+
+export function drainEvents(): DecodedEvent[] {
+  if (!buffer) return [];
+
+  const drained: { events: ArrayBuffer; counts: number[]; threads: number[]; lost: number } =
+    addons[0].drainEventRing();
+  const eventsFloat64 = new Float64Array(drained.events);
+  const eventsUint32 = new Uint32Array(drained.events);
+  const eventsInt32 = new Int32Array(drained.events);
+
+  const result: DecodedEvent[] = [];
+  let index = 0;
+  drained.counts.forEach((count, ring) => {
+    for (let i = 0; i < count; i++, index += EVENT_SIZE / 4) {
+      const id: EventId = eventsUint32[index + 2];
+      const definition = EVENTS[id] || { name: `unknown${id}`, args: [] };
+      const args: DecodedEvent["args"] = {};
+      definition.args.forEach((name, j) => {
+        const value = eventsInt32[index + 4 + j];
+        args[name] = definition.stringArgs?.includes(name) ? strings[value] : value;
+      });
+
+      result.push({
+        time: eventsFloat64[index / 2],
+        thread: drained.threads[ring],
+        name: definition.name,
+        taskId: taskIds.get(eventsUint32[index + 3]) || null,
+        args,
+        span: !!definition.span
+      });
+      eventsDrained.inc({ event: definition.name });
+    }
+  });
+  if (drained.lost) eventsLost.inc({}, drained.lost);
+
+  return result.sort((a, b) => a.time - b.time);
+}
+
+export function formatEvent(event: DecodedEvent) {
+  const args = Object.entries(event.args).map(([name, value]) => `${name}=${value}`);
+  const task = event.taskId ? ` task ${event.taskId}` : "";
+  return `${(event.time / 1e3).toFixed(3)}ms [${event.thread}]${task} ${event.name} ${args.join(" ")}`.trimEnd();
+}
+
+/**
+ * Convert the events to the Chrome trace event format, see tracing.ts.
+ */
+export function eventsToTrace(events: DecodedEvent[]) {
+  return {
+    traceEvents: events.map(event => {
+      const common = { name: event.name, cat: "event", ts: event.time, pid: 1, tid: event.thread };
+      const args = { ...event.args, taskId: event.taskId };
+      return event.span
+        ? { ...common, ph: "X", dur: event.args.duration, args }
+        : { ...common, ph: "i", s: "t", args };
+    }),
+    displayTimeUnit: "ms"
+  };
+}
+
+registerEndpoint("/events", query => {
+  const events = drainEvents();
+  return query.get("format") === "trace"
+    ? { contentType: "application/json", body: JSON.stringify(eventsToTrace(events)) }
+    : { contentType: "text/plain", body: events.map(event => `${formatEvent(event)}\n`).join("") };
+});
+
+/**
+ * Allocate the rings with the configured size and attach them to the native addons. No event is recorded before.
+ */
+export function startEventRing() {
+  const ringCount = config.eventRing?.rings || 32;
+  const ringCapacity = 2 ** Math.ceil(Math.log2(config.eventRing?.ringCapacity || 1024));
+
+  const newBuffer = new ArrayBuffer(HEADER_SIZE + ringCount * (RING_HEADER_SIZE + ringCapacity * EVENT_SIZE));
+  uint32 = new Uint32Array(newBuffer);
+  float64 = new Float64Array(newBuffer);
+  int32 = new Int32Array(newBuffer);
+  capacityMask = ringCapacity - 1;
+
+  uint32[0] = ringCount;
+  uint32[1] = ringCapacity;
+  // The ring 0 is written by the main thread here
+  uint32[2] = 1;
+  uint32[MAIN_RING_THREAD] = process.pid;
+
+  for (const addon of addons) addon.attachEventRing(newBuffer);
+  buffer = newBuffer;
+
+  if (config.eventRing?.drainInterval) {
+    setInterval(() => {
+      const events = drainEvents();
+      if (events.length > 0) winston.verbose(`Events:\n${events.map(formatEvent).join("\n")}`);
+    }, config.eventRing.drainInterval * 1000).unref();
+  }
+}
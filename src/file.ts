@@ -9,6 +9,8 @@ import config from "./config";
 import rpc from "./rpc";
 import * as fsNative from "./fsNative";
 import { download, safelyJoinPath } from "./utils";
+import { lockFile } from "./posixUtils";
+import { requestCacheDaemon } from "./cacheClient";
 
 const downloadingFiles: Map<string, Promise<void>> = new Map();
 const queue = new Queue(config.maxConcurrentDownloads, Infinity);
@@ -23,11 +25,29 @@ async function downloadFile(url: string, fileUuid: string) {
   await fsNative.ensureDir(tempDir);
 
   const tempFilename = safelyJoinPath(tempDir, fileUuid);
+  const persistFilename = safelyJoinPath(config.dataStore, fileUuid);
 
-  await download(url, tempFilename, `testdata file ${fileUuid}`);
+  if (!config.cacheDaemon) {
+    await download(url, tempFilename, `testdata file ${fileUuid}`);
+    await fs.promises.rename(tempFilename, persistFilename);
+    return;
+  }
 
-  const persistFilename = safelyJoinPath(config.dataStore, fileUuid);
-  await fs.promises.rename(tempFilename, persistFilename);
+  // The data store is shared by the judge processes on the same host with the cache daemon, the file may be downloaded
+  // by another one while waiting for the lock
+  const lockFilename = `${tempFilename}.lock`;
+  const lock = await lockFile(lockFilename);
+  try {
+    if (!(await fsNative.exists(persistFilename))) {
+      await download(url, tempFilename, `testdata file ${fileUuid}`);
+      await fs.promises.rename(tempFilename, persistFilename);
+    }
+
+    // Safe to remove once the file exists, since whoever locks it (or a new one) finds the file and returns
+    await fsNative.remove(lockFilename);
+  } finally {
+    await lock.close();
+  }
 }
 
 export async function ensureFiles(fileUuids: string[]) {
@@ -92,6 +112,14 @@ export async function getFileHash(fileUuid: string) {
 
   if (fileHashCache.has(fileUuid)) return await fileHashCache.get(fileUuid);
 
+  // The files are hashed once for all judge processes on the same host with the cache daemon
+  if (config.cacheDaemon) {
+    const promise = requestCacheDaemon<string>("getFileHash", { fileUuid });
+    fileHashCache.set(fileUuid, promise);
+    promise.catch(() => fileHashCache.delete(fileUuid));
+    return await promise;
+  }
+
   const promise = new Promise<string>((resolve, reject) => {
     const hash = crypto.createHash("sha256");
 
@@ -1,16 +1,28 @@
 import bindings from "bindings";
 
+// These import config, which imports this module to prepare its directories. So they're loaded before config is,
+// and must not read it on loading; each has a start function called from index.ts once config is loaded.
+import { createNativeTiming, traceNativeSpan } from "./tracing";
+import { threadpoolOperationStarted, threadpoolOperationFinished } from "./metrics";
+
 const fsNative = bindings("fs_native");
 
 /* eslint-disable */
 // Native exceptions have no callback stacks. Make a new error object with the stack.
-function wrap(func: Function, async: boolean): any {
+// Async operations are traced, measured and recorded to the event ring with the time they run on the worker thread.
+function wrap(name: string, async: boolean): any {
+  const func: Function = fsNative[name];
   return async
     ? async (...args: any[]) => {
+        const timing = createNativeTiming(name);
+        threadpoolOperationStarted();
         try {
-          return await func(...args);
+          return await func(...args, timing);
         } catch (e) {
           throw new Error(e.message);
+        } finally {
+          threadpoolOperationFinished(`fs.${name}`, timing);
+          traceNativeSpan(`fs.${name}`, "fs", timing, { path: args[0] });
         }
       }
     : (...args: any[]) => {
@@ -23,23 +35,23 @@ function wrap(func: Function, async: boolean): any {
 }
 /* eslint-enable */
 
-export const remove: (path: string) => Promise<void> = wrap(fsNative.remove, true);
-export const removeSync: (path: string) => void = wrap(fsNative.removeSync, false);
+export const remove: (path: string) => Promise<void> = wrap("remove", true);
+export const removeSync: (path: string) => void = wrap("removeSync", false);
 
-export const copy: (src: string, dst: string) => Promise<void> = wrap(fsNative.copy, true);
-export const copySync: (src: string, dst: string) => void = wrap(fsNative.copySync, false);
+export const copy: (src: string, dst: string) => Promise<void> = wrap("copy", true);
+export const copySync: (src: string, dst: string) => void = wrap("copySync", false);
 
-export const exists: (path: string) => Promise<boolean> = wrap(fsNative.exists, true);
-export const existsSync: (path: string) => boolean = wrap(fsNative.existsSync, false);
+export const exists: (path: string) => Promise<boolean> = wrap("exists", true);
+export const existsSync: (path: string) => boolean = wrap("existsSync", false);
 
-export const ensureDir: (path: string) => Promise<void> = wrap(fsNative.ensureDir, true);
-export const ensureDirSync: (path: string) => void = wrap(fsNative.ensureDirSync, false);
+export const ensureDir: (path: string) => Promise<void> = wrap("ensureDir", true);
+export const ensureDirSync: (path: string) => void = wrap("ensureDirSync", false);
 
-export const emptyDir: (path: string) => Promise<void> = wrap(fsNative.emptyDir, true);
-export const emptyDirSync: (path: string) => void = wrap(fsNative.emptyDirSync, false);
+export const emptyDir: (path: string) => Promise<void> = wrap("emptyDir", true);
+export const emptyDirSync: (path: string) => void = wrap("emptyDirSync", false);
 
-export const calcSize: (path: string) => Promise<number> = wrap(fsNative.calcSize, true);
-export const calcSizeSync: (path: string) => number = wrap(fsNative.calcSizeSync, false);
+export const calcSize: (path: string) => Promise<number> = wrap("calcSize", true);
+export const calcSizeSync: (path: string) => number = wrap("calcSizeSync", false);
 
 export interface ChmodownOptions {
   mode?: number;
@@ -51,5 +63,5 @@ export interface ChmodownOptions {
   group?: string | number | boolean;
 }
 
-export const chmodown: (path: string, options: ChmodownOptions) => Promise<void> = wrap(fsNative.chmodown, true);
-export const chmodownSync: (path: string, options: ChmodownOptions) => void = wrap(fsNative.chmodownSync, false);
+export const chmodown: (path: string, options: ChmodownOptions) => Promise<void> = wrap("chmodown", true);
+export const chmodownSync: (path: string, options: ChmodownOptions) => void = wrap("chmodownSync", false);
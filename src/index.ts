@@ -1,14 +1,30 @@
 import "reflect-metadata";
 import * as winston from "winston";
 
-import config from "./config";
+import config, { isCacheDaemon } from "./config";
 import rpc from "./rpc";
+import { startTimingMonitor } from "./timingMonitor";
+import { startTracing } from "./tracing";
+import { startMetricsServer } from "./metrics";
+import { startEventRing } from "./eventRing";
+import { startCacheDaemon } from "./cacheDaemon";
+import { startCalibration } from "./calibration";
 
 if (process.getuid() !== 0) {
   winston.error("This program requires root to run");
   process.exit(1);
 }
 
-rpc.connect().then(() => {
-  for (let i = 0; i < config.taskConsumingThreads; i++) rpc.startTaskConsumerThread(i);
-});
+if (isCacheDaemon) {
+  startCacheDaemon();
+} else {
+  startTimingMonitor();
+  startTracing();
+  startMetricsServer();
+  startEventRing();
+
+  rpc.connect().then(async () => {
+    await startCalibration(() => rpc.reportSystemInfo());
+    for (let i = 0; i < config.taskConsumingThreads; i++) rpc.startTaskConsumerThread(i);
+  });
+}
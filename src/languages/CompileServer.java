@@ -0,0 +1,55 @@
+import java.io.BufferedReader;
+import java.io.FileOutputStream;
+import java.io.InputStreamReader;
+import java.io.PrintStream;
+import java.lang.reflect.Method;
+import java.util.ArrayList;
+import java.util.Arrays;
+import java.util.List;
+
+/**
+ * Keep a compiler warm in one JVM, see src/compileServer.ts. Each line of stdin is a compilation,
+ * "<message file>\t<argument>\t<argument>...", compiled with the extra arguments of the command line appended and
+ * answered with the compiler's exit code in a line of stdout.
+ *
+ * Usage: java -cp <compiler's classpath> CompileServer.java kotlin [extra arguments...]
+ */
+public class CompileServer {
+    interface CompileFunction {
+        int compile(PrintStream messages, String[] arguments) throws Exception;
+    }
+
+    static CompileFunction getCompiler(String name) throws Exception {
+        if (name.equals("kotlin")) {
+            // Not a compile-time dependency, it's in the classpath of kotlin-compiler.jar
+            Class<?> compilerClass = Class.forName("org.jetbrains.kotlin.cli.jvm.K2JVMCompiler");
+            Method exec = compilerClass.getMethod("exec", PrintStream.class, String[].class);
+            Method getCode = Class.forName("org.jetbrains.kotlin.cli.common.ExitCode").getMethod("getCode");
+            return (messages, arguments) -> {
+                Object exitCode = exec.invoke(compilerClass.getConstructor().newInstance(), messages, arguments);
+                return (Integer) getCode.invoke(exitCode);
+            };
+        }
+        throw new IllegalArgumentException("Unknown compiler " + name);
+    }
+
+    public static void main(String[] args) throws Exception {
+        CompileFunction compiler = getCompiler(args[0]);
+        List<String> extraArguments = Arrays.asList(args).subList(1, args.length);
+
+        BufferedReader requests = new BufferedReader(new InputStreamReader(System.in, "UTF-8"));
+        String request;
+        while ((request = requests.readLine()) != null) {
+            String[] fields = request.split("\t", -1);
+            List<String> arguments = new ArrayList<>(Arrays.asList(fields).subList(1, fields.length));
+            arguments.addAll(extraArguments);
+
+            int exitCode;
+            try (PrintStream messages = new PrintStream(new FileOutputStream(fields[0]), true, "UTF-8")) {
+                exitCode = compiler.compile(messages, arguments.toArray(new String[0]));
+            }
+            System.out.println(exitCode);
+            System.out.flush();
+        }
+    }
+}
@@ -0,0 +1,23 @@
+#!/bin/bash
+
+# Build the precompiled header of bits/stdc++.h with g++
+# GCC looks for "bits/stdc++.h.gch" in each include directory before "bits/stdc++.h", so the output directory is
+# passed to the compilations with "-I" and the precompiled header is used if its options match
+#
+# $1: The absolute path of destination directory
+# $2...: The compiler and its options, the same as the compilations' (without the source file and "-o")
+#
+# stderr: The output of the compiler
+
+OUTPUT_DIRECTORY="$1"
+shift
+
+# The header differs with the options (e.g. "-m32"), find it the same way as the compilations
+HEADER=$(echo "#include <bits/stdc++.h>" | "$@" -x c++ -M - | tr ' ' '\n' | grep '/bits/stdc++\.h$' | head -n 1)
+if [ -z "$HEADER" ]; then
+    echo "bits/stdc++.h not found" >&2
+    exit 1
+fi
+
+mkdir -p "$OUTPUT_DIRECTORY/bits"
+exec "$@" -x c++-header "$HEADER" -o "$OUTPUT_DIRECTORY/bits/stdc++.h.gch"
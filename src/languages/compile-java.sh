@@ -1,7 +1,8 @@
 #!/bin/bash
 
 # Compile a Java program with any name
-# If the public class name doesn't match, it will be extracted from the error message with a perl regexp:
+# The judge names the source file after its public class (see javaSource.ts), so it's compiled once normally
+# If the public class name still doesn't match, it will be extracted from the error message with a perl regexp:
 #
 # Main.java:3: error: class ClassName is public, should be declared in a file named ClassName.java
 #
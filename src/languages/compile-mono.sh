@@ -0,0 +1,64 @@
+#!/bin/bash
+
+# Compile a C# or F# program, and then (if enabled) compile the assembly ahead of time with "mono --aot"
+# The AOT image "Main.exe.so" is loaded by mono automatically instead of JIT-compiling the code in each run
+# It's only an optimization, so it's removed if failed, timed out or it makes the binary directory exceed the size limit
+#
+# $1: "aot" to compile ahead of time, or "jit"
+# $2: The absolute path of the compiled assembly
+# $3: The binary size limit in bytes
+# $4: The time limit (ms) of the compiler, the same with or without AOT
+# $5: The extra time (ms) of the AOT compiler, the sandbox's time limit is the sum of them
+# $6...: The compiler and its arguments
+#
+# stdout & stderr: The stdout & stderr of the compiler
+
+AOT="$1"
+ASSEMBLY="$2"
+BINARY_SIZE_LIMIT="$3"
+COMPILER_TIME_LIMIT="$4"
+AOT_TIME_LIMIT="$5"
+shift 5
+
+# Set COMPILER_TIME to the CPU time (ms) of the finished children of this shell
+# "times" must run in this shell (not in a command substitution) to report them
+measure_compiler_time() {
+    local TIMES_FILE
+    TIMES_FILE="$(mktemp)"
+    times > "$TIMES_FILE"
+    COMPILER_TIME="$(awk 'NR == 2 { gsub(/s/, ""); split($1, u, "m"); split($2, s, "m"); print int((u[1] * 60 + u[2] + s[1] * 60 + s[2]) * 1000) }' "$TIMES_FILE")"
+    rm -f "$TIMES_FILE"
+}
+
+if [ "$AOT" != "aot" ]; then
+    # The sandbox's time limit is the compiler's
+    "$@" || exit $?
+    exit 0
+fi
+
+# The sandbox's time limit includes the AOT compiler's, so the compiler is limited here, to the same CPU time as without
+# AOT: by the process's CPU time limit (in whole seconds) while running, and the total of its processes after it exits
+( ulimit -S -t "$(((COMPILER_TIME_LIMIT + 999) / 1000))" && exec "$@" )
+CODE=$?
+measure_compiler_time
+if [ "$CODE" -eq 152 ] || [ "$COMPILER_TIME" -gt "$COMPILER_TIME_LIMIT" ]; then
+    # 152 is killed by SIGXCPU of the CPU time limit
+    echo "The compiler exceeded the time limit (${COMPILER_TIME_LIMIT} ms)." >&2
+    exit 1
+fi
+[ "$CODE" -eq 0 ] || exit "$CODE"
+
+# Leave a second for the rest of the script, the AOT compiler is single-threaded so its CPU time is within the wall time
+REMAINING_TIME=$((COMPILER_TIME_LIMIT + AOT_TIME_LIMIT - COMPILER_TIME - 1000))
+
+# The output of the AOT compiler is not for user
+if [ "$REMAINING_TIME" -le 0 ]; then
+    rm -f "$ASSEMBLY.so"
+elif ! timeout -s KILL "$((REMAINING_TIME / 1000)).$(printf "%03d" $((REMAINING_TIME % 1000)))" \
+             mono --aot -O=all "$ASSEMBLY" > /dev/null 2>&1; then
+    rm -f "$ASSEMBLY.so"
+elif [ "$(du -sb "$(dirname "$ASSEMBLY")" | cut -f 1)" -gt "$BINARY_SIZE_LIMIT" ]; then
+    rm -f "$ASSEMBLY.so"
+fi
+
+exit 0
@@ -0,0 +1,17 @@
+#!/bin/bash
+
+# Start CompileServer.java to keep the Kotlin compiler warm in one JVM
+#
+# $1: The compile server's directory, with CompileServer.java
+# $2: "kotlin"
+#
+# stdin & stdout: The requests and responses of the compile server
+
+if [ "$2" == "kotlin" ]; then
+    KOTLIN_HOME="$(dirname "$(dirname "$(readlink -f "$(command -v kotlinc)")")")"
+    exec java -Xmx512M -Xss4M -Dkotlin.colors.enabled=true -cp "$KOTLIN_HOME/lib/kotlin-compiler.jar" \
+              "$1/CompileServer.java" kotlin -kotlin-home "$KOTLIN_HOME"
+fi
+
+echo "Unknown compiler $2" >&2
+exit 1
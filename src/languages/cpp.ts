@@ -1,3 +1,6 @@
+import fs from "fs";
+import path from "path";
+
 import { LanguageConfig } from ".";
 
 interface CompileAndRunOptionsCpp {
@@ -7,27 +10,37 @@ interface CompileAndRunOptionsCpp {
   m: string;
 }
 
+// This script builds the precompiled header of bits/stdc++.h with the same options as the compilations
+const buildPrecompiledHeaderScript = fs.readFileSync(path.resolve(__dirname, "build-pch-cpp.sh"), "utf-8");
+
+function getCompilerOptions(compileAndRunOptions: CompileAndRunOptionsCpp) {
+  return [
+    `-std=${compileAndRunOptions.std}`,
+    `-O${compileAndRunOptions.O}`,
+    "-fdiagnostics-color=always",
+    "-DONLINE_JUDGE",
+    "-Wall",
+    "-Wextra",
+    "-Wno-unused-result",
+    compileAndRunOptions.compiler === "clang++" && compileAndRunOptions.m === "64" ? "-stdlib=libc++" : null,
+    `-m${compileAndRunOptions.m}`,
+    "-march=native"
+  ];
+}
+
 export const languageConfig: LanguageConfig<CompileAndRunOptionsCpp> = {
   name: "cpp",
   getMetaOptions: () => ({
     sourceFilename: "main.cpp",
     binarySizeLimit: 5 * 1024 * 1024 // 5 MiB, enough unless someone initlizes globals badly
   }),
-  compile: ({ sourcePathInside, binaryDirectoryInside, compileAndRunOptions }) => ({
+  compile: ({ sourcePathInside, binaryDirectoryInside, compileAndRunOptions, precompiledHeaderDirectoryInside }) => ({
     executable: compileAndRunOptions.compiler === "g++" ? "g++" : "clang++",
     parameters: [
       "-o",
       `${binaryDirectoryInside}/a.out`,
-      `-std=${compileAndRunOptions.std}`,
-      `-O${compileAndRunOptions.O}`,
-      "-fdiagnostics-color=always",
-      "-DONLINE_JUDGE",
-      "-Wall",
-      "-Wextra",
-      "-Wno-unused-result",
-      compileAndRunOptions.compiler === "clang++" && compileAndRunOptions.m === "64" ? "-stdlib=libc++" : null,
-      `-m${compileAndRunOptions.m}`,
-      "-march=native",
+      ...getCompilerOptions(compileAndRunOptions),
+      ...(precompiledHeaderDirectoryInside ? ["-I", precompiledHeaderDirectoryInside] : []),
       sourcePathInside
     ],
     time: 10000,
@@ -38,6 +51,26 @@ export const languageConfig: LanguageConfig<CompileAndRunOptionsCpp> = {
     messageFile: "message.txt",
     workingDirectory: binaryDirectoryInside
   }),
+  // Only with g++, which finds the precompiled header in the include directories itself
+  precompiledHeader: {
+    getKey: (compileAndRunOptions, code) =>
+      compileAndRunOptions.compiler === "g++" && /^\s*#\s*include\s*<bits\/stdc\+\+\.h>/m.test(code)
+        ? getCompilerOptions(compileAndRunOptions).join(" ")
+        : null,
+    build: ({ outputDirectoryInside, compileAndRunOptions }) => ({
+      script: buildPrecompiledHeaderScript,
+      parameters: [outputDirectoryInside, "g++", ...getCompilerOptions(compileAndRunOptions)],
+      time: 60000,
+      memory: 1024 * 1024 * 1024 * 2,
+      process: 20,
+      stdout: `${outputDirectoryInside}/message.txt`,
+      stderr: `${outputDirectoryInside}/message.txt`,
+      messageFile: "message.txt",
+      workingDirectory: outputDirectoryInside
+    }),
+    // The diagnostics in the headers miss the "from main.cpp:1" of the include stack with the precompiled header
+    isMessageAffected: message => message.includes("In file included from") || message.includes("bits/stdc++.h")
+  },
   run: ({ binaryDirectoryInside, stdinFile, stdoutFile, stderrFile, parameters }) => ({
     executable: `${binaryDirectoryInside}/a.out`,
     parameters,
@@ -1,4 +1,7 @@
 import { LanguageConfig } from ".";
+import { getMonoCompileOptions } from "./mono";
+
+const BINARY_SIZE_LIMIT = 10 * 1024 * 1024; // 10 MiB
 
 interface CompileAndRunOptionsCSharp {
   version: string;
@@ -8,17 +11,16 @@ export const languageConfig: LanguageConfig<CompileAndRunOptionsCSharp> = {
   name: "csharp",
   getMetaOptions: () => ({
     sourceFilename: "Main.cs",
-    binarySizeLimit: 10 * 1024 * 1024 // 10 MiB
+    binarySizeLimit: BINARY_SIZE_LIMIT
   }),
   compile: ({ sourcePathInside, binaryDirectoryInside, compileAndRunOptions }) => ({
-    executable: "csc",
-    parameters: [
+    ...getMonoCompileOptions(binaryDirectoryInside, BINARY_SIZE_LIMIT, 10000, [
+      "csc",
       "-nologo",
       `-langversion:${compileAndRunOptions.version}`,
       `-out:${binaryDirectoryInside}/Main.exe`,
       sourcePathInside
-    ],
-    time: 10000,
+    ]),
     memory: 1024 * 1024 * 1024 * 2,
     process: 20,
     stdout: `${binaryDirectoryInside}/message.txt`,
@@ -1,4 +1,7 @@
 import { LanguageConfig } from ".";
+import { getMonoCompileOptions } from "./mono";
+
+const BINARY_SIZE_LIMIT = 10 * 1024 * 1024; // 10 MiB
 
 interface CompileAndRunOptionsFSharp {}
 
@@ -6,12 +9,15 @@ export const languageConfig: LanguageConfig<CompileAndRunOptionsFSharp> = {
   name: "fsharp",
   getMetaOptions: () => ({
     sourceFilename: "Main.fs",
-    binarySizeLimit: 10 * 1024 * 1024 // 10 MiB
+    binarySizeLimit: BINARY_SIZE_LIMIT
   }),
   compile: ({ sourcePathInside, binaryDirectoryInside }) => ({
-    executable: "fsharpc",
-    parameters: ["--nologo", `--out:${binaryDirectoryInside}/Main.exe`, sourcePathInside],
-    time: 10000,
+    ...getMonoCompileOptions(binaryDirectoryInside, BINARY_SIZE_LIMIT, 10000, [
+      "fsharpc",
+      "--nologo",
+      `--out:${binaryDirectoryInside}/Main.exe`,
+      sourcePathInside
+    ]),
     memory: 1024 * 1024 * 1024 * 2,
     process: 20,
     stdout: `${binaryDirectoryInside}/message.txt`,
@@ -8,7 +8,13 @@ export interface LanguageConfig<T> {
    */
   name: string;
 
-  getMetaOptions: (compileAndRunOptions: T) => {
+  getMetaOptions: (
+    compileAndRunOptions: T,
+    /**
+     * The user submitted source code, e.g. to name the source file after its public class
+     */
+    code: string
+  ) => {
     /**
      * The user submitted source file will be named with the name e.g. "main.cpp"
      */
@@ -39,8 +45,55 @@ export interface LanguageConfig<T> {
      * Custom options passed by user
      */
     compileAndRunOptions: T;
+    /**
+     * The directory of the precompiled header built by `precompiledHeader.build()`, if any
+     */
+    precompiledHeaderDirectoryInside?: string;
   }) => CompilationConfig;
 
+  /**
+   * A precompiled header shared by the compilations with the same options, built once and cached.
+   */
+  precompiledHeader?: {
+    /**
+     * Return the key of the options the precompiled header depends on, or `null` if it's not used by the code.
+     */
+    getKey: (compileAndRunOptions: T, code: string) => string;
+    /**
+     * Return the options for building the precompiled header into `outputDirectoryInside` in the sandbox.
+     */
+    build: (options: { outputDirectoryInside: string; compileAndRunOptions: T }) => CompilationConfig;
+    /**
+     * If the compiler's message could differ from the one without the precompiled header, the code will be compiled
+     * again without it.
+     */
+    isMessageAffected: (message: string) => boolean;
+  };
+
+  /**
+   * A persistent compiler (e.g. the Kotlin compiler in a warm JVM) in a long-lived sandbox, fed the compilations one
+   * at a time instead of starting the compiler for each, with `config.compileServers`. See compileServer.ts.
+   */
+  compileServer?: {
+    /**
+     * Return the options for starting the compile server, in `serverDirectoryInside` with the `files` written
+     * there. Its stdin and stdout are the requests and responses. `time` is the time limit of each compilation.
+     */
+    start: (options: { serverDirectoryInside: string }) => TaskIndependentSandboxConfig & {
+      time: number;
+      memory: number;
+      files?: Record<string, string>;
+    };
+    /**
+     * Return the compiler's arguments of a compilation.
+     */
+    getArguments: (options: {
+      sourcePathInside: string;
+      binaryDirectoryInside: string;
+      compileAndRunOptions: T;
+    }) => string[];
+  };
+
   /**
    * Return the options for running the compiled program in the sandbox.
    *
@@ -2,18 +2,21 @@ import fs from "fs";
 import path from "path";
 
 import { LanguageConfig } from ".";
+import { getClassDataSharingOptions } from "./jvm";
+import { findPublicClassName } from "./javaSource";
 
 interface CompileAndRunOptionsJava {}
 
-// This script renames the source file to the expected name (if necessary) automatically
+// The source file is named after its public class found by `findPublicClassName()` so javac runs once
+// This script still renames the source file to the expected name (if necessary) automatically, if that's wrong
 // The result file's name with ".class" suffix removed will be written to stdout (the extra info file)
 // So we execute "javac -classpath /binary/directory/inside extraInfoFileContent"
 const compileScript = fs.readFileSync(path.resolve(__dirname, "compile-java.sh"), "utf-8");
 
 export const languageConfig: LanguageConfig<CompileAndRunOptionsJava> = {
   name: "java",
-  getMetaOptions: () => ({
-    sourceFilename: "Main.java",
+  getMetaOptions: (compileAndRunOptions, code) => ({
+    sourceFilename: `${findPublicClassName(code) || "Main"}.java`,
     binarySizeLimit: 5 * 1024 * 1024 // 5 MiB
   }),
   compile: ({ sourcePathInside, binaryDirectoryInside }) => ({
@@ -30,7 +33,13 @@ export const languageConfig: LanguageConfig<CompileAndRunOptionsJava> = {
   }),
   run: ({ binaryDirectoryInside, stdinFile, stdoutFile, stderrFile, parameters, compileResultExtraInfo }) => ({
     executable: "java",
-    parameters: ["-classpath", binaryDirectoryInside, compileResultExtraInfo, ...(parameters || [])],
+    parameters: [
+      ...getClassDataSharingOptions(),
+      "-classpath",
+      binaryDirectoryInside,
+      compileResultExtraInfo,
+      ...(parameters || [])
+    ],
     process: 20,
     stdin: stdinFile,
     stdout: stdoutFile,
@@ -0,0 +1,62 @@
+// The keywords declaring a top-level type, `record` is contextual but can't be anything else after `public`
+const TYPE_KEYWORDS = ["class", "interface", "enum", "record"];
+
+const IDENTIFIER_CHAR = /[\p{L}\p{N}_$]/u;
+
+// Leave room for ".java" in a filename of 255 bytes
+const MAX_NAME_BYTES = 250;
+
+/**
+ * Find the name of the public top-level class (or interface, enum, record) of a Java source, skipping the comments,
+ * strings, characters and anything nested in braces (e.g. the public nested classes). Return `null` if not found,
+ * e.g. there's none, it's written with Unicode escapes, or it's too long for a filename.
+ */
+export function findPublicClassName(code: string): string {
+  let depth = 0;
+  // Seen `public` in the current top-level declaration
+  let isPublic = false;
+  // The last token is a type keyword after `public`
+  let expectingName = false;
+
+  let i = 0;
+  while (i < code.length) {
+    const char = code[i];
+
+    if (char === "/" && code[i + 1] === "/") {
+      const end = code.indexOf("\n", i);
+      i = end === -1 ? code.length : end + 1;
+    } else if (char === "/" && code[i + 1] === "*") {
+      const end = code.indexOf("*/", i + 2);
+      i = end === -1 ? code.length : end + 2;
+    } else if (char === '"' && code.startsWith('"""', i)) {
+      // A text block, where a single quote doesn't end it
+      let end = i + 3;
+      while (end < code.length && !code.startsWith('"""', end)) end += code[end] === "\\" ? 2 : 1;
+      i = end + 3;
+    } else if (char === '"' || char === "'") {
+      let end = i + 1;
+      while (end < code.length && code[end] !== char && code[end] !== "\n") end += code[end] === "\\" ? 2 : 1;
+      i = end + 1;
+    } else if (IDENTIFIER_CHAR.test(char)) {
+      let end = i + 1;
+      while (end < code.length && IDENTIFIER_CHAR.test(code[end])) end++;
+      const word = code.slice(i, end);
+      i = end;
+
+      if (depth !== 0) continue;
+      if (expectingName) return /^\p{N}/u.test(word) || Buffer.byteLength(word) > MAX_NAME_BYTES ? null : word;
+      if (word === "public") isPublic = true;
+      else if (isPublic && TYPE_KEYWORDS.includes(word)) expectingName = true;
+    } else {
+      if (char === "{") depth++;
+      else if (char === "}") depth = Math.max(0, depth - 1);
+
+      // A top-level declaration ends with its body or a semicolon (e.g. an import)
+      if ((char === "{" && depth === 1) || (char === ";" && depth === 0)) isPublic = false;
+      if (expectingName && !/\s/.test(char)) expectingName = false;
+      i++;
+    }
+  }
+
+  return null;
+}
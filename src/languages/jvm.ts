@@ -0,0 +1,41 @@
+import fs from "fs";
+import path from "path";
+
+import config from "@/config";
+import { safelyJoinPath } from "@/utils";
+
+// Dumped by rootfs-update/update.sh with the classes commonly used by Java and Kotlin programs
+export const CLASS_DATA_SHARING_ARCHIVE = "/usr/local/lib/lyrio/java-base.jsa";
+
+let classDataSharingEnabled: boolean;
+
+/**
+ * The JVM options to map the class data sharing archive of the rootfs (if it exists), so the common classes are
+ * not loaded and verified again in each run. The JVM ignores it if it doesn't match the JDK.
+ */
+export function getClassDataSharingOptions(): string[] {
+  if (classDataSharingEnabled == null)
+    classDataSharingEnabled = fs.existsSync(safelyJoinPath(config.sandbox.rootfs, CLASS_DATA_SHARING_ARCHIVE));
+
+  return classDataSharingEnabled ? [`-XX:SharedArchiveFile=${CLASS_DATA_SHARING_ARCHIVE}`, "-Xshare:auto"] : [];
+}
+
+// bench/startup.ts runs Java and Kotlin with and without the archive, regardless of the rootfs
+export function setClassDataSharingEnabled(enabled: boolean) {
+  classDataSharingEnabled = enabled;
+}
+
+// This script starts CompileServer.java (written to the compile server's directory) with the compiler
+const compileServerScript = fs.readFileSync(path.resolve(__dirname, "compile-server-jvm.sh"), "utf-8");
+const compileServerSource = fs.readFileSync(path.resolve(__dirname, "CompileServer.java"), "utf-8");
+
+/**
+ * The options to start a compile server keeping the Kotlin compiler warm in one JVM.
+ */
+export function getJvmCompileServerOptions(compiler: "kotlin", serverDirectoryInside: string) {
+  return {
+    script: compileServerScript,
+    parameters: [serverDirectoryInside, compiler],
+    files: { "CompileServer.java": compileServerSource }
+  };
+}
@@ -1,10 +1,18 @@
+import config from "@/config";
+
 import { LanguageConfig } from ".";
+import { getClassDataSharingOptions, getJvmCompileServerOptions } from "./jvm";
 
 interface CompileAndRunOptionsKotlin {
   version: string;
   platform: string;
 }
 
+function getJavaOptsEnvironment(): Record<string, string> {
+  const javaOpts = [config.sandbox.environments?.JAVA_OPTS, ...getClassDataSharingOptions()].filter(Boolean);
+  return javaOpts.length > 0 ? { JAVA_OPTS: javaOpts.join(" ") } : {};
+}
+
 export const languageConfig: LanguageConfig<CompileAndRunOptionsKotlin> = {
   name: "kotlin",
   getMetaOptions: () => ({
@@ -29,9 +37,26 @@ export const languageConfig: LanguageConfig<CompileAndRunOptionsKotlin> = {
     messageFile: "message.txt",
     workingDirectory: binaryDirectoryInside
   }),
+  compileServer: {
+    start: ({ serverDirectoryInside }) => ({
+      ...getJvmCompileServerOptions("kotlin", serverDirectoryInside),
+      time: 20000,
+      memory: 1024 * 1024 * 1024 * 2,
+      process: 50
+    }),
+    getArguments: ({ sourcePathInside, binaryDirectoryInside, compileAndRunOptions }) => [
+      sourcePathInside,
+      "-d",
+      binaryDirectoryInside,
+      "-language-version",
+      compileAndRunOptions.version
+    ]
+  },
   run: ({ binaryDirectoryInside, stdinFile, stdoutFile, stderrFile, parameters }) => ({
     executable: "kotlin",
     parameters: ["-classpath", binaryDirectoryInside, "MainKt", ...(parameters || [])],
+    // The kotlin script passes JAVA_OPTS to the JVM, the configured one is kept (and not overridden if empty)
+    environments: getJavaOptsEnvironment(),
     process: 20,
     stdin: stdinFile,
     stdout: stdoutFile,
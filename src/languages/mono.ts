@@ -0,0 +1,46 @@
+import fs from "fs";
+import path from "path";
+
+import config from "@/config";
+
+// This script runs the compiler and then compiles the assembly ahead of time (if enabled)
+const compileScript = fs.readFileSync(path.resolve(__dirname, "compile-mono.sh"), "utf-8");
+
+let aotEnabled: boolean;
+
+// The extra CPU time (ms) of the compilation allowed for the AOT compiler
+const AOT_TIME_LIMIT = 10000;
+
+/**
+ * The options to compile a C# or F# program to `Main.exe` in the binary directory with the compiler command, and then
+ * compile it ahead of time with `config.monoAot`. The compiler keeps its time limit (checked by the script), and the
+ * AOT compiler gets its own time allowance, so a slow AOT compilation falls back to JIT instead of failing the
+ * compilation.
+ */
+export function getMonoCompileOptions(
+  binaryDirectoryInside: string,
+  binarySizeLimit: number,
+  time: number,
+  compiler: string[]
+) {
+  if (aotEnabled == null) aotEnabled = !!config.monoAot;
+
+  const aotTimeLimit = aotEnabled ? AOT_TIME_LIMIT : 0;
+  return {
+    script: compileScript,
+    parameters: [
+      aotEnabled ? "aot" : "jit",
+      `${binaryDirectoryInside}/Main.exe`,
+      String(binarySizeLimit),
+      String(time),
+      String(aotTimeLimit),
+      ...compiler
+    ],
+    time: time + aotTimeLimit
+  };
+}
+
+// bench/startup.ts compiles C# and F# both JIT and AOT, regardless of `config.monoAot`
+export function setAotEnabled(enabled: boolean) {
+  aotEnabled = enabled;
+}
@@ -0,0 +1,234 @@
+import fs from "fs";
+import http from "http";
+
+import winston from "winston";
+
+import config from "./config";
+
+/**
+ * Metrics of the judge node in the Prometheus text format, served on `metrics.port` at `/metrics`.
+ *
+ * The metrics are always collected (it's cheap), even the ones of the fs operations done while loading config,
+ * but only served by `startMetricsServer()` if configured.
+ */
+
+export type Labels = Record<string, string | number>;
+
+function formatLabels(labels: Labels) {
+  const entries = Object.entries(labels);
+  if (entries.length === 0) return "";
+  const escape = (value: string) => value.replace(/[\\"\n]/g, c => (c === "\n" ? "\\n" : `\\${c}`));
+  return `{${entries.map(([key, value]) => `${key}="${escape(String(value))}"`).join(",")}}`;
+}
+
+const collectors: (() => string[])[] = [];
+
+/**
+ * Register a function returning the lines of some metrics (including the HELP and TYPE lines) on each scrape.
+ */
+export function registerCollector(collector: () => string[]) {
+  collectors.push(collector);
+}
+
+abstract class Metric<T> {
+  protected readonly values: Map<string, { labels: Labels; value: T }> = new Map();
+
+  constructor(readonly name: string, readonly help: string, readonly type: "counter" | "gauge" | "histogram") {
+    registerCollector(() => [`# HELP ${name} ${help}`, `# TYPE ${name} ${type}`, ...this.collectValues()]);
+  }
+
+  protected getValue(labels: Labels, create: () => T) {
+    const key = formatLabels(labels);
+    let entry = this.values.get(key);
+    if (!entry) this.values.set(key, (entry = { labels, value: create() }));
+    return entry;
+  }
+
+  protected abstract collectValues(): string[];
+}
+
+export class Counter extends Metric<number> {
+  constructor(name: string, help: string) {
+    super(name, help, "counter");
+  }
+
+  inc(labels: Labels = {}, value = 1) {
+    this.getValue(labels, () => 0).value += value;
+  }
+
+  protected collectValues() {
+    return [...this.values.values()].map(({ labels, value }) => `${this.name}${formatLabels(labels)} ${value}`);
+  }
+}
+
+export class Gauge extends Metric<number> {
+  /**
+   * @param collect If passed, called on each scrape to get the values instead of the ones set.
+   */
+  constructor(name: string, help: string, private readonly collect?: () => [Labels, number][]) {
+    super(name, help, "gauge");
+  }
+
+  set(labels: Labels, value: number) {
+    this.getValue(labels, () => 0).value = value;
+  }
+
+  inc(labels: Labels = {}, value = 1) {
+    this.getValue(labels, () => 0).value += value;
+  }
+
+  protected collectValues() {
+    const values: [Labels, number][] = this.collect
+      ? this.collect()
+      : [...this.values.values()].map(({ labels, value }) => [labels, value]);
+    return values.map(([labels, value]) => `${this.name}${formatLabels(labels)} ${value}`);
+  }
+}
+
+// In seconds
+const DEFAULT_BUCKETS = [0.001, 0.005, 0.01, 0.025, 0.05, 0.1, 0.25, 0.5, 1, 2.5, 5, 10, 30];
+
+export class Histogram extends Metric<{ buckets: number[]; count: number; sum: number }> {
+  constructor(name: string, help: string, private readonly bounds = DEFAULT_BUCKETS) {
+    super(name, help, "histogram");
+  }
+
+  observe(labels: Labels, value: number) {
+    const entry = this.getValue(labels, () => ({ buckets: this.bounds.map(() => 0), count: 0, sum: 0 })).value;
+    const index = this.bounds.findIndex(bound => value <= bound);
+    if (index !== -1) entry.buckets[index]++;
+    entry.count++;
+    entry.sum += value;
+  }
+
+  protected collectValues() {
+    return [...this.values.values()].flatMap(({ labels, value }) => {
+      let cumulative = 0;
+      return [
+        ...this.bounds.map((bound, i) => {
+          cumulative += value.buckets[i];
+          return `${this.name}_bucket${formatLabels({ ...labels, le: bound })} ${cumulative}`;
+        }),
+        `${this.name}_bucket${formatLabels({ ...labels, le: "+Inf" })} ${value.count}`,
+        `${this.name}_sum${formatLabels(labels)} ${value.sum}`,
+        `${this.name}_count${formatLabels(labels)} ${value.count}`
+      ];
+    });
+  }
+}
+
+/**
+ * Format a histogram of cumulative counts by upper bounds, e.g. from another histogram implementation.
+ */
+export function formatHistogram(
+  name: string,
+  labels: Labels,
+  buckets: [number, number][],
+  count: number,
+  sum: number
+) {
+  return [
+    ...buckets.map(([bound, cumulative]) => `${name}_bucket${formatLabels({ ...labels, le: bound })} ${cumulative}`),
+    `${name}_bucket${formatLabels({ ...labels, le: "+Inf" })} ${count}`,
+    `${name}_sum${formatLabels(labels)} ${sum}`,
+    `${name}_count${formatLabels(labels)} ${count}`
+  ];
+}
+
+// The native addons' async operations run in the libuv threadpool
+const threadpoolSize = Number(process.env.UV_THREADPOOL_SIZE) || 4;
+const threadpoolInFlight = new Gauge(
+  "judge_threadpool_in_flight",
+  "Native async operations queued or running in the libuv threadpool"
+);
+const threadpoolBusySeconds = new Counter(
+  "judge_threadpool_busy_seconds_total",
+  "Total time threadpool threads spent running native operations"
+);
+const threadpoolOperations = new Counter("judge_threadpool_operations_total", "Native async operations finished");
+// eslint-disable-next-line no-new
+new Gauge("judge_threadpool_size", "Threads in the libuv threadpool", () => [[{}, threadpoolSize]]);
+
+export function threadpoolOperationStarted() {
+  threadpoolInFlight.inc();
+}
+
+/**
+ * @param timing The start and end time (in microseconds) written by the native addon, see tracing.ts.
+ */
+export function threadpoolOperationFinished(operation: string, timing: Float64Array) {
+  threadpoolInFlight.inc({}, -1);
+  threadpoolOperations.inc({ operation });
+  if (timing && timing[1]) threadpoolBusySeconds.inc({}, (timing[1] - timing[0]) / 1e6);
+}
+
+// The busy ratio of each core since the last scrape
+let lastCpuTimes: Record<string, { busy: number; total: number }> = {};
+function readCpuTimes() {
+  const result: typeof lastCpuTimes = {};
+  for (const line of fs.readFileSync("/proc/stat", "utf-8").split("\n")) {
+    const match = /^cpu(\d+)\s+(.*)$/.exec(line);
+    if (!match) continue;
+
+    // user nice system idle iowait irq softirq steal
+    const fields = match[2].split(/\s+/).slice(0, 8).map(Number);
+    const total = fields.reduce((a, b) => a + b, 0);
+    result[match[1]] = { busy: total - fields[3] - fields[4], total };
+  }
+  return result;
+}
+
+// eslint-disable-next-line no-new
+new Gauge("judge_cpu_busy_ratio", "Busy ratio of each CPU core since the last scrape", () => {
+  const cpuTimes = readCpuTimes();
+  const values = Object.entries(cpuTimes).map(([cpu, { busy, total }]): [Labels, number] => {
+    const last = lastCpuTimes[cpu] || { busy: 0, total: 0 };
+    return [{ cpu }, total > last.total ? (busy - last.busy) / (total - last.total) : 0];
+  });
+  lastCpuTimes = cpuTimes;
+  return values;
+});
+
+export function getMetricsText() {
+  return `${collectors.flatMap(collector => collector()).join("\n")}\n`;
+}
+
+type EndpointHandler = (query: URLSearchParams) => { contentType: string; body: string };
+
+const endpoints: Map<string, EndpointHandler> = new Map([
+  ["/metrics", () => ({ contentType: "text/plain; version=0.0.4", body: getMetricsText() })]
+]);
+
+/**
+ * Serve something else for debugging on the metrics server, e.g. the drained events of the event ring.
+ */
+export function registerEndpoint(path: string, handler: EndpointHandler) {
+  endpoints.set(path, handler);
+}
+
+export function startMetricsServer() {
+  if (!config.metrics) return;
+
+  const server = http.createServer((request, response) => {
+    const url = new URL(request.url, "http://localhost");
+    const handler = endpoints.get(url.pathname);
+    if (request.method !== "GET" || !handler) {
+      response.writeHead(404).end();
+      return;
+    }
+
+    try {
+      const { contentType, body } = handler(url.searchParams);
+      response.writeHead(200, { "Content-Type": contentType }).end(body);
+    } catch (e) {
+      winston.error(`Failed to serve ${url.pathname}: ${e.stack}`);
+      response.writeHead(500).end();
+    }
+  });
+
+  server.on("error", e => winston.error(`Metrics server error: ${e}`));
+  server.listen(config.metrics.port, config.metrics.host || "127.0.0.1", () =>
+    winston.info(`Serving metrics on http://${config.metrics.host || "127.0.0.1"}:${config.metrics.port}/metrics`)
+  );
+  server.unref();
+}
@@ -0,0 +1,132 @@
+import fs from "fs";
+
+import bindings from "bindings";
+import winston from "winston";
+
+import { Disposer, FileDescriptor } from "./posixUtils";
+import { OmittableString } from "./omittableString";
+
+const pipeRelay = bindings("pipe_relay");
+
+export interface PipeRelayStats {
+  bytes: number;
+  /**
+   * The number of forwarded chunks, approximately the number of writes by the producer.
+   */
+  writes: number;
+  /**
+   * The time (ms) the relay waited for the producer to write.
+   */
+  inputWaitTime: number;
+  /**
+   * The time (ms) the relay waited for the consumer to read, i.e. the pipe to the consumer was full.
+   */
+  outputWaitTime: number;
+}
+
+export interface PipeRelayChannel {
+  from: FileDescriptor;
+  to: FileDescriptor;
+  /**
+   * Written to the transcript before the data of this channel, every time the direction changes.
+   */
+  transcriptHeader?: string;
+}
+
+export interface PipeRelayTranscriptOptions {
+  /**
+   * A file (e.g. a memfd) the forwarded data is captured to, from offset 0.
+   */
+  file: FileDescriptor;
+  /**
+   * The maximum number of bytes written to the file. The remaining data is only counted, the transcript's
+   * `omittedLength` is in characters (UTF-16 code units) like the other omitted strings.
+   */
+  limit: number;
+}
+
+export interface PipeRelayResult {
+  channels: PipeRelayStats[];
+  transcript?: OmittableString;
+}
+
+export interface PipeRelay {
+  /**
+   * Stop forwarding and return the statistics of each channel (and the transcript if enabled). It's safe to
+   * call more than once.
+   */
+  stop(): PipeRelayResult;
+}
+
+// The length of an incomplete UTF-8 sequence at the end of the buffer, and its length in UTF-16 code units if complete
+function getIncompleteUtf8Tail(buffer: Buffer, length: number) {
+  for (let i = length - 1; i >= Math.max(0, length - 4); i--) {
+    const byte = buffer[i];
+    if ((byte & 0xc0) === 0x80) continue;
+
+    const sequenceLength = byte >= 0xf0 ? 4 : byte >= 0xe0 ? 3 : byte >= 0xc0 ? 2 : 1;
+    if (length - i >= sequenceLength) break;
+    return { bytes: length - i, units: sequenceLength === 4 ? 2 : 1 };
+  }
+  return { bytes: 0, units: 0 };
+}
+
+function readTranscript(file: FileDescriptor, capturedBytes: number, omittedLength: number): OmittableString {
+  const buffer = Buffer.allocUnsafe(capturedBytes);
+  const bytesRead = fs.readSync(file.fd, buffer, 0, capturedBytes, 0);
+
+  // The limit could split a character, which is omitted as a whole instead of decoded to U+FFFD
+  const tail = omittedLength > 0 ? getIncompleteUtf8Tail(buffer, bytesRead) : { bytes: 0, units: 0 };
+  const data = buffer.toString("utf8", 0, bytesRead - tail.bytes);
+  omittedLength += tail.units;
+  if (omittedLength > 0)
+    return {
+      data,
+      omittedLength
+    };
+  else return data;
+}
+
+/**
+ * Start a native thread forwarding data from each channel's `from` pipe to its `to` pipe with `splice()`.
+ *
+ * With a transcript, the data is duplicated with `tee()` and spliced to the transcript file, still without
+ * copying to userspace until the limit is reached (the rest is read to count its characters). Without one, the relay doesn't do anything more than forwarding.
+ *
+ * The relay must be stopped before any of the pipes is closed. The disposer stops it if it's added to the
+ * disposer after the pipes.
+ */
+export function startPipeRelay(
+  channels: PipeRelayChannel[],
+  disposer: Disposer,
+  transcript?: PipeRelayTranscriptOptions
+): PipeRelay {
+  const relay = pipeRelay.start(
+    channels.map(({ from, to, transcriptHeader }) => ({ from: from.fd, to: to.fd, transcriptHeader })),
+    transcript && { fd: transcript.file.fd, limit: transcript.limit }
+  );
+
+  let result: PipeRelayResult = null;
+  const stop = () => {
+    if (!result) {
+      const nativeResult = relay.stop();
+      result = { channels: nativeResult.channels };
+      if (nativeResult.transcript)
+        result.transcript = readTranscript(
+          transcript.file,
+          nativeResult.transcript.capturedBytes,
+          nativeResult.transcript.omittedLength
+        );
+    }
+    return result;
+  };
+
+  disposer.add(() => {
+    try {
+      stop();
+    } catch (e) {
+      winston.error(e.message);
+    }
+  });
+  return { stop };
+}
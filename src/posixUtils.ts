@@ -1,9 +1,14 @@
+import fs from "fs";
+
 import bindings from "bindings";
+import winston from "winston";
 
 const posixUtils = bindings("posix");
 
 /**
  * A list of dispose functions. Functions can be added to be executed when "dispose" is called.
+ *
+ * They're executed in the reverse order of adding, so a resource is disposed before the ones it depends on.
  */
 export class Disposer {
   private disposeFunctions: (() => void)[] = [];
@@ -13,7 +18,7 @@ export class Disposer {
   }
 
   dispose() {
-    this.disposeFunctions.forEach(f => f());
+    this.disposeFunctions.reverse().forEach(f => f());
     this.disposeFunctions = [];
   }
 }
@@ -41,16 +46,147 @@ export interface Pipe {
   write: FileDescriptor;
 }
 
-export function createPipe(disposer: Disposer): Pipe {
+/**
+ * @param size If specified, the capacity of the pipe is set with `F_SETPIPE_SZ` (rounded up by the kernel).
+ */
+export function createPipe(disposer: Disposer, size?: number): Pipe {
   const pipe = posixUtils.pipe();
-  return {
+  const result = {
     read: new FileDescriptor(pipe.read, disposer),
     write: new FileDescriptor(pipe.write, disposer)
   };
+  if (size) posixUtils.fcntl_set_pipe_size(result.write.fd, size);
+  return result;
 }
 
-export function createSharedMemory(size: number, disposer: Disposer): FileDescriptor {
-  const fd: number = posixUtils.memfd_create("SharedMemory", 0);
-  posixUtils.ftruncate(fd, size);
-  return new FileDescriptor(fd, disposer);
+export interface SharedMemoryOptions {
+  /**
+   * Back the memory with hugetlbfs pages if possible, otherwise advise transparent huge pages, which only takes effect
+   * with `prefault` (the pages are allocated as huge pages then).
+   */
+  hugePages?: boolean;
+
+  /**
+   * Allocate all the pages before passing the memory to the sandboxes.
+   */
+  prefault?: boolean;
+
+  /**
+   * Prevent the memory from being resized.
+   */
+  seal?: boolean;
+}
+
+let hugePageSize: number;
+function getHugePageSize() {
+  if (hugePageSize === undefined) {
+    try {
+      const match = fs.readFileSync("/proc/meminfo", "utf-8").match(/^Hugepagesize:\s+(\d+) kB$/m);
+      hugePageSize = match ? parseInt(match[1], 10) * 1024 : null;
+    } catch (e) {
+      hugePageSize = null;
+    }
+  }
+
+  return hugePageSize;
+}
+
+function tryCreateHugeTlbSharedMemory(size: number, flags: number, prefault: boolean): number {
+  const pageSize = getHugePageSize();
+  if (!pageSize || size % pageSize !== 0) return null;
+
+  let fd: number = null;
+  try {
+    fd = posixUtils.memfd_create("SharedMemory", flags | posixUtils.constants.MFD_HUGETLB);
+    posixUtils.ftruncate(fd, size);
+    // Mapping it reserves the huge pages, which fails if there're not enough
+    posixUtils.shared_memory_prepare(fd, size, false, prefault);
+    return fd;
+  } catch (e) {
+    winston.verbose(`Couldn't create shared memory with huge pages, falling back: ${e.message}`);
+    if (fd !== null) posixUtils.close(fd);
+    return null;
+  }
+}
+
+export function createSharedMemory(
+  size: number,
+  disposer: Disposer,
+  options: SharedMemoryOptions = {}
+): FileDescriptor {
+  const { constants } = posixUtils;
+  const flags = options.seal ? constants.MFD_ALLOW_SEALING : 0;
+
+  const hugeTlbFd = options.hugePages ? tryCreateHugeTlbSharedMemory(size, flags, !!options.prefault) : null;
+  const sharedMemory = new FileDescriptor(
+    hugeTlbFd !== null ? hugeTlbFd : posixUtils.memfd_create("SharedMemory", flags),
+    disposer
+  );
+
+  if (hugeTlbFd === null) {
+    posixUtils.ftruncate(sharedMemory.fd, size);
+    if (options.hugePages || options.prefault) {
+      const advised = posixUtils.shared_memory_prepare(sharedMemory.fd, size, !!options.hugePages, !!options.prefault);
+      if (options.hugePages && !advised)
+        winston.verbose(
+          options.prefault
+            ? "Transparent huge pages are not available for shared memory"
+            : "Transparent huge pages of shared memory require prefaulting"
+        );
+    }
+  }
+
+  if (options.seal) {
+    const seals = constants.F_SEAL_SHRINK | constants.F_SEAL_GROW | constants.F_SEAL_SEAL;
+    posixUtils.fcntl_add_seals(sharedMemory.fd, seals);
+  }
+
+  return sharedMemory;
+}
+
+/**
+ * Create an empty in-memory file, which grows as it's written.
+ */
+export function createMemoryFile(name: string, disposer: Disposer): FileDescriptor {
+  return new FileDescriptor(posixUtils.memfd_create(name, 0), disposer);
+}
+
+/**
+ * Initialize the shared memory as a channel of two SPSC rings, see `native/shm_channel/shm_channel.h`.
+ */
+export function initializeSharedMemoryChannel(sharedMemory: FileDescriptor, size: number) {
+  posixUtils.shm_channel_initialize(sharedMemory.fd, size);
+}
+
+/**
+ * Take an exclusive `flock()` on a lock file, to coordinate with the other judge processes on the same host (e.g.
+ * downloading to a shared data store). It's polled instead of blocking a threadpool thread. Close the returned file
+ * to release the lock.
+ */
+export async function lockFile(path: string): Promise<fs.promises.FileHandle> {
+  const file = await fs.promises.open(path, "a");
+  try {
+    for (let delay = 10; !posixUtils.flock(file.fd, posixUtils.constants.LOCK_EX); delay = Math.min(delay * 2, 500))
+      await new Promise(resolve => setTimeout(resolve, delay));
+  } catch (e) {
+    await file.close();
+    throw e;
+  }
+  return file;
+}
+
+/**
+ * Try to take an exclusive `flock()` on a lock file without waiting. Return its fd (keep it open to hold the lock), or
+ * `null` if it's locked by another process.
+ */
+export function tryLockFileSync(path: string, flags = "a"): number {
+  const fd = fs.openSync(path, flags);
+  try {
+    if (posixUtils.flock(fd, posixUtils.constants.LOCK_EX)) return fd;
+  } catch (e) {
+    fs.closeSync(fd);
+    throw e;
+  }
+  fs.closeSync(fd);
+  return null;
 }
@@ -0,0 +1,136 @@
+import { SandboxStatus } from "simple-sandbox";
+import LruCache from "lru-cache";
+import winston from "winston";
+import { v4 as uuid } from "uuid";
+
+import config, { serverSideConfig, binaryCacheScratchStore } from "./config";
+import * as fsNative from "./fsNative";
+import { LanguageConfig } from "./languages";
+import { safelyJoinPath, ensureDirectoryEmpty } from "./utils";
+import { readFileOmitted } from "./omittableString";
+import { runSandbox, CpuAffinityStrategy, SANDBOX_INSIDE_PATH_PRECOMPILED_HEADER } from "./sandbox";
+import { Counter } from "./metrics";
+
+/**
+ * The precompiled headers of the languages supporting them (see `LanguageConfig.precompiledHeader`), with
+ * `config.precompiledHeaders`. Each one is built in the sandbox on the first compilation needing it (in the
+ * compilation's task working directory) into `binaryCacheStore`, and mounted read-only to the compilations with the
+ * same key.
+ *
+ * A failed build is also cached, so the compilations go without it instead of building it again each time.
+ */
+
+export interface PrecompiledHeader {
+  directory: string;
+  references: number;
+  evicted: boolean;
+}
+
+const precompiledHeaderRequests = new Counter(
+  "judge_precompiled_header_requests_total",
+  "Compilations using a precompiled header, by whether it's cached, built, or unavailable (failed to build)"
+);
+
+function removePrecompiledHeader(precompiledHeader: PrecompiledHeader) {
+  fsNative
+    .remove(precompiledHeader.directory)
+    .catch(e => winston.error(`Failed to remove precompiled header ${precompiledHeader.directory}: ${e.stack}`));
+}
+
+// `null` if failed to build
+const precompiledHeaders = new LruCache<string, Promise<PrecompiledHeader>>({
+  max: config.precompiledHeaders?.maxCount || 8,
+  dispose: promise => {
+    promise.then(precompiledHeader => {
+      if (!precompiledHeader) return;
+      precompiledHeader.evicted = true;
+      if (precompiledHeader.references === 0) removePrecompiledHeader(precompiledHeader);
+    });
+  }
+});
+
+async function buildPrecompiledHeader<T>(
+  languageConfig: LanguageConfig<T>,
+  compileAndRunOptions: T,
+  key: string,
+  taskWorkingDirectory: string
+): Promise<PrecompiledHeader> {
+  winston.info(`Building precompiled header of ${languageConfig.name} for ${key}`);
+
+  const directory = safelyJoinPath(binaryCacheScratchStore, `pch-${uuid()}`);
+  // Not the compilation's temp directory
+  const tempDirectoryOutside = safelyJoinPath(taskWorkingDirectory, "pch-temp");
+  await Promise.all([ensureDirectoryEmpty(directory), ensureDirectoryEmpty(tempDirectoryOutside)]);
+
+  const buildConfig = languageConfig.precompiledHeader.build({
+    outputDirectoryInside: SANDBOX_INSIDE_PATH_PRECOMPILED_HEADER,
+    compileAndRunOptions
+  });
+  const sandboxResult = await runSandbox(null, {
+    ...buildConfig,
+    tempDirectoryOutside,
+    extraMounts: [
+      {
+        mappedPath: { outside: directory, inside: SANDBOX_INSIDE_PATH_PRECOMPILED_HEADER },
+        readOnly: false
+      }
+    ],
+    cpuAffinity: CpuAffinityStrategy.Compiler
+  });
+
+  const messageFile = buildConfig.messageFile && safelyJoinPath(directory, buildConfig.messageFile);
+  const message = messageFile ? await readFileOmitted(messageFile, serverSideConfig.limit.compilerMessage) : "";
+  if (messageFile) await fsNative.remove(messageFile);
+
+  if (sandboxResult.status !== SandboxStatus.OK || sandboxResult.code !== 0) {
+    winston.warn(
+      `Failed to build precompiled header of ${languageConfig.name} for ${key}, ` +
+        `${SandboxStatus[sandboxResult.status]} (code = ${sandboxResult.code}): ${JSON.stringify(message)}`
+    );
+    await fsNative.remove(directory);
+    return null;
+  }
+
+  return { directory, references: 0, evicted: false };
+}
+
+/**
+ * Return the precompiled header for a compilation, built now if not cached, or `null` if the language or the code
+ * doesn't use one. It's referenced and must be released with `releasePrecompiledHeader()`.
+ */
+export async function acquirePrecompiledHeader<T>(
+  languageConfig: LanguageConfig<T>,
+  compileAndRunOptions: T,
+  code: string,
+  taskWorkingDirectory: string
+): Promise<PrecompiledHeader> {
+  if (!config.precompiledHeaders || !languageConfig.precompiledHeader) return null;
+
+  const key = languageConfig.precompiledHeader.getKey(compileAndRunOptions, code);
+  if (key == null) return null;
+
+  const cacheKey = `${languageConfig.name} ${key}`;
+  let promise = precompiledHeaders.get(cacheKey);
+  precompiledHeaderRequests.inc({ result: promise ? "hit" : "build" });
+  if (!promise) {
+    promise = buildPrecompiledHeader(languageConfig, compileAndRunOptions, key, taskWorkingDirectory).catch(e => {
+      winston.warn(`Failed to build precompiled header of ${languageConfig.name} for ${key}: ${e.stack}`);
+      return null;
+    });
+    precompiledHeaders.set(cacheKey, promise);
+  }
+
+  const precompiledHeader = await promise;
+  // Failed to build, or evicted while waiting for it
+  if (!precompiledHeader || precompiledHeader.evicted) {
+    precompiledHeaderRequests.inc({ result: "unavailable" });
+    return null;
+  }
+
+  precompiledHeader.references++;
+  return precompiledHeader;
+}
+
+export function releasePrecompiledHeader(precompiledHeader: PrecompiledHeader) {
+  if (--precompiledHeader.references === 0 && precompiledHeader.evicted) removePrecompiledHeader(precompiledHeader);
+}
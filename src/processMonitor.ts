@@ -0,0 +1,104 @@
+import bindings from "bindings";
+import winston from "winston";
+
+import config from "./config";
+
+const monitor = bindings("monitor");
+
+export const IDLE_SYSTEM_MESSAGE = "Idle/Deadlock: the program stopped making progress";
+
+export interface IdleWatch {
+  /**
+   * Stop watching. Return if the sandboxes were stopped for being idle.
+   */
+  stop(): boolean;
+}
+
+interface WatchedSandbox {
+  pid: number;
+  stop(): void;
+}
+
+/**
+ * Watch the process trees of the sandboxes with a native thread, and stop all of them if no thread is scheduled
+ * for `config.idleDetection.window` while all of them are sleeping. Return null if idle detection is disabled.
+ *
+ * @param requirePipeRead Also require each sandbox to have a thread blocked reading a pipe, for interaction.
+ */
+export function startIdleWatch(sandboxes: WatchedSandbox[], requirePipeRead: boolean): IdleWatch {
+  if (!config.idleDetection) return null;
+
+  let stopped = false;
+  let idle = false;
+  const watch = monitor.watchIdle(
+    sandboxes.map(sandbox => sandbox.pid),
+    {
+      window: config.idleDetection.window,
+      interval: config.idleDetection.interval,
+      requirePipeRead
+    },
+    () => {
+      if (stopped) return;
+      idle = true;
+      sandboxes.forEach(sandbox => sandbox.stop());
+    }
+  );
+
+  return {
+    stop: () => {
+      if (!stopped) {
+        stopped = true;
+        watch.stop();
+      }
+      return idle;
+    }
+  };
+}
+
+export interface MemoryTimeline {
+  /**
+   * [time (ms since start), memory (KiB)], the larger one of adjacent samples is kept when downsampling.
+   */
+  points: [number, number][];
+  samples: number;
+  /**
+   * The CPU time (ms) spent sampling.
+   */
+  samplingTime: number;
+}
+
+export interface MemoryTimelineSampler {
+  /**
+   * Stop sampling and return the timeline. It's safe to call more than once.
+   */
+  stop(): MemoryTimeline;
+}
+
+/**
+ * Record the memory usage of the sandbox (its cgroup's usage, or the total RSS of its process tree) at adaptive
+ * intervals with a native thread. Return null if disabled.
+ */
+export function startMemoryTimeline(pid: number): MemoryTimelineSampler {
+  if (!config.memoryTimeline) return null;
+
+  const sampler = monitor.startMemoryTimeline(pid, {
+    points: config.memoryTimeline.points,
+    minInterval: config.memoryTimeline.minInterval,
+    maxInterval: config.memoryTimeline.maxInterval,
+    maxOverhead: config.memoryTimeline.maxOverhead
+  });
+
+  let result: MemoryTimeline = null;
+  return {
+    stop: () => {
+      if (!result) {
+        const { points, samples, samplingTime, interval } = sampler.stop();
+        result = { points, samples, samplingTime };
+        winston.debug(
+          `Memory timeline of ${pid}: ${samples} samples costing ${samplingTime} ms, final interval ${interval} ms`
+        );
+      }
+      return result;
+    }
+  };
+}
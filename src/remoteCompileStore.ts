@@ -0,0 +1,222 @@
+import fs from "fs";
+import crypto from "crypto";
+import { resolve } from "path";
+import { execFile } from "child_process";
+import { promisify } from "util";
+import { pipeline } from "stream/promises";
+
+import axios from "axios";
+import winston from "winston";
+import { v4 as uuid } from "uuid";
+
+import config, { binaryCacheScratchStore } from "./config";
+import * as fsNative from "./fsNative";
+import { safelyJoinPath, ensureDirectoryEmpty } from "./utils";
+import { OmittableString } from "./omittableString";
+import { Counter } from "./metrics";
+
+/**
+ * A second-level store of the compile results shared by the judge nodes (with `config.remoteCompileStore`), so the
+ * checkers and interactors of a problem are compiled once instead of on each node. It's checked before compiling
+ * them and each newly compiled one is uploaded in the background. The submissions are not shared, since they're
+ * rarely compiled twice.
+ *
+ * Each compile result is a gzipped tarball `<compileTaskHash>-<sha256>.tar.gz` of its binary directory, with the
+ * message and extra info in `RESULT_FILENAME`, and `<compileTaskHash>.sha256` contains the SHA-256 digest of the last
+ * uploaded tarball, which is checked before extracting it. The digest is uploaded after the tarball, so it never
+ * refers to a partial one. The compile task hash doesn't include the compilers' versions, so the nodes sharing a
+ * store must have the same sandbox rootfs (or use a different `prefix`).
+ */
+
+export interface RemoteCompileResult {
+  message: OmittableString;
+  binaryDirectory: string;
+  binaryDirectorySize: number;
+  extraInfo: string;
+}
+
+const RESULT_FILENAME = ".lyrio-compile-result.json";
+
+const execFileAsync = promisify(execFile);
+
+const remoteCompileStoreRequests = new Counter(
+  "judge_remote_compile_store_requests_total",
+  "Requests to the remote compile store, by operation and result"
+);
+
+interface RemoteCompileStoreBackend {
+  // Download the archive to the destination file, or return false if it doesn't exist
+  fetch(filename: string, destination: string): Promise<boolean>;
+
+  upload(filename: string, source: string): Promise<void>;
+}
+
+// A directory shared by the judge nodes, e.g. a NFS mount
+class DirectoryBackend implements RemoteCompileStoreBackend {
+  constructor(private readonly path: string) {}
+
+  async fetch(filename: string, destination: string) {
+    try {
+      await fs.promises.copyFile(safelyJoinPath(this.path, filename), destination);
+      return true;
+    } catch (e) {
+      if (e.code === "ENOENT") return false;
+      throw e;
+    }
+  }
+
+  async upload(filename: string, source: string) {
+    // Copy to a temporary file first, so a partial archive is never seen by the others
+    const tempFilename = safelyJoinPath(this.path, `.${filename}.${uuid()}`);
+    try {
+      await fs.promises.copyFile(source, tempFilename);
+      await fs.promises.rename(tempFilename, safelyJoinPath(this.path, filename));
+    } catch (e) {
+      await fsNative.remove(tempFilename).catch(() => {});
+      throw e;
+    }
+  }
+}
+
+// GET and PUT `<url>/<filename>`, e.g. served by nginx with `dav_methods PUT`
+class HttpBackend implements RemoteCompileStoreBackend {
+  constructor(private readonly url: string, private readonly headers: Record<string, string>) {}
+
+  private getUrl(filename: string) {
+    return `${this.url.replace(/\/+$/, "")}/${filename}`;
+  }
+
+  async fetch(filename: string, destination: string) {
+    try {
+      const response = await axios.get(this.getUrl(filename), {
+        responseType: "stream",
+        headers: this.headers,
+        timeout: config.downloadTimeout
+      });
+      await pipeline(response.data, fs.createWriteStream(destination));
+      return true;
+    } catch (e) {
+      if (axios.isAxiosError(e) && e.response?.status === 404) return false;
+      throw e;
+    }
+  }
+
+  async upload(filename: string, source: string) {
+    const { size } = await fs.promises.stat(source);
+    await axios.put(this.getUrl(filename), fs.createReadStream(source), {
+      headers: {
+        ...this.headers,
+        "Content-Type": filename.endsWith(".tar.gz") ? "application/gzip" : "text/plain",
+        "Content-Length": String(size)
+      },
+      maxBodyLength: Infinity,
+      timeout: config.downloadTimeout
+    });
+  }
+}
+
+let backend: RemoteCompileStoreBackend;
+if (config.remoteCompileStore?.type === "directory") {
+  fsNative.ensureDirSync(config.remoteCompileStore.path);
+  backend = new DirectoryBackend(config.remoteCompileStore.path);
+} else if (config.remoteCompileStore?.type === "http") {
+  backend = new HttpBackend(config.remoteCompileStore.url, config.remoteCompileStore.headers || {});
+}
+
+function getDigestFilename(compileTaskHash: string) {
+  return `${config.remoteCompileStore.prefix || ""}${compileTaskHash}.sha256`;
+}
+
+function getArchiveFilename(compileTaskHash: string, digest: string) {
+  return `${config.remoteCompileStore.prefix || ""}${compileTaskHash}-${digest}.tar.gz`;
+}
+
+async function hashArchive(archive: string) {
+  const hash = crypto.createHash("sha256");
+  await pipeline(fs.createReadStream(archive), hash);
+  return hash.digest("hex");
+}
+
+/**
+ * Fetch a compile result to `working` of the task working directory. Return `null` if not found or failed.
+ */
+export async function fetchRemoteCompileResult(
+  compileTaskHash: string,
+  taskWorkingDirectory: string
+): Promise<RemoteCompileResult> {
+  if (!backend) return null;
+
+  const digestFile = safelyJoinPath(taskWorkingDirectory, "remote.sha256");
+  const archive = safelyJoinPath(taskWorkingDirectory, "remote.tar.gz");
+  const binaryDirectory = safelyJoinPath(taskWorkingDirectory, "working");
+  try {
+    if (!(await backend.fetch(getDigestFilename(compileTaskHash), digestFile))) {
+      remoteCompileStoreRequests.inc({ operation: "fetch", result: "miss" });
+      return null;
+    }
+
+    const digest = (await fs.promises.readFile(digestFile, "utf-8")).trim();
+    if (!/^[0-9a-f]{64}$/.test(digest)) throw new Error("Invalid digest");
+    if (!(await backend.fetch(getArchiveFilename(compileTaskHash, digest), archive)))
+      throw new Error("Missing the archive of the digest");
+
+    // It's extracted as root
+    if ((await hashArchive(archive)) !== digest) throw new Error("Digest mismatch");
+
+    await ensureDirectoryEmpty(binaryDirectory);
+    await execFileAsync("tar", ["-xzf", archive, "--no-same-owner", "-C", binaryDirectory]);
+
+    const resultFile = safelyJoinPath(binaryDirectory, RESULT_FILENAME);
+    const { message, extraInfo } = JSON.parse(await fs.promises.readFile(resultFile, "utf-8"));
+    await fsNative.remove(resultFile);
+
+    const binaryDirectorySize = await fsNative.calcSize(binaryDirectory);
+    if (binaryDirectorySize > config.binaryCacheMaxSize) throw new Error("Exceeding the limit of cache storage");
+
+    remoteCompileStoreRequests.inc({ operation: "fetch", result: "hit" });
+    return { message, binaryDirectory, binaryDirectorySize, extraInfo };
+  } catch (e) {
+    winston.warn(`Failed to fetch compile result ${compileTaskHash} from the remote store: ${e.message}`);
+    remoteCompileStoreRequests.inc({ operation: "fetch", result: "error" });
+    return null;
+  } finally {
+    await Promise.all([fsNative.remove(digestFile), fsNative.remove(archive)]).catch(() => {});
+  }
+}
+
+/**
+ * Upload a compile result, whose binary directory must not be removed before it resolves. Never rejects.
+ */
+export async function uploadRemoteCompileResult(compileTaskHash: string, result: RemoteCompileResult) {
+  if (!backend || config.remoteCompileStore.readOnly) return;
+
+  // Not in a task working directory, since it's uploaded after the compile task finished
+  const tempDirectory = safelyJoinPath(binaryCacheScratchStore, `upload-${uuid()}`);
+  try {
+    await fsNative.ensureDir(tempDirectory);
+    await fs.promises.writeFile(
+      safelyJoinPath(tempDirectory, RESULT_FILENAME),
+      JSON.stringify({ message: result.message, extraInfo: result.extraInfo })
+    );
+
+    const archive = safelyJoinPath(tempDirectory, "result.tar.gz");
+    // The files of the binary directory are in the root of the archive, besides RESULT_FILENAME. Each `-C` is
+    // relative to the previous one so resolve them.
+    const tarArguments = ["-czf", archive, "-C", resolve(tempDirectory), RESULT_FILENAME];
+    tarArguments.push("-C", resolve(result.binaryDirectory), ".");
+    await execFileAsync("tar", tarArguments);
+
+    const digest = await hashArchive(archive);
+    const digestFile = safelyJoinPath(tempDirectory, "result.sha256");
+    await fs.promises.writeFile(digestFile, digest);
+    await backend.upload(getArchiveFilename(compileTaskHash, digest), archive);
+    await backend.upload(getDigestFilename(compileTaskHash), digestFile);
+
+    remoteCompileStoreRequests.inc({ operation: "upload", result: "success" });
+  } catch (e) {
+    winston.warn(`Failed to upload compile result ${compileTaskHash} to the remote store: ${e.message}`);
+    remoteCompileStoreRequests.inc({ operation: "upload", result: "error" });
+  } finally {
+    await fsNative.remove(tempDirectory).catch(() => {});
+  }
+}
@@ -4,10 +4,22 @@ import lodashDebounce from "lodash.debounce";
 import SocketIOParser from "socket.io-msgpack-parser";
 
 import config, { updateServerSideConfig } from "./config";
-import taskHandler, { Task } from "./task";
+import taskHandler, { Task, TaskMeta } from "./task";
+import { VersionedProgress } from "./task/progress";
 
 import getSystemInfo from "./systemInfo";
 import { CanceledError } from "./error";
+import { getTimingStatus, onTimingStatusChange, waitForReliableTiming } from "./timingMonitor";
+import { traceInstant } from "./tracing";
+import { EventId, recordEvent } from "./eventRing";
+
+// With the delta progress protocol, the progress is reported as the changes since the version acknowledged by the
+// server, or as a snapshot if there's none, e.g. the first report, or the server requested one
+interface ProgressReporting {
+  acknowledgedVersion: number;
+  // Report the last progress again
+  reportAgain: () => void;
+}
 
 export class RPC {
   // eslint-disable-next-line no-undef
@@ -21,6 +33,9 @@ export class RPC {
    */
   private pendingTaskCancelCallback: Map<string, Set<() => void>> = new Map();
 
+  // taskId -> the progress reporting state
+  private progressReportings: Map<string, ProgressReporting> = new Map();
+
   async connect() {
     winston.info("Trying to connect to the server...");
 
@@ -53,6 +68,13 @@ export class RPC {
 
     this.socket.on("cancel", (taskId: string) => this.cancelTask(taskId));
 
+    this.socket.on("requestProgressSnapshot", (taskId: string) => {
+      const reporting = this.progressReportings.get(taskId);
+      if (!reporting) return;
+      reporting.acknowledgedVersion = 0;
+      reporting.reportAgain();
+    });
+
     this.socket.on("authenticationFailed", () => {
       winston.error("Failed to authentication to server, please check your key");
       process.exit(1);
@@ -64,6 +86,7 @@ export class RPC {
           winston.info(`Successfully authorized as ${name}`);
           updateServerSideConfig(serverSideConfig);
           this.socket.emit("systemInfo", await getSystemInfo());
+          onTimingStatusChange(status => this.socket.emit("timingStatus", status));
 
           resolve();
         });
@@ -71,6 +94,11 @@ export class RPC {
     );
   }
 
+  // Report the system info again after it changed, e.g. calibrated
+  async reportSystemInfo() {
+    this.socket.emit("systemInfo", await getSystemInfo());
+  }
+
   restart() {
     winston.error("Disconnected from server, restarting");
     this.cancelAllTasks();
@@ -148,8 +176,46 @@ export class RPC {
     return urls;
   }
 
+  private sendProgress(taskMeta: TaskMeta, progress: unknown, reporting: ProgressReporting) {
+    if (!(progress instanceof VersionedProgress)) {
+      this.socket.emit("progress", { taskMeta, progress });
+      return;
+    }
+
+    if (config.progressProtocol !== "delta") {
+      this.socket.emit("progress", { taskMeta, progress: progress.getSnapshot() });
+      progress.acknowledge(progress.version);
+      return;
+    }
+
+    const { version } = progress;
+    const baseVersion = reporting.acknowledgedVersion;
+    if (baseVersion === version) return;
+
+    const delta = baseVersion ? progress.getDelta(baseVersion) : null;
+    this.socket.emit(
+      "progressDelta",
+      delta ? { taskMeta, version, baseVersion, delta } : { taskMeta, version, snapshot: progress.getSnapshot() },
+      (response: { version?: number; resync?: boolean }) => {
+        if (response?.resync) {
+          winston.warn(`Server requested a progress snapshot of task ${taskMeta.taskId}`);
+          reporting.acknowledgedVersion = 0;
+          reporting.reportAgain();
+        } else if (response?.version > reporting.acknowledgedVersion) {
+          reporting.acknowledgedVersion = response.version;
+          progress.acknowledge(response.version);
+        }
+      }
+    );
+  }
+
   async startTaskConsumerThread(threadId: number) {
     for (;;) {
+      if (config.timingMonitor?.pauseConsuming && getTimingStatus()?.unreliable) {
+        winston.warn(`[Thread ${threadId}] Timing is unreliable, paused consuming tasks`);
+        await waitForReliableTiming();
+      }
+
       this.socket.emit("consumeTask", threadId);
       winston.info(`[Thread ${threadId}] Consuming task`);
 
@@ -178,18 +244,22 @@ export class RPC {
       );
 
       // Debounce the onProgress function so we won't send progress too fast to the server
+      const taskMeta: TaskMeta = {
+        taskId: task.taskId,
+        type: task.type
+      };
+      let lastProgress: unknown;
+      const reporting: ProgressReporting = { acknowledgedVersion: 0, reportAgain: null };
       const reportProgress = lodashDebounce(async (progress: unknown) => {
-        winston.verbose(`[Thread ${threadId}] Reporting progress for task ${taskInfo}`);
-        this.socket.emit("progress", {
-          taskMeta: {
-            taskId: task.taskId,
-            type: task.type
-          },
-          progress
-        });
+        recordEvent(EventId.ReportProgress, threadId);
+        traceInstant("reportProgress", "rpc");
+        this.sendProgress(taskMeta, progress, reporting);
       }, 100);
+      reporting.reportAgain = () => reportProgress(lastProgress);
+      this.progressReportings.set(task.taskId, reporting);
       task.reportProgressRaw = (progress: unknown) => {
         if (canceled) throw new CanceledError();
+        lastProgress = progress;
         reportProgress(progress);
       };
 
@@ -203,6 +273,11 @@ export class RPC {
 
       this.pendingTaskCancelCallback.delete(task.taskId);
 
+      // With the delta protocol, send the last progress before the ack, since its reporting state (to answer a resync)
+      // is removed here. The full protocol keeps its order, the debounced last progress is sent after the ack.
+      if (config.progressProtocol === "delta") reportProgress.flush();
+      this.progressReportings.delete(task.taskId);
+
       ack();
       winston.info(`[Thread ${threadId}] Sent ack for finished task ${taskInfo}`);
     }
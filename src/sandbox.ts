@@ -6,6 +6,9 @@ import rpc from "./rpc";
 import { CanceledError } from "./error";
 import { FileDescriptor } from "./posixUtils";
 import * as fsNative from "./fsNative";
+import { SandboxDiagnostics, startDiagnostics } from "./diagnostics";
+import { traceNow, traceSpan, traceSpanSince } from "./tracing";
+import { Histogram } from "./metrics";
 
 export enum CpuAffinityStrategy {
   Compiler = "Compiler",
@@ -110,9 +113,11 @@ export interface SandboxMountDirectory {
 export const SANDBOX_INSIDE_PATH_BINARY = "/sandbox/binary";
 export const SANDBOX_INSIDE_PATH_WORKING = "/sandbox/working";
 export const SANDBOX_INSIDE_PATH_SOURCE = "/sandbox/source";
+export const SANDBOX_INSIDE_PATH_PRECOMPILED_HEADER = "/sandbox/pch";
+export const SANDBOX_INSIDE_PATH_COMPILE_SERVER = "/sandbox/compile-server";
 
 const sandboxUser = Sandbox.getUidAndGidInSandbox(config.sandbox.rootfs, config.sandbox.user);
-async function setSandboxUserPermission(path: string, writeAccess: boolean): Promise<void> {
+export async function setSandboxUserPermission(path: string, writeAccess: boolean): Promise<void> {
   await fsNative.chmodown(path, {
     mode: 0o755,
     owner: writeAccess ? sandboxUser.uid : 0,
@@ -135,12 +140,20 @@ function resolveSandboxCpuAffinity(strategy: CpuAffinityStrategy): number[] {
   return map[strategy];
 }
 
+const sandboxStartSeconds = new Histogram(
+  "judge_sandbox_start_seconds",
+  "Time taken to prepare the mounts and start a sandbox, by CPU affinity type",
+  [0.001, 0.0025, 0.005, 0.01, 0.025, 0.05, 0.1, 0.25, 0.5, 1]
+);
+
 /**
  * @param taskId If not null, it is used to determine if and be notified when the current is canceled.
  */
 export async function startSandbox(taskId: string, sandboxConfig: SandboxConfig) {
   if (taskId) rpc.ensureNotCanceled(taskId);
 
+  const startTime = traceNow();
+
   let executable: string;
   let parametersPrepend: string[];
   if (sandboxConfig.executable) {
@@ -207,6 +220,16 @@ export async function startSandbox(taskId: string, sandboxConfig: SandboxConfig)
 
   preservedFileDescriptors.forEach(fd => fd && fd.setCloseOnExec(true));
 
+  const traceArgs = { type: sandboxConfig.cpuAffinity, pid: sandbox.pid };
+  traceSpanSince("startSandbox", "sandbox", startTime, traceArgs);
+  sandboxStartSeconds.observe({ type: sandboxConfig.cpuAffinity }, (traceNow() - startTime) / 1e6);
+
+  const diagnosticsCollector = startDiagnostics(sandbox.pid, sandboxConfig.cpuAffinity);
+  let diagnostics: SandboxDiagnostics = null;
+  const sandboxStopPromise = traceSpan("sandbox", "sandbox", () => sandbox.waitForStop(), traceArgs).finally(() => {
+    if (diagnosticsCollector) diagnostics = diagnosticsCollector.stop();
+  });
+
   const resultPromise = taskId
     ? // eslint-disable-next-line no-async-promise-executor
       new Promise<Sandbox.SandboxResult>(async (resolve, reject) => {
@@ -215,7 +238,7 @@ export async function startSandbox(taskId: string, sandboxConfig: SandboxConfig)
         });
 
         try {
-          const result = await sandbox.waitForStop();
+          const result = await sandboxStopPromise;
           off();
           if (rpc.isCanceled(taskId)) reject(new CanceledError());
           else resolve(result);
@@ -224,11 +247,16 @@ export async function startSandbox(taskId: string, sandboxConfig: SandboxConfig)
           reject(e);
         }
       })
-    : sandbox.waitForStop();
+    : sandboxStopPromise;
 
   return {
+    pid: sandbox.pid,
     waitForStop: () => resultPromise,
-    stop: () => sandbox.stop()
+    stop: () => sandbox.stop(),
+    /**
+     * The cgroup accounting of the run, available after it stopped if enabled.
+     */
+    getDiagnostics: () => diagnostics
   };
 }
 
@@ -2,6 +2,9 @@ import os from "os";
 
 import systeminformation from "systeminformation";
 
+import { getTimingStatus, TimingStatus } from "./timingMonitor";
+import { getLanguageStartupCosts, LanguageStartupCost } from "./calibration";
+
 export interface SystemInfo {
   // e.g. Ubuntu 18.04.2 LTS
   os: string;
@@ -31,23 +34,20 @@ export interface SystemInfo {
     description: string;
   };
 
-  // languageName => compilers
+  // languageName => the startup cost of each calibrated compile and run options, `{}` without `config.calibration`
   // TODO: Use a manually generated yaml file in sandbox rootfs to get compilers' versions
-  languages: Record<
-    string,
-    {
-      name: string;
-      version: string;
-    }[]
-  >;
+  languages: Record<string, LanguageStartupCost[]>;
 
   extraInfo: string;
+
+  // null if the timing monitor is disabled
+  timing: TimingStatus;
 }
 
-let cachedResult: SystemInfo;
+let cachedResult: Omit<SystemInfo, "languages" | "timing">;
 
 export default async function getSystemInfo(): Promise<SystemInfo> {
-  if (cachedResult) return cachedResult;
+  if (cachedResult) return { ...cachedResult, languages: getLanguageStartupCosts(), timing: getTimingStatus() };
 
   const [osInfo, cpu, cpuFlags, mem, memLayout] = await Promise.all([
     systeminformation.osInfo(),
@@ -62,8 +62,7 @@ export default async function getSystemInfo(): Promise<SystemInfo> {
 
   const cpuCores = [cpu.physicalCores, cpu.cores].find(x => Number.isSafeInteger(x));
 
-  // eslint-disable-next-line no-return-assign
-  return (cachedResult = {
+  cachedResult = {
     os: osInfo.distro + (osInfo.release === "unknown" ? "" : ` ${osInfo.release}`),
     kernel: `${os.type().split("_").join(" ")} ${os.release()}`,
     arch: osInfo.arch,
@@ -84,7 +83,7 @@ export default async function getSystemInfo(): Promise<SystemInfo> {
         .filter(x => x)
         .join(" ")
     },
-    languages: {},
     extraInfo: ""
-  });
+  };
+  return { ...cachedResult, languages: getLanguageStartupCosts(), timing: getTimingStatus() };
 }
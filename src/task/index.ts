@@ -1,4 +1,8 @@
+import { runTraced } from "@/tracing";
+import { runWithEventTask } from "@/eventRing";
+
 import onSubmission from "./submission";
+import { VersionedProgress } from "./progress";
 
 export enum TaskType {
   Submission = "Submission"
@@ -16,7 +20,8 @@ export type Task<TaskExtraInfo, Progress> = TaskMeta & {
   // It's handled by the judge queue on the server
   priority: number;
   extraInfo: TaskExtraInfo;
-  reportProgressRaw: (progress: Progress) => void;
+  // A `VersionedProgress` could be reported as the changes since the last acknowledged version
+  reportProgressRaw: (progress: Progress | VersionedProgress<Progress>) => void;
 };
 
 export type TaskHandler<T> = (task: Task<T, unknown>) => Promise<void>;
@@ -26,5 +31,5 @@ const taskHandlers: Record<TaskType, TaskHandler<unknown>> = {
 };
 
 export default async function taskHandler(task: Task<unknown, unknown>) {
-  await taskHandlers[task.type](task);
+  await runWithEventTask(task.taskId, () => runTraced(task.taskId, () => taskHandlers[task.type](task)));
 }
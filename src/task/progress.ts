@@ -0,0 +1,44 @@
+/**
+ * A task progress which records its changes, so it could be reported as the changes since the last version
+ * acknowledged by the server instead of the whole progress each time (with `progressProtocol: delta`).
+ *
+ * Each change increases the version by one and is kept (by a numeric key of the changed part) until acknowledged.
+ */
+export abstract class VersionedProgress<Progress = unknown, Delta = unknown> {
+  version = 0;
+
+  // The keys of the changes from version `changesSince + 1`
+  private changes: number[] = [];
+
+  private changesSince = 0;
+
+  protected changed(key: number) {
+    this.version++;
+    this.changes.push(key);
+  }
+
+  /**
+   * Return the keys of the parts changed since a version, or `null` if they're not kept.
+   */
+  protected getChangedKeys(sinceVersion: number): Set<number> {
+    if (sinceVersion < this.changesSince || sinceVersion > this.version) return null;
+    return new Set(this.changes.slice(sinceVersion - this.changesSince));
+  }
+
+  /**
+   * Forget the changes up to a version, since no delta will be based on an earlier version.
+   */
+  acknowledge(version: number) {
+    if (version <= this.changesSince) return;
+    this.changes.splice(0, Math.min(version, this.version) - this.changesSince);
+    this.changesSince = Math.min(version, this.version);
+  }
+
+  abstract getSnapshot(): Progress;
+
+  /**
+   * Return the changes since a version, to be applied to the progress of that version, or `null` if a snapshot
+   * must be sent instead.
+   */
+  abstract getDelta(sinceVersion: number): Delta;
+}
@@ -1,8 +1,15 @@
+import fs from "fs";
+import crypto from "crypto";
+
 import toposort from "toposort";
-import winston from "winston";
+import objectHash from "object-hash";
 
+import config, { serverSideConfig } from "@/config";
+import { getFile } from "@/file";
 import { Disposer } from "@/posixUtils";
-import { runTaskQueued } from "@/taskQueue";
+import { runTaskQueued, TaskPriority } from "@/taskQueue";
+import { traceSpan } from "@/tracing";
+import { EventId, eventString, recordEvent } from "@/eventRing";
 
 import { SubmissionTask, ProblemSample, SubmissionStatus } from ".";
 
@@ -35,6 +42,77 @@ interface SubmissionContentCommon {
 interface TestcaseResultCommon {
   status: string;
   score: number;
+  time?: number;
+  /**
+   * The time of each run, if the testcase was re-run since its time was close to the time limit.
+   */
+  timingRuns?: number[];
+}
+
+// The statuses which the time decides against TimeLimitExceeded, a re-run of the others can't change their verdict
+const TIMING_RERUN_STATUSES = ["Accepted", "PartiallyCorrect", "TimeLimitExceeded"];
+
+// The testcases of a Sum subtask are enqueued up to this times `config.maxConcurrentTasks` at a time
+const TESTCASE_WINDOW_FACTOR = 2;
+
+// The testcases hashed at a time by `createTestcaseHasher()`
+const HASH_WINDOW = 16;
+
+/**
+ * Run `job(0)` to `job(count - 1)` in order, with at most `window` of them at a time. Stop starting new jobs once
+ * any of them fails.
+ */
+async function forEachWindowed(count: number, window: number, job: (index: number) => Promise<void>) {
+  let next = 0;
+  let failed = false;
+  const worker = async () => {
+    while (next < count && !failed) {
+      try {
+        await job(next++);
+      } catch (e) {
+        failed = true;
+        throw e;
+      }
+    }
+  };
+  await Promise.all(Array.from({ length: Math.min(window, count) }, worker));
+}
+
+/**
+ * Create the hasher of the testcases of a subtask, with the parts common to them (e.g. the checker and the compile
+ * results) hashed only once with `objectHash`. Each testcase's hash is the SHA-1 of the common hash and the
+ * testcase's own parts (e.g. its data files' hashes and limits), which must be JSON serializable.
+ *
+ * The testcases are hashed lazily, `HASH_WINDOW` of them at a time when the first of them is requested (i.e. as
+ * they're enqueued), so a subtask which stops early (GroupMin or GroupMul) doesn't hash the rest of its files.
+ */
+export function createTestcaseHasher<Testcase>(
+  common: Record<string, unknown>,
+  testcases: Testcase[],
+  getParts: (testcase: Testcase) => Promise<unknown[]>
+) {
+  let commonHash: string = null;
+  const windows: Promise<string[]>[] = [];
+  return async (index: number) => {
+    const windowIndex = Math.floor(index / HASH_WINDOW);
+    if (!windows[windowIndex]) {
+      if (commonHash == null) commonHash = objectHash(common);
+      const start = windowIndex * HASH_WINDOW;
+      const promise = Promise.all(
+        testcases.slice(start, start + HASH_WINDOW).map(async testcase => {
+          const parts = await getParts(testcase);
+          return crypto.createHash("sha1").update(JSON.stringify([commonHash, ...parts])).digest("hex");
+        })
+      );
+      // Don't keep a failure, e.g. a file failed to download
+      promise.catch(() => {
+        if (windows[windowIndex] === promise) windows[windowIndex] = null;
+      });
+      windows[windowIndex] = promise;
+    }
+
+    return (await windows[windowIndex])[index % HASH_WINDOW];
+  };
 }
 
 function getSubtaskOrder(judgeInfo: JudgeInfoCommon<TestcaseConfigCommon>) {
@@ -56,10 +134,21 @@ export async function runCommonTask<
 >({
   task,
   extraParameters,
-  onTestcase
+  onTestcase,
+  timingRerun,
+  concurrentMemory
 }: {
   task: SubmissionTask<JudgeInfo, SubmissionContent, TestcaseResult, ExtraParameters>;
   extraParameters: ExtraParameters;
+  /**
+   * Re-run the testcases whose time is close to the time limit, see `config.timingRerun`.
+   */
+  timingRerun?: boolean;
+  /**
+   * The memory (in bytes) used besides the user program's while running a testcase, e.g. the interactor's memory
+   * limit, reserved with the testcase's, see `config.memoryAdmission`.
+   */
+  concurrentMemory?: number;
   onTestcase: (
     task: SubmissionTask<JudgeInfo, SubmissionContent, TestcaseResult, ExtraParameters>,
     judgeInfo: JudgeInfo,
@@ -98,6 +187,28 @@ export async function runCommonTask<
   );
   task.events.startedRunning(runSamples && samples.length, subtaskFullScores);
 
+  let timingRerunsLeft = timingRerun && config.timingRerun ? config.timingRerun.maxRerunsPerSubmission : 0;
+  const shouldRerunForTiming = (result: TestcaseResult, timeLimit: number) =>
+    timingRerunsLeft > 0 &&
+    result.time != null &&
+    TIMING_RERUN_STATUSES.includes(result.status) &&
+    result.time >= timeLimit * config.timingRerun.lowerBound &&
+    result.time <= timeLimit * config.timingRerun.upperBound;
+
+  // The memory reserved in the task queue to run a testcase: the memory limit of the user program (and of the programs
+  // running with it), and the input and output files in the working directory (which is usually a tmpfs)
+  const getTestcaseMemory = async (sample: ProblemSample, testcase: TestcaseConfig) => {
+    if (!config.memoryAdmission) return 0;
+
+    const memoryLimit = (sample ? judgeInfo.memoryLimit : testcase.memoryLimit) || 0;
+    let inputSize = 0;
+    if (sample) inputSize = Buffer.byteLength(sample.inputData);
+    else if (testcase.inputFile)
+      inputSize = (await fs.promises.stat(getFile(task.extraInfo.testData[testcase.inputFile]))).size;
+
+    return memoryLimit * 1024 * 1024 + (concurrentMemory || 0) + inputSize + serverSideConfig.limit.outputSize;
+  };
+
   const runTestcaseQueued = async (
     sampleId: number,
     sample: ProblemSample,
@@ -106,44 +217,70 @@ export async function runCommonTask<
     testcase: TestcaseConfig
   ) => {
     const isSample = sampleId != null;
+    const [eventSubtask, eventTestcase] = isSample ? [-1, sampleId] : [subtaskIndex, testcaseIndex];
 
     const existingResult = isSample
       ? await task.events.sampleTestcaseWillEnqueue(sampleId, sample, extraParameters)
       : await task.events.testcaseWillEnqueue(subtaskIndex, testcaseIndex, extraParameters);
 
-    const result =
-      existingResult ||
-      (await runTaskQueued(async (taskWorkingDirectory, disposer) => {
-        if (isSample) {
-          winston.verbose(`Running sample testcase ${sampleId}`);
-          task.events.sampleTestcaseRunning(sampleId);
-        } else {
-          winston.verbose(`Running testcase ${subtaskIndex}.${testcaseIndex}`);
-          task.events.testcaseRunning(subtaskIndex, testcaseIndex);
-        }
+    const memory = await getTestcaseMemory(sample, testcase);
+    const runOnce = (rerun: boolean) =>
+      runTaskQueued(
+        async (taskWorkingDirectory, disposer) => {
+          recordEvent(rerun ? EventId.TestcaseRerunning : EventId.TestcaseRunning, eventSubtask, eventTestcase);
+          if (!rerun) {
+            if (isSample) task.events.sampleTestcaseRunning(sampleId);
+            else task.events.testcaseRunning(subtaskIndex, testcaseIndex);
+          }
+
+          return await traceSpan(
+            "testcase",
+            "testcase",
+            () =>
+              onTestcase(
+                task,
+                judgeInfo,
+                sampleId,
+                sample,
+                subtaskIndex,
+                testcaseIndex,
+                testcase,
+                extraParameters,
+                taskWorkingDirectory,
+                disposer
+              ),
+            isSample ? { sampleId, rerun } : { subtaskIndex, testcaseIndex, rerun }
+          );
+        },
+        rerun ? TaskPriority.Low : TaskPriority.Normal,
+        memory
+      );
 
-        return await onTestcase(
-          task,
-          judgeInfo,
-          sampleId,
-          sample,
-          subtaskIndex,
-          testcaseIndex,
-          testcase,
-          extraParameters,
-          taskWorkingDirectory,
-          disposer
-        );
-      }));
-
-    if (isSample) {
-      task.events.sampleTestcaseFinished(sampleId, sample, result);
-      winston.verbose(`Finished sample testcase ${sampleId}: ${JSON.stringify(result)}`);
-    } else {
-      task.events.testcaseFinished(subtaskIndex, testcaseIndex, result);
-      winston.verbose(`Finished testcase ${subtaskIndex}.${testcaseIndex}: ${JSON.stringify(result)}`);
+    let result = existingResult || (await runOnce(false));
+
+    const timeLimit = isSample ? judgeInfo.timeLimit : testcase.timeLimit;
+    if (!existingResult && shouldRerunForTiming(result, timeLimit)) {
+      const results = [result];
+      while (results.length < config.timingRerun.runs && timingRerunsLeft > 0) {
+        timingRerunsLeft--;
+        results.push(await runOnce(true));
+      }
+
+      // A re-run could fail for other reasons, e.g. a flaky runtime error, don't report it
+      const candidates = results
+        .filter(({ status }) => TIMING_RERUN_STATUSES.includes(status))
+        .sort((a, b) => a.time - b.time);
+      result = {
+        ...(config.timingRerun.report === "median" ? candidates[(candidates.length - 1) >> 1] : candidates[0]),
+        timingRuns: results.map(({ time }) => time)
+      };
     }
 
+    if (isSample) task.events.sampleTestcaseFinished(sampleId, sample, result);
+    else task.events.testcaseFinished(subtaskIndex, testcaseIndex, result);
+    const status = eventString(result?.status || "");
+    recordEvent(EventId.TestcaseFinished, eventSubtask, eventTestcase, status, result?.time || 0);
+
     return result;
   };
 
@@ -198,51 +335,52 @@ export async function runCommonTask<
     const defaultPercentagePointsForTestcases =
       (100 - sumSpecfiedPercentagePointsForTestcases) / countUnspecfiedPercentagePointsForTestcases;
 
-    const normalizedTestcases = subtask.testcases.map(testcase => ({
+    // Normalized when run instead of all at once, so only the testcases in the window are kept
+    const normalizeTestcase = (testcase: TestcaseConfig): TestcaseConfig => ({
       ...testcase,
       points: testcase.points == null ? defaultPercentagePointsForTestcases : testcase.points,
       timeLimit: testcase.timeLimit || subtask.timeLimit || judgeInfo.timeLimit,
       memoryLimit: testcase.memoryLimit || subtask.memoryLimit || judgeInfo.memoryLimit
-    }));
+    });
+
+    // The status of the first non-accepted testcase by index, not by finishing order
+    let firstNonAcceptedIndex = Infinity;
+    let firstNonAcceptedStatusOfSubtask: string = null;
+    const checkStatus = (testcaseIndex: number, result: TestcaseResult) => {
+      if (result.status !== "Accepted" && testcaseIndex < firstNonAcceptedIndex) {
+        firstNonAcceptedIndex = testcaseIndex;
+        firstNonAcceptedStatusOfSubtask = result.status;
+      }
+    };
 
     let subtaskScore = 0;
     if (subtask.scoringType !== "Sum") subtaskScore = 100;
 
-    let results: TestcaseResult[];
     if (subtask.scoringType === "Sum") {
-      results = await Promise.all(
-        normalizedTestcases.map(async (testcase, i) => {
-          const result = await runTestcaseQueued(null, null, subtaskIndex, i, testcase);
-          subtaskScore += (result.score * normalizedTestcases[i].points) / 100;
-          task.events.subtaskScoreUpdated(subtaskIndex, subtaskScore);
-          return result;
-        })
-      );
+      // The testcases are streamed to the task queue through a bounded window instead of all enqueued at once
+      const window = config.maxConcurrentTasks * TESTCASE_WINDOW_FACTOR;
+      await forEachWindowed(subtask.testcases.length, window, async i => {
+        const testcase = normalizeTestcase(subtask.testcases[i]);
+        const result = await runTestcaseQueued(null, null, subtaskIndex, i, testcase);
+        subtaskScore += (result.score * testcase.points) / 100;
+        task.events.subtaskScoreUpdated(subtaskIndex, subtaskScore);
+        checkStatus(i, result);
+      });
     } else {
-      results = [];
-      for (const i of normalizedTestcases.keys()) {
-        const testcase = normalizedTestcases[i];
-
+      for (const i of subtask.testcases.keys()) {
         if (Math.round(subtaskScore) === 0) {
           task.events.testcaseFinished(subtaskIndex, i, null);
         } else {
-          const result = await runTestcaseQueued(null, null, subtaskIndex, i, testcase);
+          const result = await runTestcaseQueued(null, null, subtaskIndex, i, normalizeTestcase(subtask.testcases[i]));
           if (subtask.scoringType === "GroupMin") subtaskScore = Math.min(subtaskScore, result.score);
           else subtaskScore = (subtaskScore * result.score) / 100;
           task.events.subtaskScoreUpdated(subtaskIndex, subtaskScore);
-          results.push(result);
+          checkStatus(i, result);
         }
       }
     }
 
-    if (firstNonAcceptedStatus === null) {
-      for (const result of results) {
-        if (result.status !== "Accepted") {
-          firstNonAcceptedStatus = result.status;
-          break;
-        }
-      }
-    }
+    if (firstNonAcceptedStatus === null) firstNonAcceptedStatus = firstNonAcceptedStatusOfSubtask;
 
     subtaskScores[subtaskIndex] = subtaskScore;
     totalScore += (subtaskScore * subtaskFullScores[subtaskIndex]) / 100;
@@ -4,8 +4,10 @@ import { Task } from "@/task";
 import { ensureFiles } from "@/file";
 import { ConfigurationError, CanceledError } from "@/error";
 import { OmittableString } from "@/omittableString";
+import { traceSpan } from "@/tracing";
 
 import { SubmissionFile, SubmissionFileInfo } from "./submissionFile";
+import { SubmissionProgressTracker } from "./progress";
 
 import * as Traditional from "./traditional";
 import * as Interaction from "./interaction";
@@ -63,7 +65,7 @@ export enum SubmissionStatus {
   JudgementFailed = "JudgementFailed"
 }
 
-interface TestcaseProgressReference {
+export interface TestcaseProgressReference {
   // If !waiting && !running && !testcaseHash, it's "Skipped"
   waiting?: boolean;
   running?: boolean;
@@ -130,13 +132,15 @@ export interface SubmissionHandler<JudgeInfo, SubmissionContent, TestcaseResult,
   validateJudgeInfo: (
     task: SubmissionTask<JudgeInfo, SubmissionContent, TestcaseResult, ExtraParameters>
   ) => Promise<void>;
-  hashTestcase: (
+  /**
+   * Create the hasher of a subtask's testcases, which hashes them as they're requested, see `createTestcaseHasher()`.
+   */
+  hashTestcases: (
     judgeInfo: JudgeInfo,
     subtaskIndex: number,
-    testcaseIndex: number,
     testData: Record<string, string>,
     extraParameters: ExtraParameters
-  ) => Promise<string>;
+  ) => (testcaseIndex: number) => Promise<string>;
   hashSampleTestcase: (
     judgeInfo: JudgeInfo,
     sample: ProblemSample,
@@ -169,24 +173,132 @@ function getTestcaseCountOfSubtask(judgeInfo: JudgeInfoCommon, subtaskIndex: num
   return 1; // Non-common type
 }
 
+/**
+ * Create the events of a submission task, which update its progress and report it.
+ */
+export function createSubmissionEvents<JudgeInfo, SubmissionContent, TestcaseResult, ExtraParameters>(
+  task: SubmissionTask<JudgeInfo, SubmissionContent, TestcaseResult, ExtraParameters>,
+  problemTypeHandler: SubmissionHandler<JudgeInfo, SubmissionContent, TestcaseResult, ExtraParameters>,
+  progress: SubmissionProgressTracker<TestcaseResult>,
+  startTime: Date
+): SubmissionTask<JudgeInfo, SubmissionContent, TestcaseResult, ExtraParameters>["events"] {
+  const { judgeInfo } = task.extraInfo;
+
+  const sampleTestcaseHashes: string[] = [];
+  // The testcases of a subtask are hashed as they're enqueued, with a hasher created for the first of them
+  const testcaseHashers: ((testcaseIndex: number) => Promise<string>)[] = [];
+  const testcaseHashes: string[][] = [];
+
+  let finished = false;
+  return {
+    compiling() {
+      if (finished) return;
+      progress.reset({
+        progressType: SubmissionProgressType.Compiling
+      });
+      task.reportProgressRaw(progress);
+    },
+    compiled(compile) {
+      if (finished) return;
+      progress.update({ compile });
+    },
+    startedRunning(samplesCount, subtaskFullScores) {
+      if (finished) return;
+      progress.startRunning(
+        samplesCount,
+        [...new Array(getSubtaskCount(judgeInfo)).keys()].map(subtaskIndex => ({
+          fullScore: subtaskFullScores[subtaskIndex],
+          testcasesCount: getTestcaseCountOfSubtask(judgeInfo, subtaskIndex)
+        })),
+        { progressType: SubmissionProgressType.Running }
+      );
+      task.reportProgressRaw(progress);
+    },
+    async sampleTestcaseWillEnqueue(sampleId, sample, extraParameters) {
+      if (finished) return null;
+
+      const testcaseHash = await problemTypeHandler.hashSampleTestcase(judgeInfo, sample, extraParameters);
+      sampleTestcaseHashes[sampleId] = testcaseHash;
+
+      return progress.getResult(testcaseHash) || null;
+    },
+    sampleTestcaseRunning(sampleId) {
+      if (finished) return;
+      progress.sampleRunning(sampleId);
+      task.reportProgressRaw(progress);
+    },
+    sampleTestcaseFinished(sampleId, sample, result) {
+      if (finished) return;
+      progress.sampleFinished(sampleId, sampleTestcaseHashes[sampleId], result);
+      task.reportProgressRaw(progress);
+    },
+    async testcaseWillEnqueue(subtaskIndex, testcaseIndex, extraParameters) {
+      if (finished) return null;
+      if (!testcaseHashers[subtaskIndex]) {
+        testcaseHashers[subtaskIndex] = problemTypeHandler.hashTestcases(
+          judgeInfo,
+          subtaskIndex,
+          task.extraInfo.testData,
+          extraParameters
+        );
+        testcaseHashes[subtaskIndex] = [];
+      }
+      const testcaseHash = await testcaseHashers[subtaskIndex](testcaseIndex);
+      testcaseHashes[subtaskIndex][testcaseIndex] = testcaseHash;
+
+      return progress.getResult(testcaseHash) || null;
+    },
+    testcaseRunning(subtaskIndex, testcaseIndex) {
+      if (finished) return;
+      progress.testcaseRunning(subtaskIndex, testcaseIndex);
+      task.reportProgressRaw(progress);
+    },
+    testcaseFinished(subtaskIndex, testcaseIndex, result) {
+      if (finished) return;
+      // If not "Skipped"
+      const testcaseHash = result ? testcaseHashes[subtaskIndex][testcaseIndex] : null;
+      progress.testcaseFinished(subtaskIndex, testcaseIndex, testcaseHash, result);
+      task.reportProgressRaw(progress);
+    },
+    subtaskScoreUpdated(subtaskIndex, newScore) {
+      if (finished) return;
+      progress.setSubtaskScore(subtaskIndex, (newScore * progress.getSubtaskFullScore(subtaskIndex)) / 100);
+      task.reportProgressRaw(progress);
+    },
+    finished(status, score) {
+      if (finished) return;
+      finished = true;
+      progress.update({
+        progressType: SubmissionProgressType.Finished,
+        status,
+        score,
+        totalOccupiedTime: +new Date() - +startTime
+      });
+      task.reportProgressRaw(progress);
+    }
+  };
+}
+
 export default async function onSubmission<JudgeInfo, SubmissionContent, TestcaseResult, ExtraParameters>(
   task: SubmissionTask<JudgeInfo, SubmissionContent, TestcaseResult, ExtraParameters>
 ): Promise<void> {
   // Calculate the total wall time time occupied by this submission
   const startTime = new Date();
 
+  const progress = new SubmissionProgressTracker<TestcaseResult>();
   try {
     if (!(task.extraInfo.problemType in ProblemType)) {
       throw new ConfigurationError(`Unsupported problem type: ${task.extraInfo.problemType}`);
     }
 
-    task.reportProgressRaw({
+    progress.reset({
       progressType: SubmissionProgressType.Preparing
     });
+    task.reportProgressRaw(progress);
 
     // Download testdata files
     const requiredFiles = Object.values(task.extraInfo.testData);
-    await ensureFiles(requiredFiles);
+    await traceSpan("ensureFiles", "file", () => ensureFiles(requiredFiles), { count: requiredFiles.length });
 
     // Downlaod submission file
     if (task.extraInfo.file) {
@@ -195,129 +307,18 @@ export default async function onSubmission<JudgeInfo, SubmissionContent, Testcas
 
     const problemTypeHandler = problemTypeHandlers[task.extraInfo.problemType];
     try {
-      await problemTypeHandler.validateJudgeInfo(task);
+      await traceSpan("validateJudgeInfo", "task", () => problemTypeHandler.validateJudgeInfo(task));
     } catch (e) {
       if (typeof e === "string") throw new ConfigurationError(e);
       else throw e;
     }
 
-    const { judgeInfo } = task.extraInfo;
-
-    const progress: SubmissionProgress<TestcaseResult> = {
-      progressType: null
-    };
-
-    const sampleTestcaseHashes: string[] = [];
-    const testcaseHashes: string[][] = [];
-
-    let finished = false;
-    task.events = {
-      compiling() {
-        if (finished) return;
-        task.reportProgressRaw({
-          progressType: SubmissionProgressType.Compiling
-        });
-      },
-      compiled(compile) {
-        if (finished) return;
-        progress.compile = compile;
-      },
-      startedRunning(samplesCount, subtaskFullScores) {
-        if (finished) return;
-        progress.progressType = SubmissionProgressType.Running;
-        progress.testcaseResult = {};
-        if (samplesCount) {
-          progress.samples = [...new Array(samplesCount)].map(() => ({
-            waiting: true
-          }));
-        }
-        progress.subtasks = [...new Array(getSubtaskCount(judgeInfo)).keys()].map(subtaskIndex => ({
-          score: null,
-          fullScore: subtaskFullScores[subtaskIndex],
-          testcases: [...new Array(getTestcaseCountOfSubtask(judgeInfo, subtaskIndex)).keys()].map(() => ({
-            waiting: true
-          }))
-        }));
-        task.reportProgressRaw(progress);
-      },
-      async sampleTestcaseWillEnqueue(sampleId, sample, extraParameters) {
-        if (finished) return null;
-
-        const testcaseHash = await problemTypeHandler.hashSampleTestcase(judgeInfo, sample, extraParameters);
-        sampleTestcaseHashes[sampleId] = testcaseHash;
-
-        if (progress.testcaseResult[testcaseHash]) return progress.testcaseResult[testcaseHash];
-
-        return null;
-      },
-      sampleTestcaseRunning(sampleId) {
-        if (finished) return;
-        delete progress.samples[sampleId].waiting;
-        progress.samples[sampleId].running = true;
-        task.reportProgressRaw(progress);
-      },
-      sampleTestcaseFinished(sampleId, sample, result) {
-        if (finished) return;
-        delete progress.samples[sampleId].waiting;
-        delete progress.samples[sampleId].running;
-        if (result) {
-          // If not "Skipped"
-          const testcaseHash = sampleTestcaseHashes[sampleId];
-          progress.samples[sampleId].testcaseHash = testcaseHash;
-          progress.testcaseResult[testcaseHash] = result;
-        }
-        task.reportProgressRaw(progress);
-      },
-      async testcaseWillEnqueue(subtaskIndex, testcaseIndex, extraParameters) {
-        if (finished) return null;
-        if (!testcaseHashes[subtaskIndex]) testcaseHashes[subtaskIndex] = [];
-
-        const testcaseHash = await problemTypeHandler.hashTestcase(
-          judgeInfo,
-          subtaskIndex,
-          testcaseIndex,
-          task.extraInfo.testData,
-          extraParameters
-        );
-        testcaseHashes[subtaskIndex][testcaseIndex] = testcaseHash;
-
-        if (progress.testcaseResult[testcaseHash]) return progress.testcaseResult[testcaseHash];
-
-        return null;
-      },
-      testcaseRunning(subtaskIndex, testcaseIndex) {
-        if (finished) return;
-        delete progress.subtasks[subtaskIndex].testcases[testcaseIndex].waiting;
-        progress.subtasks[subtaskIndex].testcases[testcaseIndex].running = true;
-        task.reportProgressRaw(progress);
-      },
-      testcaseFinished(subtaskIndex, testcaseIndex, result) {
-        if (finished) return;
-        delete progress.subtasks[subtaskIndex].testcases[testcaseIndex].waiting;
-        delete progress.subtasks[subtaskIndex].testcases[testcaseIndex].running;
-        if (result) {
-          // If not "Skipped"
-          const testcaseHash = testcaseHashes[subtaskIndex][testcaseIndex];
-          progress.subtasks[subtaskIndex].testcases[testcaseIndex].testcaseHash = testcaseHash;
-          progress.testcaseResult[testcaseHash] = result;
-        }
-        task.reportProgressRaw(progress);
-      },
-      subtaskScoreUpdated(subtaskIndex, newScore) {
-        if (finished) return;
-        progress.subtasks[subtaskIndex].score = (newScore * progress.subtasks[subtaskIndex].fullScore) / 100;
-        task.reportProgressRaw(progress);
-      },
-      finished(status, score) {
-        if (finished) return;
-        finished = true;
-        progress.progressType = SubmissionProgressType.Finished;
-        progress.status = status;
-        progress.score = score;
-        progress.totalOccupiedTime = +new Date() - +startTime;
-        task.reportProgressRaw(progress);
-      }
-    };
+    task.events = createSubmissionEvents<JudgeInfo, SubmissionContent, TestcaseResult, ExtraParameters>(
+      task,
+      problemTypeHandler,
+      progress,
+      startTime
+    );
 
     await problemTypeHandlers[task.extraInfo.problemType].runTask(task);
   } catch (e) {
@@ -328,11 +329,12 @@ export default async function onSubmission<JudgeInfo, SubmissionContent, Testcas
     }
 
     const isConfigurationError = e instanceof ConfigurationError;
-    task.reportProgressRaw({
+    progress.reset({
       progressType: SubmissionProgressType.Finished,
       status: isConfigurationError ? SubmissionStatus.ConfigurationError : SubmissionStatus.SystemError,
       systemMessage: isConfigurationError ? e.originalMessage : e.stack || String(e)
     });
+    task.reportProgressRaw(progress);
     if (!isConfigurationError) winston.error(`Error on submission task ${task.taskId}, ${e.stack || e}`);
   } finally {
     // Remove downloaded submission file
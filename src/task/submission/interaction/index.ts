@@ -1,13 +1,13 @@
 import fs from "fs";
 
 import { v4 as uuid } from "uuid";
-import { SandboxStatus } from "simple-sandbox";
+import { SandboxStatus, SandboxResult } from "simple-sandbox";
 
 import { SubmissionTask, SubmissionStatus, ProblemSample } from "@/task/submission";
 import { compile, CompileResultSuccess } from "@/compile";
 import { startSandbox, SANDBOX_INSIDE_PATH_BINARY, SANDBOX_INSIDE_PATH_WORKING, CpuAffinityStrategy } from "@/sandbox";
 import getLanguage from "@/languages";
-import { serverSideConfig } from "@/config";
+import config, { serverSideConfig } from "@/config";
 import { safelyJoinPath, MappedPath, merge } from "@/utils";
 import {
   readFileOmitted,
@@ -18,9 +18,19 @@ import {
 } from "@/omittableString";
 import { getFile } from "@/file";
 import { ConfigurationError } from "@/error";
-import { createPipe, createSharedMemory, Disposer } from "@/posixUtils";
+import {
+  createPipe,
+  createSharedMemory,
+  createMemoryFile,
+  initializeSharedMemoryChannel,
+  Disposer
+} from "@/posixUtils";
+import { PipeRelayStats, startPipeRelay } from "@/pipeRelay";
 import { parseTestlibMessage } from "@/checkers";
 import * as fsNative from "@/fsNative";
+import { getStartupTimeAdjustment } from "@/calibration";
+import { IDLE_SYSTEM_MESSAGE, MemoryTimeline, startIdleWatch, startMemoryTimeline } from "@/processMonitor";
+import { SandboxDiagnostics } from "@/diagnostics";
 
 import { JudgeInfoInteraction, TestcaseConfig } from "./judgeInfo";
 
@@ -56,6 +66,16 @@ export interface TestcaseResultInteraction {
   userError?: OmittableString;
   interactorMessage?: OmittableString;
   systemMessage?: OmittableString;
+  pipeStats?: {
+    userToInteractor: PipeRelayStats;
+    interactorToUser: PipeRelayStats;
+  };
+  transcript?: OmittableString;
+  diagnostics?: {
+    user: SandboxDiagnostics;
+    interactor: SandboxDiagnostics;
+  };
+  memoryTimeline?: MemoryTimeline;
 }
 
 export interface SubmissionContentInteraction {
@@ -65,7 +85,9 @@ export interface SubmissionContentInteraction {
   skipSamples?: boolean;
 }
 
-export type ExtraParametersInteraction = [CompileResultSuccess, CompileResultSuccess];
+// The last one is the startup time adjustment (ms) of the user's program, got once for a submission since a
+// recalibration could change it between testcases
+export type ExtraParametersInteraction = [CompileResultSuccess, CompileResultSuccess, number];
 
 /**
  * Run a subtask testcase or sample testcase.
@@ -90,7 +112,7 @@ async function runTestcase(
   taskWorkingDirectory: string,
   disposer: Disposer
 ): Promise<TestcaseResultInteraction> {
-  const [compileResult, interactorCompileResult] = extraParameters;
+  const [compileResult, interactorCompileResult, userStartupTime] = extraParameters;
 
   const isSample = sampleId != null;
 
@@ -133,12 +155,38 @@ async function runTestcase(
   const interactorStderrFile = safelyJoinPath(workingDirectory, uuid());
   const interactorLanguageConfig = getLanguage(judgeInfo.interactor.language);
 
-  const pipeUserToInteractor = createPipe(disposer);
-  const pipeInteractorToUser = createPipe(disposer);
+  const pipeSize = config.interaction?.pipeSize;
+  const pipeUserToInteractor = createPipe(disposer, pipeSize);
+  const pipeInteractorToUser = createPipe(disposer, pipeSize);
+
+  // With the pipe relay enabled, the user program's stdin / stdout are connected to another pair of pipes,
+  // which are connected to the interactor's pipes by the relay
+  const transcriptLimit = config.interaction?.transcriptLimit;
+  const enablePipeRelay = config.interaction?.pipeRelay || !!transcriptLimit;
+  const pipeUserToRelay = enablePipeRelay ? createPipe(disposer, pipeSize) : null;
+  const pipeRelayToUser = enablePipeRelay ? createPipe(disposer, pipeSize) : null;
+  const pipeRelay =
+    enablePipeRelay &&
+    startPipeRelay(
+      [
+        { from: pipeUserToRelay.read, to: pipeUserToInteractor.write, transcriptHeader: "[user]\n" },
+        { from: pipeInteractorToUser.read, to: pipeRelayToUser.write, transcriptHeader: "[interactor]\n" }
+      ],
+      disposer,
+      transcriptLimit && { file: createMemoryFile("Transcript", disposer), limit: transcriptLimit }
+    );
+  const userStdin = pipeRelay ? pipeRelayToUser.read : pipeInteractorToUser.read;
+  const userStdout = pipeRelay ? pipeUserToRelay.write : pipeUserToInteractor.write;
+  const sharedMemorySize = judgeInfo.interactor.sharedMemorySize * 1024 * 1024;
   const sharedMemory =
-    judgeInfo.interactor.interface === "shm"
-      ? createSharedMemory(judgeInfo.interactor.sharedMemorySize * 1024 * 1024, disposer)
+    judgeInfo.interactor.interface !== "stdio"
+      ? createSharedMemory(sharedMemorySize, disposer, {
+          hugePages: config.interaction?.sharedMemoryHugePages,
+          prefault: config.interaction?.sharedMemoryPrefault,
+          seal: config.interaction?.sharedMemorySeal
+        })
       : null;
+  if (judgeInfo.interactor.interface === "shm-channel") initializeSharedMemoryChannel(sharedMemory, sharedMemorySize);
 
   const environments = {
     INTERACTOR_INTERFACE: judgeInfo.interactor.interface,
@@ -149,17 +197,17 @@ async function runTestcase(
     binaryDirectoryInside: userBinaryDirectory.inside,
     workingDirectoryInside: workingDirectory.inside,
     compileAndRunOptions: task.extraInfo.submissionContent.compileAndRunOptions,
-    time: timeLimit,
+    time: timeLimit + userStartupTime,
     memory: memoryLimit,
-    stdinFile: pipeInteractorToUser.read,
-    stdoutFile: pipeUserToInteractor.write,
+    stdinFile: userStdin,
+    stdoutFile: userStdout,
     stderrFile: userStderrFile.inside,
     parameters: [],
     compileResultExtraInfo: compileResult.extraInfo
   });
   const userSandbox = await startSandbox(task.taskId, {
     ...userRunConfig,
-    time: timeLimit,
+    time: timeLimit + userStartupTime,
     memory: memoryLimit * 1024 * 1024,
     workingDirectory: workingDirectory.inside,
     tempDirectoryOutside,
@@ -173,7 +221,7 @@ async function runTestcase(
         readOnly: false
       }
     ],
-    preservedFileDescriptors: [pipeInteractorToUser.read, pipeUserToInteractor.write, sharedMemory],
+    preservedFileDescriptors: [userStdin, userStdout, sharedMemory],
     environments: merge(userRunConfig.environments, environments),
     cpuAffinity: CpuAffinityStrategy.UserProgram
   });
@@ -214,14 +262,40 @@ async function runTestcase(
     cpuAffinity: CpuAffinityStrategy.Interactor
   });
 
-  const interactorSandboxResult = await interactorSandbox.waitForStop();
-  userSandbox.stop();
-  const userSandboxResult = await userSandbox.waitForStop();
+  // A deadlock is both programs waiting for each other to write
+  const idleWatch = startIdleWatch([userSandbox, interactorSandbox], true);
+  const memoryTimeline = startMemoryTimeline(userSandbox.pid);
+  let interactorSandboxResult: SandboxResult;
+  let userSandboxResult: SandboxResult;
+  try {
+    interactorSandboxResult = await interactorSandbox.waitForStop();
+    userSandbox.stop();
+    userSandboxResult = await userSandbox.waitForStop();
+  } finally {
+    idleWatch?.stop();
+    memoryTimeline?.stop();
+  }
+  const idle = idleWatch?.stop();
+  const userDiagnostics = userSandbox.getDiagnostics();
+  const interactorDiagnostics = interactorSandbox.getDiagnostics();
+  if (userDiagnostics || interactorDiagnostics)
+    result.diagnostics = { user: userDiagnostics, interactor: interactorDiagnostics };
+  if (memoryTimeline) result.memoryTimeline = memoryTimeline.stop();
+
+  if (pipeRelay) {
+    const { channels, transcript } = pipeRelay.stop();
+    const [userToInteractor, interactorToUser] = channels;
+    result.pipeStats = { userToInteractor, interactorToUser };
+    if (transcript != null) result.transcript = transcript;
+  }
 
   const MESSAGE_LENGTH_LIMIT = 256;
   const interactorMessage = await readFileOmitted(interactorStderrFile.outside, MESSAGE_LENGTH_LIMIT);
 
-  if (
+  if (idle) {
+    result.status = TestcaseStatusInteraction.TimeLimitExceeded;
+    result.systemMessage = IDLE_SYSTEM_MESSAGE;
+  } else if (
     userSandboxResult.status === SandboxStatus.TimeLimitExceeded ||
     interactorSandboxResult.status === SandboxStatus.TimeLimitExceeded
   )
@@ -244,7 +318,7 @@ async function runTestcase(
     ? stringToOmited(sample.inputData, serverSideConfig.limit.dataDisplay)
     : await readFileOmitted(getFile(task.extraInfo.testData[testcase.inputFile]), serverSideConfig.limit.dataDisplay);
   result.userError = await readFileOmitted(userStderrFile.outside, serverSideConfig.limit.stderrDisplay);
-  result.time = userSandboxResult.time / 1e6;
+  result.time = Math.max(0, userSandboxResult.time / 1e6 - userStartupTime);
   result.memory = userSandboxResult.memory / 1024;
 
   // Interactor and user program exited normally
@@ -289,7 +363,8 @@ export async function runTask(
   const interactorCompileResult = await compile({
     language: judgeInfo.interactor.language,
     code: await fs.promises.readFile(getFile(task.extraInfo.testData[judgeInfo.interactor.filename]), "utf-8"),
-    compileAndRunOptions: judgeInfo.interactor.compileAndRunOptions
+    compileAndRunOptions: judgeInfo.interactor.compileAndRunOptions,
+    shareRemotely: true
   });
 
   if (!(interactorCompileResult instanceof CompileResultSuccess)) {
@@ -316,11 +391,24 @@ export async function runTask(
     return;
   }
 
+  // The interactor runs with the user program, and so does the shared memory between them
+  const interactorMemory =
+    (judgeInfo.interactor.memoryLimit || judgeInfo.memoryLimit) +
+    (judgeInfo.interactor.interface !== "stdio" ? judgeInfo.interactor.sharedMemorySize || 0 : 0);
+
   try {
     await runCommonTask({
       task,
-      extraParameters: [compileResult, interactorCompileResult],
-      onTestcase: runTestcase
+      extraParameters: [
+        compileResult,
+        interactorCompileResult,
+        getStartupTimeAdjustment(
+          task.extraInfo.submissionContent.language,
+          task.extraInfo.submissionContent.compileAndRunOptions
+        )
+      ],
+      onTestcase: runTestcase,
+      concurrentMemory: interactorMemory * 1024 * 1024
     });
   } finally {
     await compileResult.dereference();
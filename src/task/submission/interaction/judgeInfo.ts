@@ -1,11 +1,9 @@
-import objectHash from "object-hash";
-
 import { SubmissionTask, ProblemSample } from "@/task/submission";
 import { getFileHash } from "@/file";
 import { hashData } from "@/utils";
 
 import { ExtraParametersInteraction, SubmissionContentInteraction, TestcaseResultInteraction } from ".";
-import { validateJudgeInfoSubtasks, validateJudgeInfoExtraSourceFiles } from "../common";
+import { validateJudgeInfoSubtasks, validateJudgeInfoExtraSourceFiles, createTestcaseHasher } from "../common";
 
 export interface TestcaseConfig {
   inputFile?: string;
@@ -63,7 +61,10 @@ export interface JudgeInfoInteraction {
   }[];
 
   interactor: {
-    interface: "stdio" | "shm";
+    // stdio:       communicate with pipes only
+    // shm:         also pass a zeroed shared memory of [sharedMemorySize] MiB
+    // shm-channel: also pass a shared memory initialized with two SPSC rings (see shm_channel.h)
+    interface: "stdio" | "shm" | "shm-channel";
     sharedMemorySize?: number;
     language: string;
     compileAndRunOptions: unknown;
@@ -91,6 +92,10 @@ export async function validateJudgeInfo(
 
   if (!judgeInfo.interactor) throw `Interactor not configured.`;
   if (!(judgeInfo.interactor.filename in testData)) throw `Interactor ${judgeInfo.interactor.filename} doesn't exist.`;
+  if (!["stdio", "shm", "shm-channel"].includes(judgeInfo.interactor.interface))
+    throw `Unknown interactor interface: ${judgeInfo.interactor.interface}.`;
+  if (judgeInfo.interactor.interface === "shm-channel" && !(judgeInfo.interactor.sharedMemorySize >= 1))
+    throw `The shared memory size of a shm-channel interactor must be at least 1 MiB.`;
 
   validateJudgeInfoExtraSourceFiles(judgeInfo, testData);
 }
@@ -107,36 +112,45 @@ export function getInteractorMeta(judgeInfo: JudgeInfoInteraction) {
   };
 }
 
-export async function hashSampleTestcase(
+function getCommonHashParts(
   judgeInfo: JudgeInfoInteraction,
-  sample: ProblemSample,
-  [compileResult, interactorCompileResult]: ExtraParametersInteraction
+  [compileResult, interactorCompileResult, startupTime]: ExtraParametersInteraction
 ) {
-  return objectHash({
+  return {
     interactor: getInteractorMeta(judgeInfo),
-    inputDataHash: await hashData(sample.inputData),
-    timeLimit: judgeInfo.timeLimit,
-    memoryLimit: judgeInfo.memoryLimit,
     compileTaskHash: compileResult.compileTaskHash,
-    interactorCompileTaskHash: interactorCompileResult.compileTaskHash
-  });
+    interactorCompileTaskHash: interactorCompileResult.compileTaskHash,
+    startupTime
+  };
+}
+
+export async function hashSampleTestcase(
+  judgeInfo: JudgeInfoInteraction,
+  sample: ProblemSample,
+  extraParameters: ExtraParametersInteraction
+) {
+  return await createTestcaseHasher(
+    getCommonHashParts(judgeInfo, extraParameters),
+    [sample],
+    async ({ inputData }) => [await hashData(inputData), judgeInfo.timeLimit, judgeInfo.memoryLimit]
+  )(0);
 }
 
-export async function hashTestcase(
+export function hashTestcases(
   judgeInfo: JudgeInfoInteraction,
   subtaskIndex: number,
-  testcaseIndex: number,
   testData: Record<string, string>,
-  [compileResult, interactorCompileResult]: ExtraParametersInteraction
+  extraParameters: ExtraParametersInteraction
 ) {
-  const testcase = judgeInfo.subtasks[subtaskIndex].testcases[testcaseIndex];
-
-  return objectHash({
-    interactor: getInteractorMeta(judgeInfo),
-    inputDataHash: await getFileHash(testData[testcase.inputFile]),
-    timeLimit: testcase.timeLimit || judgeInfo.subtasks[subtaskIndex].timeLimit || judgeInfo.timeLimit,
-    memoryLimit: testcase.memoryLimit || judgeInfo.subtasks[subtaskIndex].memoryLimit || judgeInfo.memoryLimit,
-    compileTaskHash: compileResult.compileTaskHash,
-    interactorCompileTaskHash: interactorCompileResult.compileTaskHash
-  });
+  const subtask = judgeInfo.subtasks[subtaskIndex];
+
+  return createTestcaseHasher(
+    getCommonHashParts(judgeInfo, extraParameters),
+    subtask.testcases,
+    async testcase => [
+      await getFileHash(testData[testcase.inputFile]),
+      testcase.timeLimit || subtask.timeLimit || judgeInfo.timeLimit,
+      testcase.memoryLimit || subtask.memoryLimit || judgeInfo.memoryLimit
+    ]
+  );
 }
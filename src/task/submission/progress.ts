@@ -0,0 +1,264 @@
+import { VersionedProgress } from "@/task/progress";
+
+import { SubmissionProgress, TestcaseProgressReference } from ".";
+
+type SubmissionProgressFields = Omit<SubmissionProgress<unknown>, "testcaseResult" | "samples" | "subtasks">;
+
+/**
+ * The changes of a submission progress, each part is the new value to assign to the corresponding part of the
+ * progress, e.g. `samples[i]` replaces the reference of the i-th sample and `testcaseResult` adds new results.
+ */
+export interface SubmissionProgressDelta<TestcaseResult> extends Partial<SubmissionProgressFields> {
+  testcaseResult?: Record<string, TestcaseResult>;
+  samples?: Record<number, TestcaseProgressReference>;
+  subtasks?: Record<number, { score?: number; testcases?: Record<number, TestcaseProgressReference> }>;
+}
+
+// The state of a sample or testcase, stored in a Uint8Array per subtask instead of a reference object each
+const STATE_WAITING = 0;
+const STATE_RUNNING = 1;
+const STATE_FINISHED = 2;
+const STATE_SKIPPED = 3;
+
+// Shared by all references in the snapshots, they're never modified
+const REFERENCE_WAITING: TestcaseProgressReference = Object.freeze({ waiting: true });
+const REFERENCE_RUNNING: TestcaseProgressReference = Object.freeze({ running: true });
+const REFERENCE_SKIPPED: TestcaseProgressReference = Object.freeze({});
+
+const FIELDS: (keyof SubmissionProgressFields)[] = [
+  "progressType",
+  "status",
+  "score",
+  "totalOccupiedTime",
+  "compile",
+  "systemMessage"
+];
+
+// The key of the change of the whole progress (including its structure)
+const KEY_ALL = -1;
+
+interface TestcasesState {
+  states: Uint8Array;
+  // The hash of each finished testcase
+  hashes: string[];
+}
+
+function createTestcasesState(count: number): TestcasesState {
+  return { states: new Uint8Array(count), hashes: new Array(count) };
+}
+
+function getReference(testcases: TestcasesState, index: number): TestcaseProgressReference {
+  switch (testcases.states[index]) {
+    case STATE_WAITING:
+      return REFERENCE_WAITING;
+    case STATE_RUNNING:
+      return REFERENCE_RUNNING;
+    case STATE_FINISHED:
+      return { testcaseHash: testcases.hashes[index] };
+    default:
+      return REFERENCE_SKIPPED;
+  }
+}
+
+/**
+ * The progress of a submission, kept compact for problems with many testcases: the references are states in typed
+ * arrays and the changes are numeric keys, the progress object is only built for a snapshot (and cached until the
+ * next change).
+ *
+ * The keys of the changes are `KEY_ALL`, the index of a field in `FIELDS`, then the subtasks' scores, the samples
+ * and the testcases of all subtasks in order.
+ */
+export class SubmissionProgressTracker<TestcaseResult> extends VersionedProgress<
+  SubmissionProgress<TestcaseResult>,
+  SubmissionProgressDelta<TestcaseResult>
+> {
+  private fields: SubmissionProgress<TestcaseResult> = { progressType: null };
+
+  private running = false;
+
+  private testcaseResult: Record<string, TestcaseResult> = {};
+
+  private samples: TestcasesState;
+
+  private subtasks: (TestcasesState & { score: number; fullScore: number })[] = [];
+
+  private samplesKey: number;
+
+  // The key of the first testcase of each subtask
+  private subtaskTestcasesKeys: number[] = [];
+
+  private snapshot: SubmissionProgress<TestcaseResult> = null;
+
+  private markChanged(key: number) {
+    this.snapshot = null;
+    this.changed(key);
+  }
+
+  reset(progress: SubmissionProgress<TestcaseResult>) {
+    this.fields = progress;
+    this.running = false;
+    this.testcaseResult = {};
+    this.samples = null;
+    this.subtasks = [];
+    this.markChanged(KEY_ALL);
+  }
+
+  update(fields: Partial<SubmissionProgressFields>) {
+    // A field not in FIELDS has no key of its change, and would be lost from the deltas
+    const keys = Object.keys(fields).map(field => {
+      const key = FIELDS.indexOf(field as keyof SubmissionProgressFields);
+      if (key === -1) throw new Error(`Unknown field of a submission progress: ${field}`);
+      return key;
+    });
+
+    Object.assign(this.fields, fields);
+    for (const key of keys) this.markChanged(key);
+  }
+
+  startRunning(
+    samplesCount: number,
+    subtasks: { fullScore: number; testcasesCount: number }[],
+    fields: Partial<SubmissionProgressFields>
+  ) {
+    Object.assign(this.fields, fields);
+    this.running = true;
+    this.testcaseResult = {};
+    this.samples = samplesCount ? createTestcasesState(samplesCount) : null;
+    this.subtasks = subtasks.map(({ fullScore, testcasesCount }) => ({
+      ...createTestcasesState(testcasesCount),
+      score: null,
+      fullScore
+    }));
+
+    this.samplesKey = FIELDS.length + subtasks.length;
+    let key = this.samplesKey + samplesCount;
+    this.subtaskTestcasesKeys = subtasks.map(({ testcasesCount }) => {
+      key += testcasesCount;
+      return key - testcasesCount;
+    });
+
+    this.markChanged(KEY_ALL);
+  }
+
+  getResult(testcaseHash: string): TestcaseResult {
+    return this.testcaseResult[testcaseHash];
+  }
+
+  private setState(
+    testcases: TestcasesState,
+    index: number,
+    key: number,
+    state: number,
+    testcaseHash?: string,
+    result?: TestcaseResult
+  ) {
+    if (state === STATE_FINISHED) {
+      this.testcaseResult[testcaseHash] = result;
+      testcases.hashes[index] = testcaseHash;
+    }
+    testcases.states[index] = state;
+    this.markChanged(key);
+  }
+
+  sampleRunning(sampleId: number) {
+    this.setState(this.samples, sampleId, this.samplesKey + sampleId, STATE_RUNNING);
+  }
+
+  /**
+   * @param result `null` if skipped.
+   */
+  sampleFinished(sampleId: number, testcaseHash: string, result: TestcaseResult) {
+    const state = result ? STATE_FINISHED : STATE_SKIPPED;
+    this.setState(this.samples, sampleId, this.samplesKey + sampleId, state, testcaseHash, result);
+  }
+
+  testcaseRunning(subtaskIndex: number, testcaseIndex: number) {
+    const key = this.subtaskTestcasesKeys[subtaskIndex] + testcaseIndex;
+    this.setState(this.subtasks[subtaskIndex], testcaseIndex, key, STATE_RUNNING);
+  }
+
+  /**
+   * @param result `null` if skipped.
+   */
+  testcaseFinished(subtaskIndex: number, testcaseIndex: number, testcaseHash: string, result: TestcaseResult) {
+    const key = this.subtaskTestcasesKeys[subtaskIndex] + testcaseIndex;
+    const state = result ? STATE_FINISHED : STATE_SKIPPED;
+    this.setState(this.subtasks[subtaskIndex], testcaseIndex, key, state, testcaseHash, result);
+  }
+
+  getSubtaskFullScore(subtaskIndex: number) {
+    return this.subtasks[subtaskIndex].fullScore;
+  }
+
+  setSubtaskScore(subtaskIndex: number, score: number) {
+    this.subtasks[subtaskIndex].score = score;
+    this.markChanged(FIELDS.length + subtaskIndex);
+  }
+
+  getSnapshot() {
+    if (this.snapshot) return this.snapshot;
+    if (!this.running) return (this.snapshot = this.fields);
+
+    const toReferences = (testcases: TestcasesState) =>
+      Array.from(testcases.states, (_, i) => getReference(testcases, i));
+    this.snapshot = {
+      ...this.fields,
+      testcaseResult: this.testcaseResult,
+      ...(this.samples ? { samples: toReferences(this.samples) } : {}),
+      subtasks: this.subtasks.map(subtask => ({
+        score: subtask.score,
+        fullScore: subtask.fullScore,
+        testcases: toReferences(subtask)
+      }))
+    };
+    return this.snapshot;
+  }
+
+  getDelta(sinceVersion: number) {
+    const keys = this.getChangedKeys(sinceVersion);
+    if (!keys || keys.has(KEY_ALL)) return null;
+
+    const delta: SubmissionProgressDelta<TestcaseResult> = {};
+    const getSubtask = (subtaskIndex: number) => {
+      if (!delta.subtasks) delta.subtasks = {};
+      if (!delta.subtasks[subtaskIndex]) delta.subtasks[subtaskIndex] = {};
+      return delta.subtasks[subtaskIndex];
+    };
+    const addResult = (testcases: TestcasesState, index: number) => {
+      if (testcases.states[index] !== STATE_FINISHED) return;
+      if (!delta.testcaseResult) delta.testcaseResult = {};
+      delta.testcaseResult[testcases.hashes[index]] = this.testcaseResult[testcases.hashes[index]];
+    };
+
+    for (const key of keys) {
+      if (key < FIELDS.length) {
+        delta[FIELDS[key] as string] = this.fields[FIELDS[key]];
+      } else if (key < this.samplesKey) {
+        const subtaskIndex = key - FIELDS.length;
+        getSubtask(subtaskIndex).score = this.subtasks[subtaskIndex].score;
+      } else if (this.samples && key < this.samplesKey + this.samples.states.length) {
+        const sampleId = key - this.samplesKey;
+        if (!delta.samples) delta.samples = {};
+        delta.samples[sampleId] = getReference(this.samples, sampleId);
+        addResult(this.samples, sampleId);
+      } else {
+        // The last subtask whose first testcase's key <= key
+        let low = 0;
+        let high = this.subtasks.length - 1;
+        while (low < high) {
+          const middle = (low + high + 1) >> 1;
+          if (this.subtaskTestcasesKeys[middle] <= key) low = middle;
+          else high = middle - 1;
+        }
+
+        const testcaseIndex = key - this.subtaskTestcasesKeys[low];
+        const subtask = getSubtask(low);
+        if (!subtask.testcases) subtask.testcases = {};
+        subtask.testcases[testcaseIndex] = getReference(this.subtasks[low], testcaseIndex);
+        addResult(this.subtasks[low], testcaseIndex);
+      }
+    }
+
+    return delta;
+  }
+}
@@ -201,7 +201,8 @@ export async function runTask(
         const compileResult = await compile({
           language: judgeInfo.checker.language,
           code: await fs.promises.readFile(getFile(task.extraInfo.testData[judgeInfo.checker.filename]), "utf-8"),
-          compileAndRunOptions: judgeInfo.checker.compileAndRunOptions
+          compileAndRunOptions: judgeInfo.checker.compileAndRunOptions,
+          shareRemotely: true
         });
 
         if (!(compileResult instanceof CompileResultSuccess)) {
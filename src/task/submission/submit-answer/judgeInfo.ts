@@ -1,11 +1,9 @@
-import objectHash from "object-hash";
-
 import { SubmissionTask, ProblemSample } from "@/task/submission";
 import { Checker, getCheckerMeta } from "@/checkers";
 import { getFileHash } from "@/file";
 
 import { ExtraParametersSubmitAnswer, SubmissionContentSubmitAnswer, TestcaseResultSubmitAnswer } from ".";
-import { validateJudgeInfoSubtasks } from "../common";
+import { validateJudgeInfoSubtasks, createTestcaseHasher } from "../common";
 
 export interface TestcaseConfig {
   // Input files are optional for judging
@@ -73,26 +71,22 @@ export async function hashSampleTestcase(
 }
 /* eslint-enable @typescript-eslint/no-unused-vars */
 
-export async function hashTestcase(
+export function hashTestcases(
   judgeInfo: JudgeInfoSubmitAnswer,
   subtaskIndex: number,
-  testcaseIndex: number,
   testData: Record<string, string>,
   // eslint-disable-next-line @typescript-eslint/no-unused-vars
   [unzipResult, customCheckerCompileResult]: ExtraParametersSubmitAnswer
 ) {
-  const testcase = judgeInfo.subtasks[subtaskIndex].testcases[testcaseIndex];
-
-  const [inputDataHash, outputDataHash] = await Promise.all([
-    getFileHash(testData[testcase.inputFile]),
-    getFileHash(testData[testcase.outputFile])
-  ]);
-
-  return objectHash({
-    checkerMeta: getCheckerMeta(judgeInfo),
-    inputDataHash,
-    outputDataHash,
-    userOutputFilename: testcase.userOutputFilename || testcase.outputFile,
-    customCheckerCompileTaskHash: customCheckerCompileResult && customCheckerCompileResult.compileTaskHash
-  });
+  return createTestcaseHasher(
+    {
+      checkerMeta: getCheckerMeta(judgeInfo),
+      customCheckerCompileTaskHash: customCheckerCompileResult && customCheckerCompileResult.compileTaskHash
+    },
+    judgeInfo.subtasks[subtaskIndex].testcases,
+    async testcase => [
+      ...(await Promise.all([getFileHash(testData[testcase.inputFile]), getFileHash(testData[testcase.outputFile])])),
+      testcase.userOutputFilename || testcase.outputFile
+    ]
+  );
 }
@@ -1,11 +1,11 @@
 import fs from "fs";
 
 import { v4 as uuid } from "uuid";
-import { SandboxStatus } from "simple-sandbox";
+import { SandboxStatus, SandboxResult } from "simple-sandbox";
 
 import { SubmissionTask, SubmissionStatus, ProblemSample } from "@/task/submission";
 import { compile, CompileResultSuccess } from "@/compile";
-import { CpuAffinityStrategy, runSandbox, SANDBOX_INSIDE_PATH_BINARY, SANDBOX_INSIDE_PATH_WORKING } from "@/sandbox";
+import { CpuAffinityStrategy, startSandbox, SANDBOX_INSIDE_PATH_BINARY, SANDBOX_INSIDE_PATH_WORKING } from "@/sandbox";
 import getLanguage from "@/languages";
 import { serverSideConfig } from "@/config";
 import { safelyJoinPath, MappedPath } from "@/utils";
@@ -21,6 +21,9 @@ import { ConfigurationError } from "@/error";
 import { runBuiltinChecker } from "@/checkers/builtin";
 import { runCustomChecker, validateCustomChecker } from "@/checkers/custom";
 import * as fsNative from "@/fsNative";
+import { getStartupTimeAdjustment } from "@/calibration";
+import { IDLE_SYSTEM_MESSAGE, MemoryTimeline, startIdleWatch, startMemoryTimeline } from "@/processMonitor";
+import { SandboxDiagnostics } from "@/diagnostics";
 
 import { JudgeInfoTraditional, TestcaseConfig } from "./judgeInfo";
 
@@ -60,6 +63,9 @@ export interface TestcaseResultTraditional {
   userError?: OmittableString;
   checkerMessage?: OmittableString;
   systemMessage?: OmittableString;
+  diagnostics?: SandboxDiagnostics;
+  memoryTimeline?: MemoryTimeline;
+  timingRuns?: number[];
 }
 
 export interface SubmissionContentTraditional {
@@ -69,7 +75,9 @@ export interface SubmissionContentTraditional {
   skipSamples?: boolean;
 }
 
-export type ExtraParametersTraditional = [CompileResultSuccess, CompileResultSuccess];
+// The last one is the startup time adjustment (ms) of the user's program, got once for a submission since a
+// recalibration could change it between testcases
+export type ExtraParametersTraditional = [CompileResultSuccess, CompileResultSuccess, number];
 
 /**
  * Run a subtask testcase or sample testcase.
@@ -93,7 +101,7 @@ async function runTestcase(
   extraParameters: ExtraParametersTraditional,
   taskWorkingDirectory: string
 ): Promise<TestcaseResultTraditional> {
-  const [compileResult, customCheckerCompileResult] = extraParameters;
+  const [compileResult, customCheckerCompileResult, startupTime] = extraParameters;
 
   const isSample = sampleId != null;
 
@@ -136,12 +144,12 @@ async function runTestcase(
   const stderrFile = safelyJoinPath(workingDirectory, uuid());
 
   const languageConfig = getLanguage(task.extraInfo.submissionContent.language);
-  const sandboxResult = await runSandbox(task.taskId, {
+  const sandbox = await startSandbox(task.taskId, {
     ...languageConfig.run({
       binaryDirectoryInside: binaryDirectory.inside,
       workingDirectoryInside: workingDirectory.inside,
       compileAndRunOptions: task.extraInfo.submissionContent.compileAndRunOptions,
-      time: timeLimit,
+      time: timeLimit + startupTime,
       memory: memoryLimit,
       stdinFile: judgeInfo.fileIo ? null : inputFile.inside,
       stdoutFile: judgeInfo.fileIo ? null : outputFile.inside,
@@ -149,7 +157,7 @@ async function runTestcase(
       parameters: [],
       compileResultExtraInfo: compileResult.extraInfo
     }),
-    time: timeLimit,
+    time: timeLimit + startupTime,
     memory: memoryLimit * 1024 * 1024,
     workingDirectory: workingDirectory.inside,
     tempDirectoryOutside,
@@ -165,10 +173,26 @@ async function runTestcase(
     ],
     cpuAffinity: CpuAffinityStrategy.UserProgram
   });
+  const idleWatch = startIdleWatch([sandbox], false);
+  const memoryTimeline = startMemoryTimeline(sandbox.pid);
+  let sandboxResult: SandboxResult;
+  try {
+    sandboxResult = await sandbox.waitForStop();
+  } finally {
+    idleWatch?.stop();
+    memoryTimeline?.stop();
+  }
+  const idle = idleWatch?.stop();
+  const diagnostics = sandbox.getDiagnostics();
+  if (diagnostics) result.diagnostics = diagnostics;
+  if (memoryTimeline) result.memoryTimeline = memoryTimeline.stop();
 
   const workingDirectorySize = await fsNative.calcSize(workingDirectory.outside);
   const inputFileSize = await fsNative.calcSize(inputFile.outside);
-  if (workingDirectorySize - inputFileSize > serverSideConfig.limit.outputSize) {
+  if (idle) {
+    result.status = TestcaseStatusTraditional.TimeLimitExceeded;
+    result.systemMessage = IDLE_SYSTEM_MESSAGE;
+  } else if (workingDirectorySize - inputFileSize > serverSideConfig.limit.outputSize) {
     result.status = TestcaseStatusTraditional.OutputLimitExceeded;
   } else if (sandboxResult.status === SandboxStatus.TimeLimitExceeded) {
     result.status = TestcaseStatusTraditional.TimeLimitExceeded;
@@ -191,7 +215,7 @@ async function runTestcase(
     : await readFileOmitted(getFile(task.extraInfo.testData[testcase.outputFile]), serverSideConfig.limit.dataDisplay);
   result.userOutput = await readFileOmitted(outputFile.outside, serverSideConfig.limit.dataDisplay);
   result.userError = await readFileOmitted(stderrFile.outside, serverSideConfig.limit.stderrDisplay);
-  result.time = sandboxResult.time / 1e6;
+  result.time = Math.max(0, sandboxResult.time / 1e6 - startupTime);
   result.memory = sandboxResult.memory / 1024;
 
   // Finished running user's program, now run checker
@@ -265,7 +289,8 @@ export async function runTask(
     const compileResult = await compile({
       language: judgeInfo.checker.language,
       code: await fs.promises.readFile(getFile(task.extraInfo.testData[judgeInfo.checker.filename]), "utf-8"),
-      compileAndRunOptions: judgeInfo.checker.compileAndRunOptions
+      compileAndRunOptions: judgeInfo.checker.compileAndRunOptions,
+      shareRemotely: true
     });
 
     if (!(compileResult instanceof CompileResultSuccess)) {
@@ -298,8 +323,16 @@ export async function runTask(
   try {
     await runCommonTask({
       task,
-      extraParameters: [compileResult, customCheckerCompileResult],
-      onTestcase: runTestcase
+      extraParameters: [
+        compileResult,
+        customCheckerCompileResult,
+        getStartupTimeAdjustment(
+          task.extraInfo.submissionContent.language,
+          task.extraInfo.submissionContent.compileAndRunOptions
+        )
+      ],
+      onTestcase: runTestcase,
+      timingRerun: true
     });
   } finally {
     await compileResult.dereference();
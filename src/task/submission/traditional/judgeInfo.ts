@@ -1,12 +1,10 @@
-import objectHash from "object-hash";
-
 import { SubmissionTask, ProblemSample } from "@/task/submission";
 import { Checker, getCheckerMeta } from "@/checkers";
 import { hashData } from "@/utils";
 import { getFileHash } from "@/file";
 
 import { ExtraParametersTraditional, SubmissionContentTraditional, TestcaseResultTraditional } from ".";
-import { validateJudgeInfoSubtasks, validateJudgeInfoExtraSourceFiles } from "../common";
+import { validateJudgeInfoSubtasks, validateJudgeInfoExtraSourceFiles, createTestcaseHasher } from "../common";
 
 export interface TestcaseConfig {
   inputFile?: string;
@@ -98,47 +96,50 @@ export async function validateJudgeInfo(
 }
 /* eslint-enable no-throw-literal */
 
-export async function hashSampleTestcase(
+function getCommonHashParts(
   judgeInfo: JudgeInfoTraditional,
-  sample: ProblemSample,
-  [compileResult, customCheckerCompileResult]: ExtraParametersTraditional
+  [compileResult, customCheckerCompileResult, startupTime]: ExtraParametersTraditional
 ) {
-  const [inputDataHash, outputDataHash] = await Promise.all([hashData(sample.inputData), hashData(sample.outputData)]);
-
-  return objectHash({
+  return {
     fileIo: judgeInfo.fileIo,
     checkerMeta: getCheckerMeta(judgeInfo),
-    inputDataHash,
-    outputDataHash,
-    timeLimit: judgeInfo.timeLimit,
-    memoryLimit: judgeInfo.memoryLimit,
     compileTaskHash: compileResult.compileTaskHash,
-    customCheckerCompileTaskHash: customCheckerCompileResult?.compileTaskHash
-  });
+    customCheckerCompileTaskHash: customCheckerCompileResult?.compileTaskHash,
+    startupTime
+  };
+}
+
+export async function hashSampleTestcase(
+  judgeInfo: JudgeInfoTraditional,
+  sample: ProblemSample,
+  extraParameters: ExtraParametersTraditional
+) {
+  return await createTestcaseHasher(
+    getCommonHashParts(judgeInfo, extraParameters),
+    [sample],
+    async ({ inputData, outputData }) => [
+      ...(await Promise.all([hashData(inputData), hashData(outputData)])),
+      judgeInfo.timeLimit,
+      judgeInfo.memoryLimit
+    ]
+  )(0);
 }
 
-export async function hashTestcase(
+export function hashTestcases(
   judgeInfo: JudgeInfoTraditional,
   subtaskIndex: number,
-  testcaseIndex: number,
   testData: Record<string, string>,
-  [compileResult, customCheckerCompileResult]: ExtraParametersTraditional
+  extraParameters: ExtraParametersTraditional
 ) {
-  const testcase = judgeInfo.subtasks[subtaskIndex].testcases[testcaseIndex];
-
-  const [inputDataHash, outputDataHash] = await Promise.all([
-    getFileHash(testData[testcase.inputFile]),
-    getFileHash(testData[testcase.outputFile])
-  ]);
-
-  return objectHash({
-    fileIo: judgeInfo.fileIo,
-    checkerMeta: getCheckerMeta(judgeInfo),
-    inputDataHash,
-    outputDataHash,
-    timeLimit: testcase.timeLimit || judgeInfo.subtasks[subtaskIndex].timeLimit || judgeInfo.timeLimit,
-    memoryLimit: testcase.memoryLimit || judgeInfo.subtasks[subtaskIndex].memoryLimit || judgeInfo.memoryLimit,
-    compileTaskHash: compileResult.compileTaskHash,
-    customCheckerCompileTaskHash: customCheckerCompileResult?.compileTaskHash
-  });
+  const subtask = judgeInfo.subtasks[subtaskIndex];
+
+  return createTestcaseHasher(
+    getCommonHashParts(judgeInfo, extraParameters),
+    subtask.testcases,
+    async testcase => [
+      ...(await Promise.all([getFileHash(testData[testcase.inputFile]), getFileHash(testData[testcase.outputFile])])),
+      testcase.timeLimit || subtask.timeLimit || judgeInfo.timeLimit,
+      testcase.memoryLimit || subtask.memoryLimit || judgeInfo.memoryLimit
+    ]
+  );
 }
@@ -1,31 +1,195 @@
-import Queue from "promise-queue";
+import fs from "fs";
+import os from "os";
+import { performance } from "perf_hooks";
+
+import winston from "winston";
 
 import config from "./config";
 import { ensureDirectoryEmpty } from "./utils";
 import { Disposer } from "./posixUtils";
+import { traceSpan, runInTraceThread } from "./tracing";
+import { Counter, Gauge, Histogram, Labels } from "./metrics";
+
+export enum TaskPriority {
+  Normal = 0,
+  /**
+   * Only started when no normal task is waiting, e.g. timing re-runs which should run on an otherwise idle slot.
+   */
+  Low = 1
+}
 
 const availableWorkingDirectories = config.taskWorkingDirectories;
-const queue = new Queue(Math.min(availableWorkingDirectories.length, config.maxConcurrentTasks));
+// For the trace thread of each working directory, since the array above is used as a stack
+const workingDirectoryIds = new Map(availableWorkingDirectories.map((directory, i) => [directory, i + 1]));
+const maxRunningTasks = Math.min(availableWorkingDirectories.length, config.maxConcurrentTasks);
+
+/**
+ * The memory limit of the judge's cgroup (v2 or v1), or the total memory if not limited.
+ */
+function getAvailableMemory() {
+  const readLimit = (path: string) => {
+    try {
+      const value = Number(fs.readFileSync(path, "utf-8").trim());
+      // "max" (NaN) or a huge value (v1) if not limited
+      return Number.isSafeInteger(value) && value > 0 ? value : Infinity;
+    } catch (e) {
+      return Infinity;
+    }
+  };
+
+  let cgroupLimit = Infinity;
+  try {
+    for (const line of fs.readFileSync("/proc/self/cgroup", "utf-8").split("\n")) {
+      const [, controllers, path] = line.split(":");
+      if (controllers === "") cgroupLimit = Math.min(cgroupLimit, readLimit(`/sys/fs/cgroup${path}/memory.max`));
+      else if (controllers?.split(",").includes("memory"))
+        cgroupLimit = Math.min(cgroupLimit, readLimit(`/sys/fs/cgroup/memory${path}/memory.limit_in_bytes`));
+    }
+  } catch (e) {
+    // Not Linux or no cgroup
+  }
+
+  return Math.min(cgroupLimit, os.totalmem());
+}
+
+/**
+ * With `config.memoryAdmission`, the tasks reserve memory (e.g. a testcase's memory limit and its files in the
+ * tmpfs) while running. A task waits for headroom if it doesn't fit in the budget, unless nothing is running.
+ */
+function getMemoryBudget() {
+  if (!config.memoryAdmission) return Infinity;
+  if (config.memoryAdmission.budget != null) return config.memoryAdmission.budget * 1024 * 1024;
+  return getAvailableMemory() - (config.memoryAdmission.reserved ?? 512) * 1024 * 1024;
+}
+
+const memoryBudget = getMemoryBudget();
+if (memoryBudget !== Infinity)
+  winston.info(`Memory admission budget of tasks: ${(memoryBudget / 1024 / 1024).toFixed(0)} MiB`);
+
+interface PendingTask {
+  memory: number;
+  start: () => void;
+  waitedForMemory?: boolean;
+}
+
+let runningTasks = 0;
+let reservedMemory = 0;
+// While a job of `runWhenIdle` runs, no task is started
+let idleJobRunning = false;
+const pendingTasks: Record<TaskPriority, PendingTask[]> = {
+  [TaskPriority.Normal]: [],
+  [TaskPriority.Low]: []
+};
+
+/* eslint-disable no-new */
+new Gauge("judge_task_queue_depth", "Tasks waiting for a working directory", () =>
+  [TaskPriority.Normal, TaskPriority.Low].map((priority): [Labels, number] => [
+    { priority: TaskPriority[priority] },
+    pendingTasks[priority].length
+  ])
+);
+new Gauge("judge_task_queue_running", "Tasks running in a working directory", () => [[{}, runningTasks]]);
+new Gauge("judge_task_queue_slots", "Tasks could run in the same time", () => [[{}, maxRunningTasks]]);
+new Gauge("judge_task_queue_reserved_bytes", "Memory reserved by the running tasks", () => [[{}, reservedMemory]]);
+new Gauge("judge_task_queue_memory_budget_bytes", "Memory the running tasks could reserve", () =>
+  memoryBudget === Infinity ? [] : [[{}, memoryBudget]]
+);
+/* eslint-enable no-new */
+const queueWaitSeconds = new Histogram("judge_task_queue_wait_seconds", "Time tasks waited for a working directory");
+
+const memoryWaits = new Counter(
+  "judge_task_queue_memory_waits_total",
+  "Tasks which waited for memory headroom with a free working directory"
+);
+
+function scheduleNext() {
+  if (idleJobRunning) return;
+
+  while (runningTasks < maxRunningTasks) {
+    const queue = pendingTasks[TaskPriority.Normal].length > 0 ? TaskPriority.Normal : TaskPriority.Low;
+    const next = pendingTasks[queue][0];
+    if (!next) return;
+
+    // The tasks are started in order, so a large task isn't starved by the smaller ones after it
+    if (runningTasks > 0 && reservedMemory + next.memory > memoryBudget) {
+      if (!next.waitedForMemory) memoryWaits.inc();
+      next.waitedForMemory = true;
+      return;
+    }
+
+    pendingTasks[queue].shift();
+    runningTasks++;
+    reservedMemory += next.memory;
+    next.start();
+  }
+}
 
 /**
  * We have limited working directories for tasks, so we couldn't run too many tasks in the same time.
  *
  * This function accepts a task that requires a working directory, and execute the task when a working
- * directory is available.
+ * directory is available. Waiting tasks are started in FIFO order, normal priority ones first.
  *
  * A `Disposer` is passed to task callback to ensure any POSIX resources could be disposed safely even if
  * there're exceptions.
+ *
+ * @param memory The memory (in bytes) the task uses at most, reserved while it runs, see `config.memoryAdmission`.
  */
-export async function runTaskQueued<T>(task: (taskWorkingDirectory: string, disposer?: Disposer) => Promise<T>) {
-  return await queue.add(async () => {
-    const taskWorkingDirectory = availableWorkingDirectories.pop();
-    const disposer = new Disposer();
-    try {
-      await ensureDirectoryEmpty(taskWorkingDirectory);
-      return await task(taskWorkingDirectory, disposer);
-    } finally {
-      availableWorkingDirectories.push(taskWorkingDirectory);
-      disposer.dispose();
-    }
-  });
+export async function runTaskQueued<T>(
+  task: (taskWorkingDirectory: string, disposer?: Disposer) => Promise<T>,
+  priority = TaskPriority.Normal,
+  memory = 0
+) {
+  const enqueueTime = performance.now();
+  await traceSpan(
+    "queue",
+    "queue",
+    () =>
+      new Promise<void>(resolve => {
+        pendingTasks[priority].push({ memory, start: resolve });
+        scheduleNext();
+      }),
+    { priority: TaskPriority[priority] }
+  );
+  queueWaitSeconds.observe({ priority: TaskPriority[priority] }, (performance.now() - enqueueTime) / 1e3);
+
+  const taskWorkingDirectory = availableWorkingDirectories.pop();
+  const disposer = new Disposer();
+  try {
+    // Traced in the thread of the working directory
+    return await runInTraceThread(workingDirectoryIds.get(taskWorkingDirectory), () =>
+      traceSpan("run", "queue", async () => {
+        await ensureDirectoryEmpty(taskWorkingDirectory);
+        return await task(taskWorkingDirectory, disposer);
+      })
+    );
+  } finally {
+    availableWorkingDirectories.push(taskWorkingDirectory);
+
+    // The next task is started asynchronously, after disposing
+    runningTasks--;
+    reservedMemory -= memory;
+    scheduleNext();
+
+    disposer.dispose();
+  }
+}
+
+/**
+ * Run a job while no task is running, and start no task until it finishes, e.g. the timing probe whose busy loop
+ * on the user program cores shouldn't be measured by, or slow down, any task. Return `false` without running it if
+ * a task is running or waiting.
+ */
+export async function runWhenIdle(job: () => Promise<void>) {
+  const waitingTasks = pendingTasks[TaskPriority.Normal].length + pendingTasks[TaskPriority.Low].length;
+  if (idleJobRunning || runningTasks > 0 || waitingTasks > 0) return false;
+
+  idleJobRunning = true;
+  try {
+    await job();
+    return true;
+  } finally {
+    idleJobRunning = false;
+    scheduleNext();
+  }
 }
@@ -0,0 +1,154 @@
+import os from "os";
+
+import bindings from "bindings";
+import winston from "winston";
+
+import config from "./config";
+import { runWhenIdle } from "./taskQueue";
+
+const monitor = bindings("monitor");
+
+export interface TimingProbeSample {
+  cpu: number;
+  /**
+   * The duration (ms) of the fixed workload.
+   */
+  duration: number;
+  /**
+   * The mean duration (ms) of the recent samples of this core.
+   */
+  mean: number;
+  /**
+   * The coefficient of variation (stddev / mean) of the recent samples of this core.
+   */
+  variation: number;
+  windowSize: number;
+  /**
+   * The current frequency (kHz) of the core, 0 if unknown.
+   */
+  frequency: number;
+  /**
+   * The ratio of the core's steal time since the last probe, non-zero if a hypervisor takes the core away.
+   */
+  stealRatio: number;
+}
+
+export interface TimingStatus {
+  unreliable: boolean;
+  // cpu => last sample
+  cpus: Record<number, TimingProbeSample>;
+}
+
+let status: TimingStatus = null;
+const listeners = new Set<(status: TimingStatus) => void>();
+
+export function getTimingStatus() {
+  return status;
+}
+
+export function onTimingStatusChange(listener: (status: TimingStatus) => void) {
+  listeners.add(listener);
+  return () => listeners.delete(listener);
+}
+
+/**
+ * Resolve once the node's timing is not flagged unreliable (immediately if it's not).
+ */
+export async function waitForReliableTiming() {
+  if (!status?.unreliable) return;
+
+  await new Promise<void>(resolve => {
+    const off = onTimingStatusChange(newStatus => {
+      if (newStatus.unreliable) return;
+      off();
+      resolve();
+    });
+  });
+}
+
+function onSample(sample: TimingProbeSample) {
+  status.cpus[sample.cpu] = sample;
+
+  const unreliableCpus = Object.values(status.cpus).filter(
+    ({ variation, windowSize }) =>
+      windowSize >= config.timingMonitor.window && variation > config.timingMonitor.maxVariation
+  );
+  const unreliable = unreliableCpus.length > 0;
+  if (unreliable === status.unreliable) return;
+
+  status.unreliable = unreliable;
+  if (unreliable) {
+    const details = unreliableCpus
+      .map(({ cpu, variation, frequency, stealRatio }) =>
+        [
+          `CPU ${cpu}: variation ${(variation * 100).toFixed(1)}%`,
+          frequency && `frequency ${frequency / 1000} MHz`,
+          stealRatio && `steal ${(stealRatio * 100).toFixed(1)}%`
+        ]
+          .filter(x => x)
+          .join(", ")
+      )
+      .join("; ");
+    winston.warn(`Timing of this node is unreliable (${details})`);
+  } else winston.info("Timing of this node is reliable again");
+
+  listeners.forEach(listener => listener(status));
+}
+
+let probe: { requestRound: () => boolean; stop: () => void } = null;
+let roundTimer: NodeJS.Timeout = null;
+let onRoundEnd: () => void = null;
+
+function endRound() {
+  const resolve = onRoundEnd;
+  onRoundEnd = null;
+  if (resolve) resolve();
+}
+
+function runRound() {
+  return new Promise<void>(resolve => {
+    if (probe?.requestRound()) onRoundEnd = resolve;
+    else resolve();
+  });
+}
+
+function scheduleRound() {
+  roundTimer = setTimeout(async () => {
+    // The probe pins a busy loop to the user program cores, so it runs only when no task is running, and the queue
+    // starts no task until the round ends
+    await runWhenIdle(runRound);
+    if (probe) scheduleRound();
+  }, config.timingMonitor.interval);
+  roundTimer.unref();
+}
+
+/**
+ * Start the background native probe running a fixed workload on the idle user program cores, if enabled. Each
+ * round runs only when the task queue is idle and holds back the waiting tasks, it's skipped if a task is running.
+ */
+export function startTimingMonitor() {
+  if (!config.timingMonitor) return;
+
+  const cpus = config.timingMonitor.cpus || config.cpuAffinity?.userProgram || [...Array(os.cpus().length).keys()];
+  status = { unreliable: false, cpus: {} };
+  probe = monitor.startTimingProbe(
+    {
+      cpus,
+      window: config.timingMonitor.window,
+      maxBusyRatio: config.timingMonitor.maxBusyRatio
+    },
+    (sample: TimingProbeSample) => (sample ? onSample(sample) : endRound())
+  );
+  scheduleRound();
+
+  process.once("exit", stopTimingMonitor);
+}
+
+export function stopTimingMonitor() {
+  if (!probe) return;
+
+  clearTimeout(roundTimer);
+  probe.stop();
+  probe = null;
+  endRound();
+}
@@ -0,0 +1,185 @@
+import fs from "fs";
+import { join } from "path";
+import { AsyncLocalStorage } from "async_hooks";
+
+import winston from "winston";
+
+import config from "./config";
+import { eventString, getEventTask } from "./eventRing";
+
+/**
+ * Per-task span tracing, written as a Chrome trace event format JSON file for each traced task, which can be
+ * opened with chrome://tracing or https://ui.perfetto.dev.
+ *
+ * A task is traced if it's sampled with `tracing.sampleRate`, or on demand by sending SIGUSR2 to the judge
+ * process, which traces the next task consumed. The trace of the current task is passed along the async context,
+ * so nothing is recorded (and only a AsyncLocalStorage lookup is spent) when the task is not traced.
+ *
+ * Spans run in a task working directory are put on the thread of the directory, so they nest well. The others
+ * (e.g. waiting for the queue, which overlap) are async events.
+ */
+
+interface TraceEvent {
+  name: string;
+  cat: string;
+  ph: "X" | "b" | "e" | "i" | "M";
+  ts: number;
+  dur?: number;
+  pid: number;
+  tid: number;
+  id?: number;
+  s?: "t";
+  args?: Record<string, unknown>;
+}
+
+class Trace {
+  readonly events: TraceEvent[] = [];
+
+  private nextAsyncId = 0;
+
+  constructor(readonly taskId: string) {}
+
+  addSpan(name: string, category: string, start: number, end: number, tid: number, args?: Record<string, unknown>) {
+    if (tid) {
+      this.events.push({ name, cat: category, ph: "X", ts: start, dur: end - start, pid: 1, tid, args });
+    } else {
+      const id = ++this.nextAsyncId;
+      this.events.push({ name, cat: category, ph: "b", ts: start, pid: 1, tid, id, args });
+      this.events.push({ name, cat: category, ph: "e", ts: end, pid: 1, tid, id });
+    }
+  }
+
+  addInstant(name: string, category: string, time: number, tid: number, args?: Record<string, unknown>) {
+    this.events.push({ name, cat: category, ph: "i", ts: time, pid: 1, tid, s: "t", args });
+  }
+
+  toJSON() {
+    const tids = new Set(this.events.map(event => event.tid));
+    const metadata: TraceEvent[] = [
+      { name: "process_name", cat: "", ph: "M", ts: 0, pid: 1, tid: 0, args: { name: `Task ${this.taskId}` } },
+      ...[...tids].map(
+        (tid): TraceEvent => ({
+          name: "thread_name",
+          cat: "",
+          ph: "M",
+          ts: 0,
+          pid: 1,
+          tid,
+          args: { name: tid ? `Working directory ${tid}` : "Task" }
+        })
+      )
+    ];
+    return { traceEvents: [...metadata, ...this.events], displayTimeUnit: "ms" };
+  }
+}
+
+interface TraceContext {
+  trace: Trace;
+  // The 1-based index of the task working directory running in, or 0 if not in one
+  tid: number;
+}
+
+const storage = new AsyncLocalStorage<TraceContext>();
+
+let onDemandTraces = 0;
+
+/**
+ * Create the trace directory and start tracing on SIGUSR2, if configured. Until then no task is traced.
+ */
+export function startTracing() {
+  if (!config.tracing) return;
+
+  fs.mkdirSync(config.tracing.directory, { recursive: true });
+  process.on("SIGUSR2", () => {
+    onDemandTraces++;
+    winston.info("Received SIGUSR2, tracing the next task");
+  });
+}
+
+/**
+ * Microseconds of CLOCK_MONOTONIC, the same clock as the native addons' timings.
+ */
+export function traceNow() {
+  const [seconds, nanoseconds] = process.hrtime();
+  return seconds * 1e6 + nanoseconds / 1e3;
+}
+
+/**
+ * Run a task with tracing if it's sampled or requested, and write the trace after it finished.
+ */
+export async function runTraced<T>(taskId: string, callback: () => Promise<T>): Promise<T> {
+  if (!config.tracing) return await callback();
+  if (onDemandTraces > 0) onDemandTraces--;
+  else if (!(Math.random() < config.tracing.sampleRate)) return await callback();
+
+  const trace = new Trace(taskId);
+  const start = traceNow();
+  try {
+    return await storage.run({ trace, tid: 0 }, callback);
+  } finally {
+    trace.addSpan("task", "task", start, traceNow(), 0);
+
+    const filePath = join(config.tracing.directory, `${taskId}.json`);
+    fs.promises
+      .writeFile(filePath, JSON.stringify(trace))
+      .then(() => winston.info(`Written trace of task ${taskId} to ${filePath}`))
+      .catch(e => winston.error(`Failed to write trace of task ${taskId}: ${e}`));
+  }
+}
+
+/**
+ * Run a callback in the thread of a task working directory.
+ */
+export function runInTraceThread<T>(tid: number, callback: () => T): T {
+  const context = storage.getStore();
+  if (!context) return callback();
+  return storage.run({ trace: context.trace, tid }, callback);
+}
+
+export async function traceSpan<T>(
+  name: string,
+  category: string,
+  callback: () => Promise<T>,
+  args?: Record<string, unknown>
+): Promise<T> {
+  const context = storage.getStore();
+  if (!context) return await callback();
+
+  const start = traceNow();
+  try {
+    return await callback();
+  } finally {
+    context.trace.addSpan(name, category, start, traceNow(), context.tid, args);
+  }
+}
+
+/**
+ * Add a span from `start` (returned by `traceNow()`) to now.
+ */
+export function traceSpanSince(name: string, category: string, start: number, args?: Record<string, unknown>) {
+  const context = storage.getStore();
+  if (context) context.trace.addSpan(name, category, start, traceNow(), context.tid, args);
+}
+
+export function traceInstant(name: string, category: string, args?: Record<string, unknown>) {
+  const context = storage.getStore();
+  if (context) context.trace.addInstant(name, category, traceNow(), context.tid, args);
+}
+
+/**
+ * The native addons write the start and end time (in microseconds of CLOCK_MONOTONIC) of an operation on their
+ * threads to the first two elements of the `Float64Array(4)` passed, and record an event of the operation with the
+ * task number and operation (string) of the last two to the event ring (see eventRing.ts).
+ */
+export function createNativeTiming(operation: string) {
+  return new Float64Array([0, 0, getEventTask(), eventString(operation)]);
+}
+
+/**
+ * Add a span with the time recorded by a native addon, if any.
+ */
+export function traceNativeSpan(name: string, category: string, timing: Float64Array, args?: Record<string, unknown>) {
+  const context = storage.getStore();
+  if (!context || !timing || !timing[1]) return;
+  context.trace.addSpan(name, category, timing[0], timing[1], context.tid, args);
+}
@@ -1,6 +1,7 @@
 import fs from "fs";
 import crypto from "crypto";
 import { join, normalize } from "path";
+import { performance } from "perf_hooks";
 
 import axios from "axios";
 import AgentKeepAlive from "agentkeepalive";
@@ -8,6 +9,7 @@ import streamToString from "stream-to-string";
 
 import * as fsNative from "./fsNative";
 import config from "./config";
+import { Counter, Histogram } from "./metrics";
 
 export interface MappedPath {
   outside: string;
@@ -126,6 +128,12 @@ export function merge<K extends Key, V>(baseRecord: OverridableRecord<K, V>, ove
   return result;
 }
 
+const downloadedBytes = new Counter("judge_download_bytes_total", "Bytes of files downloaded");
+const downloadSeconds = new Histogram("judge_download_duration_seconds", "Time taken by successful downloads", [
+  0.01, 0.05, 0.1, 0.25, 0.5, 1, 2.5, 5, 10, 30, 60, 300
+]);
+const downloadFailures = new Counter("judge_download_failures_total", "Failed download attempts, including retried");
+
 // TODO: check download speed
 export const download = (() => {
   const agentOptions: AgentKeepAlive.HttpOptions & AgentKeepAlive.HttpsOptions = {
@@ -147,6 +155,7 @@ export const download = (() => {
     for (let retry = config.downloadRetry - 1; retry >= 0; retry--) {
       const fileStream: fs.WriteStream = fs.createWriteStream(destination);
       const abortController = new AbortController();
+      const startTime = performance.now();
 
       try {
         const response = await axios({
@@ -174,8 +183,11 @@ export const download = (() => {
         });
 
         // Download success!
+        downloadedBytes.inc({}, fileStream.bytesWritten);
+        downloadSeconds.observe({}, (performance.now() - startTime) / 1000);
         break;
       } catch (e) {
+        downloadFailures.inc({ reason: abortController.signal.aborted ? "timeout" : "error" });
         if (retry !== 0) continue;
 
         if (abortController.signal.aborted) {